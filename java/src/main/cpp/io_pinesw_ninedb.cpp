@@ -41,6 +41,9 @@ JNIEXPORT jlong JNICALL Java_io_pinesw_ninedb_KvDatabase_kvdb_1open(JNIEnv *env,
     if (context_reduce_callback)
     {
         config.writer.reduce = std::bind(&ContextReduceCallback::call, context_reduce_callback.get(), std::placeholders::_1, std::placeholders::_2);
+        // The callback can only be invoked from the calling thread.
+        config.enable_background_flush = false;
+        config.num_compaction_threads = 0;
     }
 
     try
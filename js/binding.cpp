@@ -42,9 +42,19 @@ NAPI_METHOD(kvdb_open)
     config.max_level_count = napi_object_get_property_uint32(env, config_obj, "maxLevelCount", 10);
     config.writer.initial_pbt_size = napi_object_get_property_uint32(env, config_obj, "initialPbtSize", 1 << 23);
     config.writer.max_node_children = napi_object_get_property_uint32(env, config_obj, "maxNodeChildren", 16);
+    config.writer.enable_prefix_compression = napi_object_get_property_boolean(env, config_obj, "enablePrefixEncoding", false);
+    config.writer.enable_lz4_compression = napi_object_get_property_boolean(env, config_obj, "enableCompression", false);
+    config.internal_node_cache_size = napi_object_get_property_uint32(env, config_obj, "internalNodeCacheSize", 0);
+    config.leaf_node_cache_size = napi_object_get_property_uint32(env, config_obj, "leafNodeCacheSize", 0);
+    config.node_cache_num_shards = napi_object_get_property_uint32(env, config_obj, "nodeCacheNumShards", 1);
+    config.enable_mmap_reads = napi_object_get_property_boolean(env, config_obj, "enableMmapReads", true);
+    config.pin_internal_nodes = napi_object_get_property_boolean(env, config_obj, "pinInternalNodes", false);
     if (context_reduce_callback)
     {
         config.writer.reduce = std::bind(&ContextReduceCallback::call, context_reduce_callback.get(), std::placeholders::_1, std::placeholders::_2);
+        // The callback can only be invoked from the calling thread.
+        config.enable_background_flush = false;
+        config.num_compaction_threads = 0;
     }
 
     try
@@ -97,10 +107,10 @@ NAPI_METHOD(kvdb_get)
     try
     {
         napi_value result;
-        std::string_view value;
+        ninedb::pbt::PinnedView value;
         if (context->kvdb.get(key, value))
         {
-            NAPI_STATUS_THROW_ERROR(napi_create_buffer_copy(env, value.size(), value.data(), NULL, &result));
+            NAPI_STATUS_THROW_ERROR(napi_create_buffer_copy(env, value.get().size(), value.get().data(), NULL, &result));
         }
         else
         {
@@ -128,14 +138,14 @@ NAPI_METHOD(kvdb_at)
     try
     {
         napi_value result;
-        std::string_view key;
-        std::string_view value;
+        ninedb::pbt::PinnedView key;
+        ninedb::pbt::PinnedView value;
         if (context->kvdb.at(index, key, value))
         {
             napi_value result_key;
             napi_value result_value;
-            NAPI_STATUS_THROW_ERROR(napi_create_buffer_copy(env, key.size(), key.data(), NULL, &result_key));
-            NAPI_STATUS_THROW_ERROR(napi_create_buffer_copy(env, value.size(), value.data(), NULL, &result_value));
+            NAPI_STATUS_THROW_ERROR(napi_create_buffer_copy(env, key.get().size(), key.get().data(), NULL, &result_key));
+            NAPI_STATUS_THROW_ERROR(napi_create_buffer_copy(env, value.get().size(), value.get().data(), NULL, &result_value));
             NAPI_STATUS_THROW_ERROR(napi_create_object(env, &result));
             NAPI_STATUS_THROW_ERROR(napi_set_named_property(env, result, "key", result_key));
             NAPI_STATUS_THROW_ERROR(napi_set_named_property(env, result, "value", result_value));
@@ -414,6 +424,13 @@ NAPI_METHOD(hrdb_open)
     config.max_level_count = napi_object_get_property_uint32(env, config_obj, "maxLevelCount", 10);
     config.writer.initial_pbt_size = napi_object_get_property_uint32(env, config_obj, "initialPbtSize", 1 << 23);
     config.writer.max_node_children = napi_object_get_property_uint32(env, config_obj, "maxNodeChildren", 16);
+    config.writer.enable_prefix_compression = napi_object_get_property_boolean(env, config_obj, "enablePrefixEncoding", false);
+    config.writer.enable_lz4_compression = napi_object_get_property_boolean(env, config_obj, "enableCompression", false);
+    config.internal_node_cache_size = napi_object_get_property_uint32(env, config_obj, "internalNodeCacheSize", 0);
+    config.leaf_node_cache_size = napi_object_get_property_uint32(env, config_obj, "leafNodeCacheSize", 0);
+    config.node_cache_num_shards = napi_object_get_property_uint32(env, config_obj, "nodeCacheNumShards", 1);
+    config.enable_mmap_reads = napi_object_get_property_boolean(env, config_obj, "enableMmapReads", true);
+    config.pin_internal_nodes = napi_object_get_property_boolean(env, config_obj, "pinInternalNodes", false);
 
     try
     {
@@ -16,6 +16,9 @@ export interface DbConfig {
     maxLevelCount?: number;
     internalNodeCacheSize?: number;
     leafNodeCacheSize?: number;
+    nodeCacheNumShards?: number;
+    enableMmapReads?: boolean;
+    pinInternalNodes?: boolean;
     enableCompression?: boolean;
     enablePrefixEncoding?: boolean;
     initialPbtSize?: number;
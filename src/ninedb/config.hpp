@@ -19,6 +19,63 @@ namespace ninedb
          */
         uint64_t max_level_count = 10;
 
+        /**
+         * If true, full buffers are written to disk on a background thread so that add() does not block on it.
+         * Must be false if the reduce function can only be called from the thread that calls add().
+         */
+        bool enable_background_flush = true;
+
+        /**
+         * The maximum number of full buffers waiting to be written to disk.
+         * When this number is reached, add() blocks until a buffer has been written.
+         */
+        uint64_t max_immutable_buffer_count = 2;
+
+        /**
+         * The number of background threads that perform merge operations.
+         * If 0, merges are performed on the thread that writes the buffer to disk.
+         */
+        uint64_t num_compaction_threads = 1;
+
+        /**
+         * The number of key ranges that a merge operation is split into, which are merged in parallel on up to one thread per core.
+         * The results are then stitched together into one file.
+         * If 1, merge operations run on a single thread.
+         */
+        uint64_t num_sub_compactions = 1;
+
+        /**
+         * The size in bytes of the cache for internal nodes, shared by all files of the db.
+         * If 0, internal nodes are read from the files every time.
+         */
+        uint64_t internal_node_cache_size = 0;
+
+        /**
+         * The size in bytes of the cache for leaf nodes, shared by all files of the db.
+         * If 0, leaf nodes are read from the files every time.
+         */
+        uint64_t leaf_node_cache_size = 0;
+
+        /**
+         * The number of shards that each node cache is split into, each with its own lock.
+         * More shards reduce contention between threads that read at once on many cores,
+         * but make each lookup slightly more expensive when there is little contention.
+         */
+        uint64_t node_cache_num_shards = 1;
+
+        /**
+         * If true, the files of the db are mapped into memory for reads.
+         * Otherwise, nodes are read from the files with explicit reads, which are counted in the I/O statistics of the db.
+         * Without memory mappings, the node caches decide how much of the files stays in memory.
+         */
+        bool enable_mmap_reads = true;
+
+        /**
+         * If true, the internal nodes of every file of the db are kept in memory while the file is open.
+         * Lookups then read at most one node from a file, and get_pinned_size() reports the memory this takes.
+         */
+        bool pin_internal_nodes = false;
+
         /**
          * The config for writers of the db.
          */
@@ -1,65 +1,396 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <cstdint>
-#include <map>
+#include <memory>
+#include <random>
 #include <string>
 #include <string_view>
-#include <type_traits>
 
 #include "./profiling.hpp"
 
 namespace ninedb::detail
 {
+    struct BufferNode
+    {
+        std::string key;
+        std::string value;
+        uint64_t sequence;
+        uint8_t height;
+        std::unique_ptr<std::atomic<BufferNode *>[]> next;
+        // The number of entries that next[level] moves forward, or the number of entries after this node if it is null
+        std::unique_ptr<std::atomic<uint64_t>[]> span;
+
+        BufferNode(std::string_view key, std::string_view value, uint64_t sequence, uint8_t height)
+            : key(key), value(value), sequence(sequence), height(height), next(new std::atomic<BufferNode *>[height]), span(new std::atomic<uint64_t>[height])
+        {
+            for (uint8_t i = 0; i < height; i++)
+            {
+                next[i].store(nullptr, std::memory_order_relaxed);
+                span[i].store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    /**
+     * Iterator over the key-value pairs of a buffer.
+     * Mirrors the interface of pbt::Iterator so both can be merged by ninedb::Iterator.
+     * Only entries that were added before the iterator was created are visited.
+     */
+    struct BufferIterator
+    {
+        BufferIterator(BufferNode *node, uint64_t limit)
+            : node(node), limit(limit)
+        {
+            skip_invisible();
+        }
+
+        /**
+         * Get the key at the current position.
+         */
+        std::string_view get_key() const
+        {
+            ZoneBuffer;
+
+            return node->key;
+        }
+
+        /**
+         * Get the value at the current position.
+         */
+        std::string_view get_value() const
+        {
+            ZoneBuffer;
+
+            return node->value;
+        }
+
+        /**
+         * Move the iterator to the next key-value pair.
+         */
+        void next()
+        {
+            ZoneBuffer;
+
+            node = node->next[0].load(std::memory_order_acquire);
+            skip_invisible();
+        }
+
+        /**
+         * Check if the iterator is at the end.
+         */
+        bool is_end() const
+        {
+            ZoneBuffer;
+
+            return node == nullptr;
+        }
+
+    private:
+        BufferNode *node;
+        uint64_t limit;
+
+        void skip_invisible()
+        {
+            while (node != nullptr && node->sequence >= limit)
+            {
+                node = node->next[0].load(std::memory_order_acquire);
+            }
+        }
+    };
+
+    /**
+     * In-memory write buffer holding key-value pairs in sorted order.
+     * Implemented as a skip list that one thread may add to while any number of threads read from it.
+     * Readers see the entries that were added before the read started, in the order they were added for equal keys.
+     * Each link stores the number of entries it skips, so entries can be found by index in logarithmic time.
+     */
     struct Buffer
     {
-        typedef typename std::multimap<std::string, std::string> buffer_map;
+        Buffer(uint32_t seed = 0)
+            : rng(seed), head(std::string_view(), std::string_view(), 0, MAX_HEIGHT) {}
 
+        ~Buffer()
+        {
+            BufferNode *node = head.next[0].load(std::memory_order_relaxed);
+            while (node != nullptr)
+            {
+                BufferNode *next = node->next[0].load(std::memory_order_relaxed);
+                delete node;
+                node = next;
+            }
+        }
+
+        Buffer(const Buffer &) = delete;
+        Buffer &operator=(const Buffer &) = delete;
+
+        /**
+         * Add a key-value pair to the buffer.
+         * If the key already exists, the pair is placed after the existing ones.
+         * Must only be called by one thread at a time.
+         */
         void insert(std::string_view key, std::string_view value)
         {
             ZoneBuffer;
 
+            // The nodes that the new node is linked after, and their positions in the list, with the head at 0
+            std::array<BufferNode *, MAX_HEIGHT> prev;
+            std::array<uint64_t, MAX_HEIGHT> rank;
+            BufferNode *node = &head;
+            uint64_t position = 0;
+            for (int level = MAX_HEIGHT - 1; level >= 0; level--)
+            {
+                BufferNode *next = node->next[level].load(std::memory_order_relaxed);
+                while (next != nullptr && next->key.compare(key) <= 0)
+                {
+                    position += node->span[level].load(std::memory_order_relaxed);
+                    node = next;
+                    next = node->next[level].load(std::memory_order_relaxed);
+                }
+                prev[level] = node;
+                rank[level] = position;
+            }
+
+            uint64_t sequence = count.load(std::memory_order_relaxed);
+            uint8_t height = random_height();
+            BufferNode *new_node = new BufferNode(key, value, sequence, height);
+            for (uint8_t level = 0; level < height; level++)
+            {
+                new_node->next[level].store(prev[level]->next[level].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                new_node->span[level].store(prev[level]->span[level].load(std::memory_order_relaxed) - (position - rank[level]), std::memory_order_relaxed);
+            }
+
+            // Readers that find entries by index check this counter to detect that the spans changed while they were read
+            uint64_t update_count = num_updates.load(std::memory_order_relaxed);
+            num_updates.store(update_count + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (uint8_t level = 0; level < height; level++)
+            {
+                prev[level]->span[level].store(position - rank[level] + 1, std::memory_order_relaxed);
+                prev[level]->next[level].store(new_node, std::memory_order_release);
+            }
+            for (uint8_t level = height; level < MAX_HEIGHT; level++)
+            {
+                prev[level]->span[level].store(prev[level]->span[level].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+
             size += key.size() + value.size();
-            map.insert(buffer_map::value_type(key, value));
+            count.store(sequence + 1, std::memory_order_release);
+            num_updates.store(update_count + 2, std::memory_order_release);
         }
 
-        void clear()
+        /**
+         * Get the total size of the keys and values in the buffer.
+         * Must only be called by the thread that adds to the buffer.
+         */
+        uint64_t get_size() const
         {
             ZoneBuffer;
 
-            map.clear();
-            size = 0;
+            return size;
         }
 
-        uint64_t get_size() const
+        /**
+         * Get the number of entries in the buffer.
+         * Entries are numbered in the order they were added, so this can be used as a limit to read the buffer as it is now.
+         */
+        uint64_t get_count() const
         {
             ZoneBuffer;
 
-            return size;
+            return count.load(std::memory_order_acquire);
         }
 
-        buffer_map::iterator begin()
+        /**
+         * Get the first value for the given key.
+         * Values for equal keys are kept in insertion order, so this is the value that was added first.
+         */
+        bool get(std::string_view key, std::string_view &value) const
         {
             ZoneBuffer;
 
-            return map.begin();
+            return get(key, value, get_count());
         }
 
-        buffer_map::iterator end()
+        /**
+         * Get the first value for the given key among the first limit entries that were added.
+         */
+        bool get(std::string_view key, std::string_view &value, uint64_t limit) const
         {
             ZoneBuffer;
 
-            return map.end();
+            BufferIterator it = seek_first(key, limit);
+            if (it.is_end() || it.get_key() != key)
+            {
+                return false;
+            }
+            value = it.get_value();
+            return true;
         }
 
-        uint64_t get_count() const
+        /**
+         * Get the key and value at the given index in sorted order.
+         */
+        bool at(uint64_t index, std::string_view &key, std::string_view &value) const
+        {
+            ZoneBuffer;
+
+            return at(index, key, value, get_count());
+        }
+
+        /**
+         * Get the key and value at the given index in sorted order among the first limit entries that were added.
+         */
+        bool at(uint64_t index, std::string_view &key, std::string_view &value, uint64_t limit) const
+        {
+            ZoneBuffer;
+
+            BufferIterator it = seek(index, limit);
+            if (it.is_end())
+            {
+                return false;
+            }
+            key = it.get_key();
+            value = it.get_value();
+            return true;
+        }
+
+        /**
+         * Return an iterator positioned at the first key-value pair.
+         */
+        BufferIterator begin() const
         {
             ZoneBuffer;
 
-            return map.size();
+            return begin(get_count());
+        }
+
+        /**
+         * Return an iterator positioned at the first key-value pair among the first limit entries that were added.
+         */
+        BufferIterator begin(uint64_t limit) const
+        {
+            ZoneBuffer;
+
+            return BufferIterator(head.next[0].load(std::memory_order_acquire), limit);
+        }
+
+        /**
+         * Return an iterator positioned at the first key-value pair with a key greater than or equal to the given key.
+         */
+        BufferIterator seek_first(std::string_view key) const
+        {
+            ZoneBuffer;
+
+            return seek_first(key, get_count());
+        }
+
+        /**
+         * Like seek_first(key), but only considering the first limit entries that were added.
+         */
+        BufferIterator seek_first(std::string_view key, uint64_t limit) const
+        {
+            ZoneBuffer;
+
+            const BufferNode *node = &head;
+            for (int level = MAX_HEIGHT - 1; level >= 0; level--)
+            {
+                BufferNode *next = node->next[level].load(std::memory_order_acquire);
+                while (next != nullptr && next->key.compare(key) < 0)
+                {
+                    node = next;
+                    next = node->next[level].load(std::memory_order_acquire);
+                }
+            }
+            return BufferIterator(node->next[0].load(std::memory_order_acquire), limit);
+        }
+
+        /**
+         * Return an iterator positioned at the given index.
+         * If the index is out of bounds, the iterator is positioned at the end.
+         */
+        BufferIterator seek(uint64_t index) const
+        {
+            ZoneBuffer;
+
+            return seek(index, get_count());
+        }
+
+        /**
+         * Like seek(index), but only considering the first limit entries that were added.
+         * If all entries in the buffer are visible, the entry is found through the spans of the skip list.
+         * Otherwise, as the spans also count the entries that were added later, the visible entries are counted one by one.
+         */
+        BufferIterator seek(uint64_t index, uint64_t limit) const
+        {
+            ZoneBuffer;
+
+            BufferNode *node;
+            if (try_find(index, limit, node))
+            {
+                return BufferIterator(node, limit);
+            }
+
+            BufferIterator it = begin(limit);
+            for (uint64_t i = 0; i < index && !it.is_end(); i++)
+            {
+                it.next();
+            }
+            return it;
         }
 
     private:
-        buffer_map map;
+        static constexpr uint8_t MAX_HEIGHT = 16;
+
+        std::mt19937 rng;
+        BufferNode head;
+        std::atomic<uint64_t> count{0};
+        // Odd while insert() is changing the links of the skip list
+        std::atomic<uint64_t> num_updates{0};
         uint64_t size = 0;
+
+        /**
+         * Find the node at the given index through the spans of the skip list, or nullptr if the index is out of bounds.
+         * Returns false if entries beyond the limit were added, or were being added while the spans were read.
+         */
+        bool try_find(uint64_t index, uint64_t limit, BufferNode *&result) const
+        {
+            uint64_t update_count = num_updates.load(std::memory_order_acquire);
+            if (update_count % 2 != 0 || count.load(std::memory_order_relaxed) != limit)
+            {
+                return false;
+            }
+
+            // Find the node before the index, at the position equal to the index with the head at 0
+            const BufferNode *node = &head;
+            uint64_t position = 0;
+            for (int level = MAX_HEIGHT - 1; level >= 0; level--)
+            {
+                BufferNode *next = node->next[level].load(std::memory_order_acquire);
+                uint64_t span = node->span[level].load(std::memory_order_relaxed);
+                while (next != nullptr && position + span <= index)
+                {
+                    position += span;
+                    node = next;
+                    next = node->next[level].load(std::memory_order_acquire);
+                    span = node->span[level].load(std::memory_order_relaxed);
+                }
+            }
+            result = node->next[0].load(std::memory_order_acquire);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return num_updates.load(std::memory_order_relaxed) == update_count;
+        }
+
+        uint8_t random_height()
+        {
+            uint8_t height = 1;
+            while (height < MAX_HEIGHT && (rng() & 3) == 0)
+            {
+                height++;
+            }
+            return height;
+        }
     };
 }
@@ -55,7 +55,7 @@ namespace ninedb::detail::level_manager
 
         void load_state()
         {
-            std::filesystem::path max_index_file_path;
+            std::vector<FileInfo> files;
             for (const auto &entry : std::filesystem::directory_iterator(path))
             {
                 if (!entry.is_regular_file())
@@ -63,20 +63,36 @@ namespace ninedb::detail::level_manager
                     continue;
                 }
 
-                std::string file_name = entry.path().filename().string();
-                uint64_t index, level;
-                parse_file_path(file_name, index, level);
+                // Temporary files of a merge that was split into key ranges, left behind if it was interrupted
+                if (entry.path().filename().string().find(".part") != std::string::npos)
+                {
+                    std::filesystem::remove(entry.path());
+                    continue;
+                }
 
-                if (index >= state.next_index)
+                FileInfo file;
+                file.path = entry.path();
+                parse_file_path(file.path.string(), file.index, file.level);
+                auto footer = pbt::Reader::read_footer_from_file(file.path);
+                file.global_start = footer.global_start;
+                file.global_end = footer.global_end;
+                files.push_back(file);
+            }
+            remove_obsolete_files(files);
+
+            std::filesystem::path max_index_file_path;
+            for (const auto &file : files)
+            {
+                if (file.index >= state.next_index)
                 {
-                    max_index_file_path = entry.path();
-                    state.next_index = index + 1;
+                    max_index_file_path = file.path;
+                    state.next_index = file.index + 1;
                 }
-                while (level >= state.levels.size())
+                while (file.level >= state.levels.size())
                 {
                     add_new_level();
                 }
-                state.levels[level].indices.push_back(index);
+                state.levels[file.level].indices.push_back(file.index);
             }
             if (state.levels.empty())
             {
@@ -104,6 +120,10 @@ namespace ninedb::detail::level_manager
             return files;
         }
 
+        /**
+         * Get the next cascaded merge operation, if any level is full.
+         * Files that are part of a merge operation in progress are not included.
+         */
         std::optional<MergeOperation> get_cascaded_merge_operation(bool reverse) const
         {
             if (!should_merge_level(0, false))
@@ -118,7 +138,10 @@ namespace ninedb::detail::level_manager
                 merge_operation.dst_level = level + 1;
                 for (uint64_t i = 0; i < state.levels[level].indices.size(); i++)
                 {
-                    merge_operation.src_levels_and_indices.push_back({level, state.levels[level].indices[i]});
+                    if (!is_merging(level, state.levels[level].indices[i]))
+                    {
+                        merge_operation.src_levels_and_indices.push_back({level, state.levels[level].indices[i]});
+                    }
                 }
                 level++;
             } while (should_merge_level(level, true));
@@ -185,6 +208,18 @@ namespace ninedb::detail::level_manager
             level = std::stoull(file_name.substr(21, 8));
         }
 
+        /**
+         * Mark the source files of a merge operation as being merged.
+         * They are excluded from new merge operations until the operation is applied.
+         */
+        void begin_merge_operation(const MergeOperation &merge_operation)
+        {
+            for (const auto &level_and_index : merge_operation.src_levels_and_indices)
+            {
+                state.merging.push_back(level_and_index);
+            }
+        }
+
         void apply_merge_operation(const MergeOperation &merge_operation)
         {
             while (merge_operation.dst_level >= state.levels.size())
@@ -199,8 +234,18 @@ namespace ninedb::detail::level_manager
                                 level_and_index.index),
                     state.levels[level_and_index.level].indices.end());
             }
-            state.levels[merge_operation.dst_level].indices.push_back(merge_operation.dst_index);
-            state.next_index = merge_operation.dst_index + 1;
+            for (const auto &level_and_index : merge_operation.src_levels_and_indices)
+            {
+                state.merging.erase(
+                    std::remove_if(state.merging.begin(),
+                                   state.merging.end(),
+                                   [&level_and_index](const LevelAndIndex &merging)
+                                   { return merging.level == level_and_index.level && merging.index == level_and_index.index; }),
+                    state.merging.end());
+            }
+            auto &dst_indices = state.levels[merge_operation.dst_level].indices;
+            dst_indices.insert(std::upper_bound(dst_indices.begin(), dst_indices.end(), merge_operation.dst_index), merge_operation.dst_index);
+            state.next_index = std::max(state.next_index, merge_operation.dst_index + 1);
         }
 
     private:
@@ -211,13 +256,92 @@ namespace ninedb::detail::level_manager
         LevelManager(const std::string &path, const Config &config, const State &state)
             : path(path), config(config), state(state) {}
 
+        struct FileInfo
+        {
+            std::filesystem::path path;
+            uint64_t index;
+            uint64_t level;
+            uint64_t global_start;
+            uint64_t global_end;
+        };
+
+        /**
+         * Remove the source files of merges that completed but whose sources were not yet removed.
+         * This happens when the db was closed abruptly while the sources were still being read.
+         * A file is obsolete if its range of the global index is covered by a file that was written after it.
+         */
+        static void remove_obsolete_files(std::vector<FileInfo> &files)
+        {
+            auto is_obsolete = [&files](const FileInfo &file)
+            {
+                for (const auto &other : files)
+                {
+                    bool covers = other.global_start <= file.global_start && file.global_end <= other.global_end;
+                    bool is_newer = std::make_pair(other.level, other.index) > std::make_pair(file.level, file.index);
+                    if (covers && is_newer)
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            };
+
+            std::vector<FileInfo> remaining;
+            for (const auto &file : files)
+            {
+                if (is_obsolete(file))
+                {
+                    std::filesystem::remove(file.path);
+                }
+                else
+                {
+                    remaining.push_back(file);
+                }
+            }
+            files = std::move(remaining);
+        }
+
+        bool is_merging(uint64_t level, uint64_t index) const
+        {
+            for (const auto &merging : state.merging)
+            {
+                if (merging.level == level && merging.index == index)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * Check if the files of a level that are not being merged should be merged.
+         * A level can only be merged if all those files are newer than any file being merged,
+         * so that the files of a merge operation always cover a contiguous range of entries.
+         */
         bool should_merge_level(uint64_t level, bool plus_one) const
         {
             if (level >= state.levels.size())
             {
                 return false;
             }
-            uint64_t count = state.levels[level].indices.size();
+            uint64_t max_merging_index = 0;
+            for (const auto &merging : state.merging)
+            {
+                max_merging_index = std::max(max_merging_index, merging.index + 1);
+            }
+            uint64_t count = 0;
+            for (uint64_t index : state.levels[level].indices)
+            {
+                if (is_merging(level, index))
+                {
+                    continue;
+                }
+                if (index < max_merging_index)
+                {
+                    return false;
+                }
+                count++;
+            }
             if (plus_one)
             {
                 count++;
@@ -34,5 +34,6 @@ namespace ninedb::detail::level_manager
         uint64_t next_index;
         uint64_t global_start;
         std::vector<LevelState> levels;
+        std::vector<LevelAndIndex> merging;
     };
 }
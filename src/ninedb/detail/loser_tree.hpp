@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace ninedb::detail
+{
+    /**
+     * Tournament tree selecting the source with the smallest key among multiple sorted sources.
+     * Each inner node holds the loser of the match between its subtrees, so replacing the key of the winner only replays the matches on its path to the root,
+     * which takes log(n) comparisons instead of comparing the keys of all sources.
+     * For equal keys, the source with the lowest index wins, so merging stays stable across sources.
+     * Sources that have ended lose against all others.
+     */
+    struct LoserTree
+    {
+        LoserTree() = default;
+
+        /**
+         * Create a tree over the given current keys of the sources, where ended sources are flagged in ended.
+         */
+        LoserTree(std::vector<std::string_view> keys, std::vector<bool> ended)
+            : keys(std::move(keys)), ended(std::move(ended))
+        {
+            uint64_t n = this->keys.size();
+            losers.resize(n);
+            if (n == 0)
+            {
+                return;
+            }
+
+            // The leaves are at positions n to 2n - 1, and the parent of position p is p / 2
+            std::vector<uint64_t> winners(2 * n);
+            for (uint64_t i = 0; i < n; i++)
+            {
+                winners[n + i] = i;
+            }
+            for (uint64_t p = n - 1; p >= 1; p--)
+            {
+                uint64_t left = winners[2 * p];
+                uint64_t right = winners[2 * p + 1];
+                if (is_less(right, left))
+                {
+                    winners[p] = right;
+                    losers[p] = left;
+                }
+                else
+                {
+                    winners[p] = left;
+                    losers[p] = right;
+                }
+            }
+            losers[0] = n == 1 ? 0 : winners[1];
+        }
+
+        /**
+         * Get the index of the source with the smallest key.
+         * If all sources have ended, this is an ended source.
+         * Must not be called on a tree without sources.
+         */
+        uint64_t top() const
+        {
+            return losers[0];
+        }
+
+        /**
+         * Get the current key of the given source.
+         */
+        std::string_view get_key(uint64_t i) const
+        {
+            return keys[i];
+        }
+
+        /**
+         * Check if all sources have ended.
+         */
+        bool is_empty() const
+        {
+            return losers.empty() || ended[losers[0]];
+        }
+
+        /**
+         * Check if the winning source would still win with the given key instead of its current one, without changing the tree.
+         * Only the sources that lost directly against the winner need to be compared, as the runner-up is one of them.
+         */
+        bool would_stay_top(std::string_view key) const
+        {
+            uint64_t n = keys.size();
+            uint64_t winner = losers[0];
+            for (uint64_t p = (n + winner) / 2; p >= 1; p /= 2)
+            {
+                if (is_less(losers[p], keys[losers[p]], winner, key))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * Set the key of the winning source after it moved to its next entry.
+         */
+        void replace_top(std::string_view key)
+        {
+            keys[losers[0]] = key;
+            replay();
+        }
+
+        /**
+         * Mark the winning source as ended.
+         */
+        void remove_top()
+        {
+            ended[losers[0]] = true;
+            replay();
+        }
+
+    private:
+        std::vector<std::string_view> keys;
+        std::vector<bool> ended;
+        // The loser of the match at each inner node, with the overall winner at position 0.
+        std::vector<uint64_t> losers;
+
+        bool is_less(uint64_t a, uint64_t b) const
+        {
+            return is_less(a, keys[a], b, keys[b]);
+        }
+
+        bool is_less(uint64_t a, std::string_view key_a, uint64_t b, std::string_view key_b) const
+        {
+            if (ended[a] || ended[b])
+            {
+                return !ended[a] || (ended[b] && a < b);
+            }
+            int comparison = key_a.compare(key_b);
+            return comparison < 0 || (comparison == 0 && a < b);
+        }
+
+        /**
+         * Replay the matches on the path from the winning source to the root.
+         */
+        void replay()
+        {
+            uint64_t n = keys.size();
+            uint64_t winner = losers[0];
+            for (uint64_t p = (n + winner) / 2; p >= 1; p /= 2)
+            {
+                if (is_less(losers[p], winner))
+                {
+                    std::swap(losers[p], winner);
+                }
+            }
+            losers[0] = winner;
+        }
+    };
+}
@@ -1,52 +1,60 @@
 #pragma once
 
-#include <array>
-#include <list>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
 #include <stdexcept>
+#include <tuple>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "./profiling.hpp"
 
 namespace ninedb::detail
 {
-    template <typename K, typename V>
+    /**
+     * Cache with approximated LRU eviction.
+     * Instead of keeping the items in access order, a few items are sampled on eviction and the least recently used one of those is evicted.
+     * The capacity is measured in units of the weigh function, which defaults to counting items.
+     * Pinned items are never evicted, so the cache can temporarily exceed its capacity while items are pinned.
+     */
+    template <typename K, typename V, typename Hash = std::hash<K>>
     class RLRUCache
     {
     public:
-        typedef typename std::tuple<K, V, uint64_t> array_item;
+        typedef typename std::tuple<K, V, uint64_t, uint64_t, uint64_t> array_item;
 
-        RLRUCache(uint64_t max_size)
-            : max_size(max_size)
+        RLRUCache(uint64_t max_size, const std::function<uint64_t(const V &value)> &weigh = nullptr)
+            : max_size(max_size), weigh(weigh)
         {
-            stride = std::max<uint64_t>(2ull, max_size / sample_size);
-            cache_items_array.resize(max_size);
         }
 
         void put(const K &key, const V &value)
         {
             ZoneLruCache;
 
+            uint64_t weight = get_weight(value);
+
             auto it = cache_items_map.find(key);
             if (it != cache_items_map.end())
             {
+                size -= std::get<3>(cache_items_array[it->second]);
+                size += weight;
                 std::get<1>(cache_items_array[it->second]) = value;
                 std::get<2>(cache_items_array[it->second]) = monotonic_time++;
-                return;
+                std::get<3>(cache_items_array[it->second]) = weight;
             }
-
-            if (cache_items_map.size() < max_size)
+            else
             {
-                uint64_t index = cache_items_map.size();
-                cache_items_array[index] = std::make_tuple(key, value, monotonic_time++);
-                cache_items_map[key] = index;
-                return;
+                cache_items_map[key] = cache_items_array.size();
+                cache_items_array.push_back(std::make_tuple(key, value, monotonic_time++, weight, 0));
+                size += weight;
             }
 
-            uint64_t evict_index = evict();
-            cache_items_map.erase(std::get<0>(cache_items_array[evict_index]));
-            cache_items_array[evict_index] = std::make_tuple(key, value, monotonic_time++);
-            cache_items_map[key] = evict_index;
+            // The item that was just added is never evicted, even if it exceeds the capacity on its own
+            shrink(cache_items_map[key]);
         }
 
         bool try_get(const K &key, V &value)
@@ -66,6 +74,45 @@ namespace ninedb::detail
             }
         }
 
+        /**
+         * Get the item with the given key and pin it, so it is not evicted until it is unpinned.
+         * An item can be pinned multiple times, and must be unpinned as many times.
+         */
+        bool try_get_and_pin(const K &key, V &value)
+        {
+            ZoneLruCache;
+
+            auto it = cache_items_map.find(key);
+            if (it == cache_items_map.end())
+            {
+                return false;
+            }
+            else
+            {
+                std::get<2>(cache_items_array[it->second]) = monotonic_time++;
+                std::get<4>(cache_items_array[it->second])++;
+                value = std::get<1>(cache_items_array[it->second]);
+                return true;
+            }
+        }
+
+        /**
+         * Release a pin on the item with the given key.
+         */
+        void unpin(const K &key)
+        {
+            ZoneLruCache;
+
+            auto it = cache_items_map.find(key);
+            if (it == cache_items_map.end() || std::get<4>(cache_items_array[it->second]) == 0)
+            {
+                throw std::runtime_error("Cannot unpin an item that is not pinned");
+            }
+            std::get<4>(cache_items_array[it->second])--;
+
+            shrink(std::numeric_limits<uint64_t>::max());
+        }
+
         bool exists(const K &key) const
         {
             ZoneLruCache;
@@ -73,31 +120,110 @@ namespace ninedb::detail
             return cache_items_map.find(key) != cache_items_map.end();
         }
 
+        /**
+         * Get the total weight of the items in the cache.
+         */
+        uint64_t get_size() const
+        {
+            ZoneLruCache;
+
+            return size;
+        }
+
+        uint64_t get_max_size() const
+        {
+            ZoneLruCache;
+
+            return max_size;
+        }
+
     private:
         static constexpr uint64_t sample_size = 8;
 
         uint64_t max_size;
-        uint64_t stride;
+        std::function<uint64_t(const V &value)> weigh;
+        uint64_t size = 0;
         uint64_t monotonic_time = 0;
         uint64_t evict_sample_offset = 0;
         std::vector<array_item> cache_items_array;
-        std::unordered_map<K, uint64_t> cache_items_map;
+        std::unordered_map<K, uint64_t, Hash> cache_items_map;
+
+        uint64_t get_weight(const V &value) const
+        {
+            return weigh != nullptr ? weigh(value) : 1;
+        }
+
+        bool is_evictable(uint64_t index, uint64_t keep_index) const
+        {
+            return index != keep_index && std::get<4>(cache_items_array[index]) == 0;
+        }
+
+        /**
+         * Evict items until the cache is within its capacity, never evicting the item at the given index.
+         */
+        void shrink(uint64_t keep_index)
+        {
+            uint64_t evict_index;
+            while (size > max_size && evict(keep_index, evict_index))
+            {
+                remove(evict_index);
+                if (keep_index == cache_items_array.size())
+                {
+                    // The kept item was moved into the place of the removed one
+                    keep_index = evict_index;
+                }
+            }
+        }
 
-        uint64_t evict()
+        /**
+         * Select an item to evict by sampling, never selecting the item at the given index or a pinned item.
+         * Returns false if there is no item that can be evicted.
+         */
+        bool evict(uint64_t keep_index, uint64_t &evict_index)
         {
-            uint64_t min_index = 0;
+            uint64_t count = cache_items_array.size();
+            uint64_t stride = std::max<uint64_t>(1, count / sample_size);
             uint64_t min_time = std::numeric_limits<uint64_t>::max();
             for (uint64_t i = 0; i < sample_size; i++)
             {
-                uint64_t index = (evict_sample_offset + i * stride) % max_size;
-                if (std::get<2>(cache_items_array[index]) < min_time)
+                uint64_t index = (evict_sample_offset + i * stride) % count;
+                if (is_evictable(index, keep_index) && std::get<2>(cache_items_array[index]) < min_time)
                 {
-                    min_index = index;
+                    evict_index = index;
                     min_time = std::get<2>(cache_items_array[index]);
                 }
             }
             evict_sample_offset++;
-            return min_index;
+            if (min_time != std::numeric_limits<uint64_t>::max())
+            {
+                return true;
+            }
+
+            // All sampled items are pinned, so fall back to looking at every item
+            for (uint64_t index = 0; index < count; index++)
+            {
+                if (is_evictable(index, keep_index))
+                {
+                    evict_index = index;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * Remove the item at the given index by moving the last item into its place.
+         */
+        void remove(uint64_t index)
+        {
+            size -= std::get<3>(cache_items_array[index]);
+            cache_items_map.erase(std::get<0>(cache_items_array[index]));
+            if (index != cache_items_array.size() - 1)
+            {
+                cache_items_array[index] = std::move(cache_items_array.back());
+                cache_items_map[std::get<0>(cache_items_array[index])] = index;
+            }
+            cache_items_array.pop_back();
         }
     };
 }
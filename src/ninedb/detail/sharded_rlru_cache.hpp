@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "./profiling.hpp"
+#include "./rlru_cache.hpp"
+
+namespace ninedb::detail
+{
+    /**
+     * Cache with approximated LRU eviction that is safe to use from multiple threads.
+     * Keys are partitioned by hash over a number of shards, each an RLRUCache with its own lock,
+     * so threads accessing different shards do not contend.
+     * The capacity is divided evenly over the shards.
+     */
+    template <typename K, typename V, typename Hash = std::hash<K>>
+    class ShardedRLRUCache
+    {
+    public:
+        static constexpr uint64_t DEFAULT_NUM_SHARDS = 16;
+
+        ShardedRLRUCache(uint64_t max_size, const std::function<uint64_t(const V &value)> &weigh = nullptr, uint64_t num_shards = DEFAULT_NUM_SHARDS)
+            : max_size(max_size)
+        {
+            num_shards = std::max<uint64_t>(1, num_shards);
+            uint64_t shard_max_size = (max_size + num_shards - 1) / num_shards;
+            for (uint64_t i = 0; i < num_shards; i++)
+            {
+                shards.push_back(std::make_unique<Shard>(shard_max_size, weigh));
+            }
+        }
+
+        ShardedRLRUCache(const ShardedRLRUCache &) = delete;
+        ShardedRLRUCache &operator=(const ShardedRLRUCache &) = delete;
+
+        void put(const K &key, const V &value)
+        {
+            ZoneLruCache;
+
+            Shard &shard = get_shard(key);
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            shard.cache.put(key, value);
+        }
+
+        bool try_get(const K &key, V &value)
+        {
+            ZoneLruCache;
+
+            Shard &shard = get_shard(key);
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            return shard.cache.try_get(key, value);
+        }
+
+        /**
+         * Get the item with the given key and pin it, so it is not evicted until it is unpinned.
+         */
+        bool try_get_and_pin(const K &key, V &value)
+        {
+            ZoneLruCache;
+
+            Shard &shard = get_shard(key);
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            return shard.cache.try_get_and_pin(key, value);
+        }
+
+        /**
+         * Release a pin on the item with the given key.
+         */
+        void unpin(const K &key)
+        {
+            ZoneLruCache;
+
+            Shard &shard = get_shard(key);
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            shard.cache.unpin(key);
+        }
+
+        bool exists(const K &key) const
+        {
+            ZoneLruCache;
+
+            Shard &shard = get_shard(key);
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            return shard.cache.exists(key);
+        }
+
+        /**
+         * Get the total weight of the items in the cache.
+         */
+        uint64_t get_size() const
+        {
+            ZoneLruCache;
+
+            uint64_t size = 0;
+            for (const auto &shard : shards)
+            {
+                std::unique_lock<std::mutex> lock(shard->mutex);
+                size += shard->cache.get_size();
+            }
+            return size;
+        }
+
+        uint64_t get_max_size() const
+        {
+            ZoneLruCache;
+
+            return max_size;
+        }
+
+        uint64_t get_num_shards() const
+        {
+            ZoneLruCache;
+
+            return shards.size();
+        }
+
+    private:
+        struct Shard
+        {
+            Shard(uint64_t max_size, const std::function<uint64_t(const V &value)> &weigh)
+                : cache(max_size, weigh) {}
+
+            std::mutex mutex;
+            RLRUCache<K, V, Hash> cache;
+        };
+
+        uint64_t max_size;
+        std::vector<std::unique_ptr<Shard>> shards;
+
+        Shard &get_shard(const K &key) const
+        {
+            // Mix the hash, so the shard does not correlate with the bucket of the key within the shard
+            uint64_t hash = static_cast<uint64_t>(Hash()(key)) * 0x9e3779b97f4a7c15ULL;
+            return *shards[(hash >> 32) % shards.size()];
+        }
+    };
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./buffer.hpp"
+#include "../pbt/reader.hpp"
+
+namespace ninedb::detail
+{
+    /**
+     * An immutable view of the data sources of a db.
+     * A new version is published whenever a buffer is handed off, a PBT is written or a merge completes.
+     * Readers hold on to a version for the duration of a read, so sources it references stay alive.
+     */
+    struct Version
+    {
+        /**
+         * The readers of the PBT files, by file name.
+         * File names sort in the order of the global index.
+         */
+        std::map<std::string, std::shared_ptr<pbt::Reader>> readers;
+
+        /**
+         * The readers in the order of the global index, for positional access.
+         */
+        std::vector<std::shared_ptr<pbt::Reader>> ordered_readers;
+
+        /**
+         * For each reader in ordered_readers, the number of entries in it and the readers before it.
+         * Sorted, so the reader holding an index can be binary searched.
+         */
+        std::vector<uint64_t> reader_ends;
+
+        /**
+         * The in-memory buffers, oldest first.
+         * The last buffer receives new writes, the others are full and waiting to be written to disk.
+         */
+        std::vector<std::shared_ptr<Buffer>> buffers;
+
+        /**
+         * Rebuild ordered_readers and reader_ends from readers.
+         * Must be called after changing the readers.
+         */
+        void update_reader_ends()
+        {
+            ordered_readers.clear();
+            reader_ends.clear();
+            uint64_t num_entries = 0;
+            for (const auto &[file_name, reader] : readers)
+            {
+                num_entries += reader->count();
+                ordered_readers.push_back(reader);
+                reader_ends.push_back(num_entries);
+            }
+        }
+    };
+}
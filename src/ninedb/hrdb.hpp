@@ -30,7 +30,7 @@ namespace ninedb
 
             Config new_config = config;
             new_config.writer.reduce = HrDb::reduce;
-            return HrDb(KvDb::open(path, new_config));
+            return HrDb(path, new_config);
         }
 
         /**
@@ -114,8 +114,8 @@ namespace ninedb
     private:
         KvDb kvdb;
 
-        HrDb(KvDb &&kvdb)
-            : kvdb(std::move(kvdb)) {}
+        HrDb(const std::string &path, const Config &config)
+            : kvdb(KvDb::open(path, config)) {}
 
         static std::string pad_value_with_bbox(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, std::string_view value)
         {
@@ -3,82 +3,132 @@
 #include <memory>
 #include <vector>
 
+#include "./detail/buffer.hpp"
+#include "./detail/loser_tree.hpp"
+#include "./detail/version.hpp"
 #include "./pbt/iterator.hpp"
 #include "./pbt/reader.hpp"
 
 namespace ninedb
 {
+    /**
+     * Iterator merging the key-value pairs of multiple PBTs and in-memory buffers in key order.
+     * For equal keys, the entries of PBTs come before those of buffers, and earlier sources come before later ones.
+     * The next source is selected with a loser tree, so each step takes log(n) key comparisons for n sources.
+     * The iterator may hold on to the version it was created from, so its sources stay valid while it is in use.
+     */
     struct Iterator
     {
         bool is_end() const
         {
-            return itrs[current].is_end();
+            return tree.is_empty();
         }
 
         std::string_view get_key() const
         {
-            return keys[current];
+            return tree.get_key(current);
         }
 
         void get_key(std::string_view &key) const
         {
-            key = keys[current];
+            key = tree.get_key(current);
         }
 
         std::string_view get_value() const
         {
-            return itrs[current].get_value();
+            return source_get_value(current);
         }
 
         void get_value(std::string_view &value) const
         {
-            value = itrs[current].get_value();
+            value = source_get_value(current);
         }
 
         void next()
         {
-            itrs[current].next();
-            if (!itrs[current].is_end())
+            source_next(current);
+            if (source_is_end(current))
             {
-                keys[current] = itrs[current].get_key();
+                tree.remove_top();
             }
-            current = get_min_index();
+            else
+            {
+                tree.replace_top(source_get_key(current));
+            }
+            current = tree.top();
         }
 
         Iterator(std::vector<pbt::Iterator> &&itrs)
-            : itrs(std::move(itrs))
+            : Iterator(std::move(itrs), {}) {}
+
+        Iterator(std::vector<pbt::Iterator> &&itrs, std::vector<detail::BufferIterator> &&buffer_itrs)
+            : Iterator(std::move(itrs), std::move(buffer_itrs), nullptr) {}
+
+        Iterator(std::vector<pbt::Iterator> &&itrs, std::vector<detail::BufferIterator> &&buffer_itrs, std::shared_ptr<const detail::Version> version)
+            : itrs(std::move(itrs)), buffer_itrs(std::move(buffer_itrs)), version(std::move(version))
         {
-            keys.resize(this->itrs.size());
-            for (uint64_t i = 0; i < this->itrs.size(); i++)
+            uint64_t num_sources = this->itrs.size() + this->buffer_itrs.size();
+            std::vector<std::string_view> keys(num_sources);
+            std::vector<bool> ended(num_sources);
+            for (uint64_t i = 0; i < num_sources; i++)
             {
-                if (!this->itrs[i].is_end())
+                ended[i] = source_is_end(i);
+                if (!ended[i])
                 {
-                    keys[i] = this->itrs[i].get_key();
+                    keys[i] = source_get_key(i);
                 }
             }
-            current = get_min_index();
+            tree = detail::LoserTree(std::move(keys), std::move(ended));
+            if (!tree.is_empty())
+            {
+                current = tree.top();
+            }
         }
 
     private:
         std::vector<pbt::Iterator> itrs;
-        std::vector<std::string_view> keys;
-        uint64_t current;
+        std::vector<detail::BufferIterator> buffer_itrs;
+        detail::LoserTree tree;
+        uint64_t current = 0;
+        std::shared_ptr<const detail::Version> version;
 
-        uint64_t get_min_index() const
+        bool source_is_end(uint64_t i) const
         {
-            uint64_t next = 0;
-            for (uint64_t i = 1; i < itrs.size(); i++)
+            if (i < itrs.size())
             {
-                if (itrs[i].is_end())
-                {
-                    continue;
-                }
-                if (itrs[next].is_end() || keys[i].compare(keys[next]) < 0)
-                {
-                    next = i;
-                }
+                return itrs[i].is_end();
+            }
+            return buffer_itrs[i - itrs.size()].is_end();
+        }
+
+        std::string_view source_get_key(uint64_t i) const
+        {
+            if (i < itrs.size())
+            {
+                return itrs[i].get_key();
+            }
+            return buffer_itrs[i - itrs.size()].get_key();
+        }
+
+        std::string_view source_get_value(uint64_t i) const
+        {
+            if (i < itrs.size())
+            {
+                return itrs[i].get_value();
+            }
+            return buffer_itrs[i - itrs.size()].get_value();
+        }
+
+        void source_next(uint64_t i)
+        {
+            if (i < itrs.size())
+            {
+                itrs[i].next();
+            }
+            else
+            {
+                buffer_itrs[i - itrs.size()].next();
             }
-            return next;
         }
     };
 }
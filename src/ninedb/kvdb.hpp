@@ -1,24 +1,39 @@
 #pragma once
 
+#include <algorithm>
+#include <condition_variable>
 #include <cstdint>
+#include <exception>
 #include <filesystem>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #include "./detail/profiling.hpp"
 #include "./detail/buffer.hpp"
 #include "./detail/level_manager/level_manager.hpp"
+#include "./detail/version.hpp"
 
 #include "./config.hpp"
 #include "./iterator.hpp"
+#include "./snapshot.hpp"
 #include "./pbt/pbt.hpp"
 
 namespace ninedb
 {
+    /**
+     * A key-value db made of in-memory buffers and PBT files on disk.
+     * One thread may call add(), flush() and compact() while any number of threads read concurrently.
+     * Keys and values returned by get() and at() keep the buffer or node they point into in memory,
+     * so they stay valid for as long as they exist, across flushes, merges and further reads.
+     */
     struct KvDb
     {
         /**
@@ -57,20 +72,42 @@ namespace ninedb
             return KvDb(config, level_manager);
         }
 
+        KvDb(const KvDb &) = delete;
+        KvDb &operator=(const KvDb &) = delete;
+
+        ~KvDb()
+        {
+            ZoneDb;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            flush_condition.notify_all();
+            if (flush_thread.joinable())
+            {
+                flush_thread.join();
+            }
+            compaction_condition.notify_all();
+            for (auto &compaction_thread : compaction_threads)
+            {
+                compaction_thread.join();
+            }
+        }
+
         /**
          * Add a key-value pair to the db.
          * If the key already exists, the value will be added after the existing values.
+         * When the buffer is full, it is handed off to be written to disk and a new buffer is started.
          */
         void add(std::string_view key, std::string_view value)
         {
             ZoneDb;
 
-            // TODO: run flush/merge in a separate thread pool.
-
-            buffer.insert(key, value);
-            if (buffer.get_size() > config.max_buffer_size)
+            buffer->insert(key, value);
+            if (buffer->get_size() > config.max_buffer_size)
             {
-                flush();
+                rotate_buffer();
             }
         }
 
@@ -78,17 +115,27 @@ namespace ninedb
          * Get the first value for the given key.
          * If the key does not exist, false will be returned.
          * Otherwise, true will be returned and the value will be set.
+         * Entries that are still in the write buffer are included.
          */
-        bool get(std::string_view key, std::string_view &value) const
+        bool get(std::string_view key, pbt::PinnedView &value) const
         {
             ZoneDb;
 
-            for (const auto &[file_name, reader] : readers)
+            return snapshot().get(key, value);
+        }
+
+        /**
+         * Get a copy of the first value for the given key.
+         */
+        bool get(std::string_view key, std::string &value) const
+        {
+            ZoneDb;
+
+            pbt::PinnedView value_view;
+            if (get(key, value_view))
             {
-                if (reader->get(key, value))
-                {
-                    return true;
-                }
+                value.assign(value_view.get());
+                return true;
             }
             return false;
         }
@@ -96,11 +143,11 @@ namespace ninedb
         /**
          * Get the first value for the given key.
          */
-        std::optional<std::string_view> get(std::string_view key) const
+        std::optional<pbt::PinnedView> get(std::string_view key) const
         {
             ZoneDb;
 
-            std::string_view value;
+            pbt::PinnedView value;
             if (get(key, value))
             {
                 return value;
@@ -112,20 +159,29 @@ namespace ninedb
          * Get the key and value at the given index.
          * If the index is out of range, false will be returned.
          * Otherwise, true will be returned and the key and value will be set.
+         * Entries that are still in the write buffer are indexed after all entries on disk.
          */
-        bool at(uint64_t index, std::string_view &key, std::string_view &value) const
+        bool at(uint64_t index, pbt::PinnedView &key, pbt::PinnedView &value) const
         {
             ZoneDb;
 
-            for (const auto &[file_name, reader] : readers)
+            return snapshot().at(index, key, value);
+        }
+
+        /**
+         * Get a copy of the key and value at the given index.
+         */
+        bool at(uint64_t index, std::string &key, std::string &value) const
+        {
+            ZoneDb;
+
+            pbt::PinnedView key_view;
+            pbt::PinnedView value_view;
+            if (at(index, key_view, value_view))
             {
-                uint64_t num_entries = reader->count();
-                if (index < num_entries)
-                {
-                    reader->at(index, key, value);
-                    return true;
-                }
-                index -= num_entries;
+                key.assign(key_view.get());
+                value.assign(value_view.get());
+                return true;
             }
             return false;
         }
@@ -134,11 +190,11 @@ namespace ninedb
          * Get the key-value pair at the given index.
          * If the index is out of range, std::nullopt will be returned.
          */
-        std::optional<std::pair<std::string_view, std::string_view>> at(uint64_t index) const
+        std::optional<std::pair<pbt::PinnedView, pbt::PinnedView>> at(uint64_t index) const
         {
             ZoneDb;
 
-            std::pair<std::string_view, std::string_view> result;
+            std::pair<pbt::PinnedView, pbt::PinnedView> result;
             if (at(index, result.first, result.second))
             {
                 return result;
@@ -146,19 +202,27 @@ namespace ninedb
             return std::nullopt;
         }
 
+        /**
+         * Take a point-in-time snapshot of the db.
+         * The snapshot sees all entries added so far, including those still in the write buffer,
+         * and keeps the files and buffers it reads from alive while merges and flushes continue.
+         */
+        Snapshot snapshot() const
+        {
+            ZoneDb;
+
+            return Snapshot(get_version());
+        }
+
         /**
          * Return an iterator to the first key-value pair in the db.
+         * The iterator reads from a snapshot of the db taken when it was created.
          */
         Iterator begin() const
         {
             ZoneDb;
 
-            std::vector<pbt::Iterator> itrs;
-            for (const auto &[file_name, reader] : readers)
-            {
-                itrs.push_back(reader->begin());
-            }
-            return Iterator(std::move(itrs));
+            return snapshot().begin();
         }
 
         /**
@@ -170,12 +234,7 @@ namespace ninedb
         {
             ZoneDb;
 
-            std::vector<pbt::Iterator> itrs;
-            for (const auto &[file_name, reader] : readers)
-            {
-                itrs.push_back(reader->seek_first(key));
-            }
-            return Iterator(std::move(itrs));
+            return snapshot().seek(key);
         }
 
         /**
@@ -186,13 +245,7 @@ namespace ninedb
         {
             ZoneDb;
 
-            std::vector<pbt::Iterator> itrs;
-            for (const auto &[file_name, reader] : readers)
-            {
-                itrs.push_back(reader->seek(index));
-                index -= std::min(index, reader->count());
-            }
-            return Iterator(std::move(itrs));
+            return snapshot().seek(index);
         }
 
         /**
@@ -204,10 +257,7 @@ namespace ninedb
         {
             ZoneDb;
 
-            for (const auto &[file_name, reader] : readers)
-            {
-                reader->traverse(predicate, accumulator);
-            }
+            snapshot().traverse(predicate, accumulator);
         }
 
         /**
@@ -218,44 +268,175 @@ namespace ninedb
         {
             ZoneDb;
 
-            flush_buffer();
-            auto merge_operation = level_manager.get_full_merge(false);
+            flush();
+
+            std::optional<detail::level_manager::MergeOperation> merge_operation;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                merge_operation = level_manager.get_full_merge(false);
+                if (merge_operation.has_value())
+                {
+                    level_manager.begin_merge_operation(merge_operation.value());
+                    num_running_compactions++;
+                }
+            }
             if (merge_operation.has_value())
             {
-                perform_merge_operation(merge_operation.value());
+                run_merge_operation(merge_operation.value());
             }
         }
 
         /**
          * Flush the buffer to disk and perform any necessary merges.
+         * Blocks until all buffers handed off so far have been written and the resulting merges have finished.
          */
         void flush()
         {
             ZoneDb;
 
-            flush_buffer();
-            auto merge_operation = level_manager.get_cascaded_merge_operation(false);
-            if (merge_operation.has_value())
+            if (buffer->get_size() > 0)
             {
-                perform_merge_operation(merge_operation.value());
+                rotate_buffer();
             }
+
+            if (config.enable_background_flush)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                flushed_condition.wait(lock, [this]
+                                       { return (version->buffers.size() <= 1 && !flushing) || background_error != nullptr; });
+            }
+            rethrow_background_error();
+            wait_for_compactions();
+            release_retired();
+        }
+
+        /**
+         * Get the cache for internal nodes shared by all files of the db, or nullptr if it is disabled.
+         * The cache counts its hits and misses.
+         */
+        std::shared_ptr<const pbt::NodeCache> get_internal_node_cache() const
+        {
+            ZoneDb;
+
+            return reader_config.internal_node_cache;
+        }
+
+        /**
+         * Get the cache for leaf nodes shared by all files of the db, or nullptr if it is disabled.
+         * The cache counts its hits and misses.
+         */
+        std::shared_ptr<const pbt::NodeCache> get_leaf_node_cache() const
+        {
+            ZoneDb;
+
+            return reader_config.leaf_node_cache;
+        }
+
+        /**
+         * Get the number of bytes of internal nodes that are pinned in memory for the current files of the db.
+         */
+        uint64_t get_pinned_size() const
+        {
+            ZoneDb;
+
+            std::shared_ptr<const detail::Version> current = get_version();
+            uint64_t pinned_size = 0;
+            for (const auto &[file, reader] : current->readers)
+            {
+                pinned_size += reader->get_pinned_size();
+            }
+            return pinned_size;
+        }
+
+        /**
+         * Get the statistics of the explicit reads from the files of the db, or nullptr if the files are mapped into memory.
+         */
+        std::shared_ptr<const pbt::IoStats> get_io_stats() const
+        {
+            ZoneDb;
+
+            return reader_config.io_stats;
+        }
+
+        /**
+         * Block until no merge operations are running or waiting to run on the compaction threads.
+         */
+        void wait_for_compactions()
+        {
+            ZoneDb;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                compacted_condition.wait(lock, [this]
+                                         { return (num_running_compactions == 0 && !level_manager.get_cascaded_merge_operation(false).has_value()) || background_error != nullptr; });
+            }
+            rethrow_background_error();
         }
 
     private:
         Config config;
-        detail::Buffer buffer;
         detail::level_manager::LevelManager level_manager;
-        std::map<std::string, std::shared_ptr<pbt::Reader>> readers;
+
+        /**
+         * The config for readers of the db, holding the node caches and I/O statistics they share.
+         */
+        pbt::ReaderConfig reader_config;
+
+        /**
+         * The current version of the data sources.
+         * Readers load it with std::atomic_load and never take the mutex.
+         * It is replaced with std::atomic_store while holding the mutex.
+         */
+        std::shared_ptr<const detail::Version> version;
+
+        /**
+         * The buffer receiving new writes, same as the last buffer of the current version.
+         * Only accessed by the thread calling add().
+         */
+        std::shared_ptr<detail::Buffer> buffer;
+
+        /**
+         * Buffers and readers that have been replaced but may still be referenced by values returned from reads.
+         * Released when the next buffer is handed off or on flush().
+         * The files of retired readers are removed once no snapshot or iterator references them anymore.
+         */
+        std::vector<std::shared_ptr<detail::Buffer>> retired_buffers;
+        std::vector<std::shared_ptr<pbt::Reader>> retired_readers;
+
+        mutable std::mutex mutex;
+        std::condition_variable flush_condition;
+        std::condition_variable flushed_condition;
+        std::condition_variable compaction_condition;
+        std::condition_variable compacted_condition;
+        std::thread flush_thread;
+        std::vector<std::thread> compaction_threads;
+        uint64_t num_running_compactions = 0;
+        bool flushing = false;
+        bool stopping = false;
+        std::exception_ptr background_error;
 
         KvDb(const Config &config, const detail::level_manager::LevelManager &level_manager)
-            : config(config), level_manager(level_manager)
+            : config(config), level_manager(level_manager), reader_config(get_reader_config(config)), buffer(std::make_shared<detail::Buffer>())
         {
             ZoneDb;
 
+            std::shared_ptr<detail::Version> initial_version = std::make_shared<detail::Version>();
             std::vector<std::string> unmerged_files = level_manager.get_unmerged_files();
             for (const auto &file : unmerged_files)
             {
-                readers[file] = std::make_shared<pbt::Reader>(file);
+                initial_version->readers[file] = std::make_shared<pbt::Reader>(file, reader_config);
+            }
+            initial_version->update_reader_ends();
+            initial_version->buffers.push_back(buffer);
+            version = initial_version;
+
+            if (config.enable_background_flush)
+            {
+                flush_thread = std::thread(&KvDb::run_flush_thread, this);
+            }
+            for (uint64_t i = 0; i < config.num_compaction_threads; i++)
+            {
+                compaction_threads.emplace_back(&KvDb::run_compaction_thread, this);
             }
         }
 
@@ -267,10 +448,39 @@ namespace ninedb
             writer_config.max_node_children = config.writer.max_node_children;
             writer_config.initial_pbt_size = config.writer.initial_pbt_size;
             writer_config.reduce = config.writer.reduce;
+            writer_config.bloom_filter_bits_per_key = config.writer.bloom_filter_bits_per_key;
+            writer_config.enable_compact_nodes = config.writer.enable_compact_nodes;
+            writer_config.enable_prefix_compression = config.writer.enable_prefix_compression;
+            writer_config.prefix_restart_interval = config.writer.prefix_restart_interval;
+            writer_config.enable_lz4_compression = config.writer.enable_lz4_compression;
+            writer_config.enable_streaming_writes = config.writer.enable_streaming_writes;
+            writer_config.write_buffer_size = config.writer.write_buffer_size;
             writer_config.error_if_exists = false;
             return writer_config;
         }
 
+        static pbt::ReaderConfig get_reader_config(const Config &config)
+        {
+            ZoneDb;
+
+            pbt::ReaderConfig reader_config;
+            if (config.internal_node_cache_size > 0)
+            {
+                reader_config.internal_node_cache = std::make_shared<pbt::NodeCache>(config.internal_node_cache_size, config.node_cache_num_shards);
+            }
+            if (config.leaf_node_cache_size > 0)
+            {
+                reader_config.leaf_node_cache = std::make_shared<pbt::NodeCache>(config.leaf_node_cache_size, config.node_cache_num_shards);
+            }
+            reader_config.enable_mmap = config.enable_mmap_reads;
+            reader_config.pin_internal_nodes = config.pin_internal_nodes;
+            if (!config.enable_mmap_reads)
+            {
+                reader_config.io_stats = std::make_shared<pbt::IoStats>();
+            }
+            return reader_config;
+        }
+
         static detail::level_manager::Config get_level_manager_config(const Config &config)
         {
             ZoneDb;
@@ -280,29 +490,278 @@ namespace ninedb
             return level_manager_config;
         }
 
-        void flush_buffer()
+        std::shared_ptr<const detail::Version> get_version() const
         {
             ZoneDb;
 
-            if (buffer.get_size() <= 0)
+            return std::atomic_load(&version);
+        }
+
+        /**
+         * Publish a copy of the current version with the given changes applied.
+         * Must be called with the mutex held.
+         */
+        void publish_version(const std::function<void(detail::Version &version)> &apply)
+        {
+            ZoneDb;
+
+            std::shared_ptr<detail::Version> next_version = std::make_shared<detail::Version>(*version);
+            apply(*next_version);
+            next_version->update_reader_ends();
+            std::atomic_store(&version, std::shared_ptr<const detail::Version>(std::move(next_version)));
+        }
+
+        /**
+         * Hand off the current buffer to be written to disk and start a new one.
+         * Blocks while the maximum number of immutable buffers are waiting to be written.
+         */
+        void rotate_buffer()
+        {
+            ZoneDb;
+
+            if (!config.enable_background_flush)
             {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    buffer = std::make_shared<detail::Buffer>();
+                    publish_version([this](detail::Version &version)
+                                    { version.buffers.push_back(buffer); });
+                }
+                while (flush_immutable_buffer())
+                {
+                }
+                release_retired();
                 return;
             }
 
-            uint64_t num_entries = buffer.get_count();
-            std::string file_name = level_manager.get_next_level_0_file_path();
-            pbt::Writer writer(level_manager.get_global_start(), file_name, get_writer_config(config));
-            for (const auto &[key, value] : buffer)
             {
-                writer.add(key, value);
+                std::unique_lock<std::mutex> lock(mutex);
+                flushed_condition.wait(lock, [this]
+                                       { return version->buffers.size() <= config.max_immutable_buffer_count || background_error != nullptr; });
+                if (background_error == nullptr)
+                {
+                    buffer = std::make_shared<detail::Buffer>();
+                    publish_version([this](detail::Version &version)
+                                    { version.buffers.push_back(buffer); });
+                    retired_buffers.clear();
+                    retired_readers.clear();
+                }
+            }
+            rethrow_background_error();
+            flush_condition.notify_one();
+        }
+
+        void release_retired()
+        {
+            ZoneDb;
+
+            std::unique_lock<std::mutex> lock(mutex);
+            retired_buffers.clear();
+            retired_readers.clear();
+        }
+
+        void set_background_error(std::exception_ptr error)
+        {
+            ZoneDb;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (background_error == nullptr)
+                {
+                    background_error = error;
+                }
+                flushing = false;
+            }
+            flushed_condition.notify_all();
+            compaction_condition.notify_all();
+            compacted_condition.notify_all();
+        }
+
+        void rethrow_background_error() const
+        {
+            ZoneDb;
+
+            std::unique_lock<std::mutex> lock(mutex);
+            if (background_error != nullptr)
+            {
+                std::rethrow_exception(background_error);
+            }
+        }
+
+        void run_flush_thread()
+        {
+            ZoneDb;
+
+            while (true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    flush_condition.wait(lock, [this]
+                                         { return version->buffers.size() > 1 || stopping; });
+                    if (version->buffers.size() <= 1)
+                    {
+                        return;
+                    }
+                    flushing = true;
+                }
+
+                try
+                {
+                    flush_immutable_buffer();
+                }
+                catch (...)
+                {
+                    set_background_error(std::current_exception());
+                    return;
+                }
+
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    flushing = false;
+                }
+                flushed_condition.notify_all();
+            }
+        }
+
+        void run_compaction_thread()
+        {
+            ZoneDb;
+
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!stopping && background_error == nullptr)
+            {
+                auto merge_operation = begin_merge_operation();
+                if (!merge_operation.has_value())
+                {
+                    compaction_condition.wait(lock);
+                    continue;
+                }
+                lock.unlock();
+
+                try
+                {
+                    perform_merge_operation(merge_operation.value());
+                }
+                catch (...)
+                {
+                    set_background_error(std::current_exception());
+                }
+
+                lock.lock();
+                num_running_compactions--;
+                compacted_condition.notify_all();
+            }
+        }
+
+        /**
+         * Take the next cascaded merge operation and mark it as running.
+         * Must be called with the mutex held.
+         */
+        std::optional<detail::level_manager::MergeOperation> begin_merge_operation()
+        {
+            ZoneDb;
+
+            auto merge_operation = level_manager.get_cascaded_merge_operation(false);
+            if (merge_operation.has_value())
+            {
+                level_manager.begin_merge_operation(merge_operation.value());
+                num_running_compactions++;
+            }
+            return merge_operation;
+        }
+
+        /**
+         * Perform a merge operation taken with begin_merge_operation() on the calling thread.
+         */
+        void run_merge_operation(const detail::level_manager::MergeOperation &merge_operation)
+        {
+            ZoneDb;
+
+            try
+            {
+                perform_merge_operation(merge_operation);
+            }
+            catch (...)
+            {
+                end_merge_operation();
+                throw;
+            }
+            end_merge_operation();
+        }
+
+        void end_merge_operation()
+        {
+            ZoneDb;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                num_running_compactions--;
+            }
+            compacted_condition.notify_all();
+        }
+
+        /**
+         * Write the oldest immutable buffer to disk.
+         * Merges that become necessary are handed to the compaction threads, or performed directly if there are none.
+         * Returns false if there was no buffer to write.
+         */
+        bool flush_immutable_buffer()
+        {
+            ZoneDb;
+
+            std::shared_ptr<detail::Buffer> immutable_buffer;
+            std::string file_name;
+            uint64_t global_start;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (version->buffers.size() <= 1)
+                {
+                    return false;
+                }
+                immutable_buffer = version->buffers.front();
+                file_name = level_manager.get_next_level_0_file_path();
+                global_start = level_manager.get_global_start();
+            }
+
+            pbt::Writer writer(global_start, file_name, get_writer_config(config));
+            for (auto it = immutable_buffer->begin(); !it.is_end(); it.next())
+            {
+                writer.add(it.get_key(), it.get_value());
             }
             writer.finish();
-            buffer.clear();
+            std::shared_ptr<pbt::Reader> reader = std::make_shared<pbt::Reader>(writer.to_reader(reader_config));
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                level_manager.advance_level_0();
+                level_manager.set_global_start(global_start + immutable_buffer->get_count());
+                publish_version([&file_name, &reader](detail::Version &version)
+                                {
+                                    version.readers[file_name] = reader;
+                                    version.buffers.erase(version.buffers.begin()); });
+                retired_buffers.push_back(immutable_buffer);
+            }
 
-            level_manager.advance_level_0();
-            level_manager.set_global_start(level_manager.get_global_start() + num_entries);
+            if (!compaction_threads.empty())
+            {
+                compaction_condition.notify_one();
+                return true;
+            }
 
-            readers[file_name] = std::make_shared<pbt::Reader>(writer.to_reader());
+            while (true)
+            {
+                std::optional<detail::level_manager::MergeOperation> merge_operation;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    merge_operation = begin_merge_operation();
+                }
+                if (!merge_operation.has_value())
+                {
+                    break;
+                }
+                run_merge_operation(merge_operation.value());
+            }
+            return true;
         }
 
         void perform_merge_operation(const detail::level_manager::MergeOperation &merge_operation)
@@ -311,27 +770,85 @@ namespace ninedb
 
             std::vector<std::shared_ptr<pbt::Reader>> src_readers;
             uint64_t global_start = std::numeric_limits<uint64_t>::max();
-            for (const auto &[level, index] : merge_operation.src_levels_and_indices)
+            std::string target_file_name;
             {
-                std::string file_name = level_manager.get_file_path(index, level);
-                src_readers.push_back(readers[file_name]);
-                global_start = std::min(global_start, readers[file_name]->get_global_start());
+                std::unique_lock<std::mutex> lock(mutex);
+                for (const auto &[level, index] : merge_operation.src_levels_and_indices)
+                {
+                    std::string file_name = level_manager.get_file_path(index, level);
+                    std::shared_ptr<pbt::Reader> reader = version->readers.at(file_name);
+                    src_readers.push_back(reader);
+                    global_start = std::min(global_start, reader->get_global_start());
+                }
+                target_file_name = level_manager.get_file_path(merge_operation.dst_index, merge_operation.dst_level);
             }
 
-            std::string target_file_name = level_manager.get_file_path(merge_operation.dst_index, merge_operation.dst_level);
             pbt::Writer writer(global_start, target_file_name, get_writer_config(config));
-            writer.merge(src_readers);
+            std::vector<std::shared_ptr<pbt::Reader>> disjoint_readers = sort_if_disjoint(src_readers);
+            if (!disjoint_readers.empty())
+            {
+                writer.concatenate(disjoint_readers);
+            }
+            else
+            {
+                writer.merge(src_readers, config.num_sub_compactions);
+            }
             writer.finish();
 
+            std::unique_lock<std::mutex> lock(mutex);
             level_manager.apply_merge_operation(merge_operation);
 
-            readers[target_file_name] = std::make_shared<pbt::Reader>(writer.to_reader());
+            std::vector<std::string> src_file_names;
             for (const auto &[level, index] : merge_operation.src_levels_and_indices)
             {
-                std::string file_name = level_manager.get_file_path(index, level);
-                readers.erase(file_name);
-                std::filesystem::remove(file_name);
+                src_file_names.push_back(level_manager.get_file_path(index, level));
+            }
+            std::shared_ptr<pbt::Reader> target_reader = std::make_shared<pbt::Reader>(writer.to_reader(reader_config));
+            publish_version([&target_file_name, &target_reader, &src_file_names](detail::Version &version)
+                            {
+                                version.readers[target_file_name] = target_reader;
+                                for (const auto &file_name : src_file_names)
+                                {
+                                    version.readers.erase(file_name);
+                                } });
+            for (const auto &src_reader : src_readers)
+            {
+                src_reader->remove_on_close();
+                retired_readers.push_back(src_reader);
+            }
+        }
+
+        /**
+         * Sort the given PBTs by their keys if their key ranges do not overlap, so they can be concatenated instead of merged.
+         * Returns the non-empty PBTs in order of their keys, or nothing if the key ranges overlap.
+         */
+        static std::vector<std::shared_ptr<pbt::Reader>> sort_if_disjoint(const std::vector<std::shared_ptr<pbt::Reader>> &readers)
+        {
+            ZoneDb;
+
+            std::vector<std::shared_ptr<pbt::Reader>> sorted_readers;
+            for (const auto &reader : readers)
+            {
+                if (reader->count() > 0)
+                {
+                    sorted_readers.push_back(reader);
+                }
+            }
+            if (sorted_readers.empty())
+            {
+                return sorted_readers;
+            }
+
+            std::sort(sorted_readers.begin(), sorted_readers.end(), [](const auto &a, const auto &b)
+                      { return a->get_min_key() < b->get_min_key(); });
+            for (size_t i = 1; i < sorted_readers.size(); i++)
+            {
+                if (sorted_readers[i - 1]->get_max_key() >= sorted_readers[i]->get_min_key())
+                {
+                    return {};
+                }
             }
+            return sorted_readers;
         }
 
         // virtual std::optional<std::string> seek_first(const std::string &key) = 0;
@@ -4,3 +4,4 @@
 #include "./hrdb.hpp"
 #include "./iterator.hpp"
 #include "./kvdb.hpp"
+#include "./snapshot.hpp"
@@ -2,11 +2,15 @@
 
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace ninedb::pbt
 {
+    struct IoStats;
+    struct NodeCache;
+
     struct WriterConfig
     {
         /**
@@ -15,7 +19,7 @@ namespace ninedb::pbt
         uint64_t max_node_children = 16;
 
         /**
-         * The initial size of the PBT file.
+         * The initial size of the PBT file, if it is written through a memory mapping.
          */
         uint64_t initial_pbt_size = 1 << 23;
 
@@ -31,5 +35,104 @@ namespace ninedb::pbt
          * If true, an error is thrown if the file already exists.
          */
         bool error_if_exists = false;
+
+        /**
+         * The number of bits per key in the Bloom filter of the PBT.
+         * The filter lets lookups of keys that are not in the PBT skip the tree, with a false positive rate of about 1% at 10 bits per key.
+         * If 0, no filter is written.
+         */
+        uint64_t bloom_filter_bits_per_key = 10;
+
+        /**
+         * If true, the offsets and sizes in the node headers are stored with the smallest width that fits each node,
+         * instead of 8 bytes each.
+         * Files written with compact nodes cannot be read by readers older than version 0.3 of the format.
+         */
+        bool enable_compact_nodes = true;
+
+        /**
+         * If true, keys in leaf nodes only store the part that differs from the previous key,
+         * for the nodes where this makes the node smaller.
+         * Requires compact nodes, and is ignored without them.
+         */
+        bool enable_prefix_compression = false;
+
+        /**
+         * The number of entries between the keys that are stored in full in a prefix compressed leaf node.
+         * Lookups binary search these restart points, and then scan at most this many entries.
+         * Must be between 1 and 65535.
+         */
+        uint64_t prefix_restart_interval = 16;
+
+        /**
+         * If true, leaf nodes are compressed with LZ4, for the nodes where this saves at least 1/8 of their size.
+         * Reads decompress the leaf nodes they need, so a leaf node cache should be used to keep hot nodes decompressed.
+         * Internal nodes are not compressed, as they make up a small part of the file and are needed by every lookup.
+         */
+        bool enable_lz4_compression = false;
+
+        /**
+         * If true, the PBT file is appended to through a buffer and written out in large writes.
+         * Otherwise, it is written through a memory mapping of the file, which is resized and remapped as it grows.
+         * Only applies to writers of a file at a path.
+         */
+        bool enable_streaming_writes = true;
+
+        /**
+         * The size in bytes of the buffer for streamed writes.
+         */
+        uint64_t write_buffer_size = 1 << 20;
+    };
+
+    struct ReaderConfig
+    {
+        /**
+         * The cache for internal nodes, or nullptr to read them from the file every time.
+         * Can be shared by multiple readers.
+         */
+        std::shared_ptr<NodeCache> internal_node_cache = nullptr;
+
+        /**
+         * The cache for leaf nodes, or nullptr to read them from the file every time.
+         * Can be shared by multiple readers.
+         */
+        std::shared_ptr<NodeCache> leaf_node_cache = nullptr;
+
+        /**
+         * If true, the PBT file is mapped into memory, and nodes that are not cached are read through the mapping.
+         * Otherwise, nodes are read from the file with explicit reads, so a cache should be used to keep hot nodes in memory.
+         * Only applies to readers of a file at a path.
+         */
+        bool enable_mmap = true;
+
+        /**
+         * If true, the batches of explicit reads of get_batch() are submitted together through io_uring, where the system supports it.
+         * Otherwise, or where io_uring is not available, the reads of a batch are issued one by one.
+         * Only applies to readers that do not use a memory mapping.
+         * Disabled by default, as it has not been shown to beat individual reads of files that are in the page cache.
+         */
+        bool enable_io_uring = false;
+
+        /**
+         * If true, the system is told how the file is going to be read, so it can read ahead where that pays off.
+         * The file is marked for random reads when it is opened, as most reads are lookups.
+         * Iterators, including the ones of merges, ask for the leaf nodes ahead of them once they move past a leaf node,
+         * in a window that grows as the scan goes on, so the hint for the rest of the file stays in place for concurrent lookups.
+         */
+        bool enable_access_advice = true;
+
+        /**
+         * If true, all internal nodes are read into memory when the PBT is opened, and stay there until it is closed.
+         * Lookups then read at most one node from the file, the leaf node, at the cost of keeping the internal nodes in memory.
+         * The internal nodes are then not put in the internal node cache.
+         */
+        bool pin_internal_nodes = false;
+
+        /**
+         * The statistics that count the explicit reads from the file, or nullptr to not count them.
+         * Reads through a memory mapping are not counted.
+         * Can be shared by multiple readers.
+         */
+        std::shared_ptr<IoStats> io_stats = nullptr;
     };
 }
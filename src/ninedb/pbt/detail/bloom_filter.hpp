@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./format.hpp"
+#include "./utils.hpp"
+
+namespace ninedb::pbt::detail
+{
+    /**
+     * Hash a key for the Bloom filter.
+     * The hash is part of the file format, so it must not depend on the platform or standard library.
+     */
+    inline uint64_t hash_key(std::string_view key)
+    {
+        ZonePbtFormat;
+
+        const uint64_t m = 0xc6a4a7935bd1e995ULL;
+        const uint64_t r = 47;
+
+        uint64_t h = 0x9ee27dc1a3e6a1c5ULL ^ (key.size() * m);
+        const char *data = key.data();
+        const char *end = data + (key.size() & ~uint64_t(7));
+
+        for (; data != end; data += 8)
+        {
+            uint64_t k;
+            memcpy(&k, data, sizeof(uint64_t));
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+            h ^= k;
+            h *= m;
+        }
+
+        uint64_t tail = 0;
+        memcpy(&tail, data, key.size() & 7);
+        if ((key.size() & 7) != 0)
+        {
+            h ^= tail;
+            h *= m;
+        }
+
+        h ^= h >> r;
+        h *= m;
+        h ^= h >> r;
+        return h;
+    }
+
+    /**
+     * Write-only structure for blocked Bloom filters.
+     * Collects the hashes of the keys and writes the filter once the number of keys is known.
+     */
+    struct BloomFilterBuilder
+    {
+        std::vector<uint64_t> hashes;
+
+        void add_key(std::string_view key)
+        {
+            ZonePbtStructures;
+
+            uint64_t hash = hash_key(key);
+            // Keys are added in sorted order, so duplicate keys are adjacent.
+            if (hashes.empty() || hashes.back() != hash)
+            {
+                hashes.push_back(hash);
+            }
+        }
+
+        void clear()
+        {
+            ZonePbtStructures;
+
+            hashes.clear();
+        }
+    };
+
+    /**
+     * Read-only structure for blocked Bloom filters.
+     * Each key sets a number of bits within a single 512-bit block, so a lookup touches one cache line.
+     */
+    struct BloomFilter
+    {
+        static constexpr uint64_t BLOCK_SIZE = 64;
+        static constexpr uint64_t HEADER_SIZE = 2 * sizeof(uint32_t);
+
+        static uint64_t size_of(const BloomFilterBuilder &builder, uint64_t bits_per_key)
+        {
+            ZonePbtStructures;
+
+            return HEADER_SIZE + BLOCK_SIZE * get_num_blocks(builder, bits_per_key);
+        }
+
+        static uint64_t write(char *address, const BloomFilterBuilder &builder, uint64_t bits_per_key)
+        {
+            ZonePbtStructures;
+
+            uint32_t num_blocks = get_num_blocks(builder, bits_per_key);
+            // Optimal number of probes is bits_per_key * ln(2)
+            uint32_t num_probes = std::max<uint64_t>(1, std::min<uint64_t>(16, bits_per_key * 69 / 100));
+
+            char *base = address;
+            address += Format::write_uint32(address, num_blocks);
+            address += Format::write_uint32(address, num_probes);
+            memset(address, 0, BLOCK_SIZE * num_blocks);
+            for (uint64_t hash : builder.hashes)
+            {
+                char *block = address + BLOCK_SIZE * get_block_index(hash, num_blocks);
+                uint32_t h = static_cast<uint32_t>(hash);
+                uint32_t delta = (h >> 17) | (h << 15);
+                for (uint32_t i = 0; i < num_probes; i++)
+                {
+                    uint32_t bit = h & (BLOCK_SIZE * 8 - 1);
+                    block[bit >> 3] |= static_cast<char>(1 << (bit & 7));
+                    h += delta;
+                }
+            }
+            address += BLOCK_SIZE * num_blocks;
+
+            return address - base;
+        }
+
+        /**
+         * Check if the filter may contain the given key.
+         * Returns false only if the key was definitely not added.
+         */
+        static bool may_contain(char *address, std::string_view key)
+        {
+            ZonePbtStructures;
+
+            uint32_t num_blocks;
+            uint32_t num_probes;
+            address += Format::read_uint32(address, num_blocks);
+            address += Format::read_uint32(address, num_probes);
+            if (num_blocks == 0)
+            {
+                return false;
+            }
+
+            uint64_t hash = hash_key(key);
+            char *block = address + BLOCK_SIZE * get_block_index(hash, num_blocks);
+            uint32_t h = static_cast<uint32_t>(hash);
+            uint32_t delta = (h >> 17) | (h << 15);
+            for (uint32_t i = 0; i < num_probes; i++)
+            {
+                uint32_t bit = h & (BLOCK_SIZE * 8 - 1);
+                if ((block[bit >> 3] & (1 << (bit & 7))) == 0)
+                {
+                    return false;
+                }
+                h += delta;
+            }
+            return true;
+        }
+
+    private:
+        static uint32_t get_num_blocks(const BloomFilterBuilder &builder, uint64_t bits_per_key)
+        {
+            return div_ceil(builder.hashes.size() * bits_per_key, BLOCK_SIZE * 8);
+        }
+
+        static uint64_t get_block_index(uint64_t hash, uint32_t num_blocks)
+        {
+            // Multiply-shift maps the upper bits of the hash onto the blocks without a division
+            return ((hash >> 32) * num_blocks) >> 32;
+        }
+    };
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "../../detail/profiling.hpp"
+
+#include "../io_stats.hpp"
+#include "./io_uring.hpp"
+#include "./storage.hpp"
+
+namespace ninedb::pbt::detail
+{
+    /**
+     * Storage that reads the file with positioned reads instead of mapping it into memory.
+     * Reads can be issued from multiple threads at once, and are counted in the given statistics.
+     * Batches of reads go through io_uring if it is enabled and available, and are read one by one otherwise.
+     */
+    struct FileStorage : Storage
+    {
+        FileStorage(const std::string &path, const std::shared_ptr<IoStats> &io_stats, bool enable_io_uring)
+            : Storage(path), size(std::filesystem::file_size(path)), io_stats(io_stats), enable_io_uring(enable_io_uring)
+        {
+#ifdef _WIN32
+            handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (handle == INVALID_HANDLE_VALUE)
+            {
+                throw std::runtime_error("Failed to open file");
+            }
+#else
+            fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                throw std::runtime_error("Failed to open file");
+            }
+#endif
+        }
+
+        ~FileStorage() override
+        {
+#ifdef _WIN32
+            CloseHandle(handle);
+#else
+            ::close(fd);
+#endif
+        }
+
+        void *get_address() const override
+        {
+            ZonePbtStorage;
+
+            return nullptr;
+        }
+
+        std::size_t get_size() const override
+        {
+            ZonePbtStorage;
+
+            return size;
+        }
+
+        void read(uint64_t offset, uint64_t size, char *buffer) const override
+        {
+            ZonePbtStorage;
+
+            if (offset + size > this->size)
+            {
+                throw std::runtime_error("Read past the end of the file");
+            }
+            if (io_stats != nullptr)
+            {
+                io_stats->add_read(size);
+            }
+
+            uint64_t num_read = 0;
+            while (num_read < size)
+            {
+#ifdef _WIN32
+                OVERLAPPED overlapped = {};
+                overlapped.Offset = static_cast<DWORD>(offset + num_read);
+                overlapped.OffsetHigh = static_cast<DWORD>((offset + num_read) >> 32);
+                DWORD result = 0;
+                if (!ReadFile(handle, buffer + num_read, static_cast<DWORD>(std::min<uint64_t>(size - num_read, 1 << 30)), &result, &overlapped))
+                {
+                    throw std::runtime_error("Failed to read file");
+                }
+#else
+                ssize_t result = ::pread(fd, buffer + num_read, size - num_read, offset + num_read);
+                if (result < 0)
+                {
+                    throw std::runtime_error("Failed to read file");
+                }
+#endif
+                if (result == 0)
+                {
+                    throw std::runtime_error("Unexpected end of file");
+                }
+                num_read += result;
+            }
+        }
+
+        void advise(uint64_t offset, uint64_t size, AccessAdvice advice) const override
+        {
+            ZonePbtStorage;
+
+#ifdef __linux__
+            int flag = advice == AccessAdvice::RANDOM ? POSIX_FADV_RANDOM : POSIX_FADV_WILLNEED;
+            // A failed hint does not affect the reads, so errors are ignored
+            ::posix_fadvise(fd, offset, size, flag);
+#endif
+        }
+
+        void read_batch(const std::vector<ReadRequest> &requests) const override
+        {
+            ZonePbtStorage;
+
+#ifdef NINEDB_HAS_IO_URING
+            if (enable_io_uring && requests.size() > 1 && IoUring::get_for_thread().is_available())
+            {
+                for (const ReadRequest &request : requests)
+                {
+                    if (request.offset + request.size > this->size)
+                    {
+                        throw std::runtime_error("Read past the end of the file");
+                    }
+                    if (io_stats != nullptr)
+                    {
+                        io_stats->add_read(request.size);
+                    }
+                }
+                IoUring::get_for_thread().read(fd, requests);
+                return;
+            }
+#endif
+            Storage::read_batch(requests);
+        }
+
+    private:
+        uint64_t size;
+        std::shared_ptr<IoStats> io_stats;
+        bool enable_io_uring;
+#ifdef _WIN32
+        HANDLE handle;
+#else
+        int fd;
+#endif
+    };
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#include "../../detail/profiling.hpp"
+
+namespace ninedb::pbt::detail
+{
+    /**
+     * Sequential writer that appends to a file through a buffer, writing it out in large writes.
+     * Unlike a memory-mapped storage, the file is never resized, remapped or filled with zeros ahead of the data.
+     */
+    struct FileWriter
+    {
+        /**
+         * Create the file at the given path, truncating it if it exists.
+         */
+        FileWriter(const std::string &path, uint64_t buffer_size)
+            : buffer_size(buffer_size)
+        {
+            file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+            file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+            buffer.resize(buffer_size);
+        }
+
+        FileWriter(const FileWriter &) = delete;
+        FileWriter &operator=(const FileWriter &) = delete;
+
+        /**
+         * Get the address to write at most the given number of bytes to, at the end of what has been written.
+         * The bytes are only written once they are committed, and the address is valid until the next call.
+         */
+        char *reserve(uint64_t size)
+        {
+            ZonePbtStorage;
+
+            if (buffer_used + size > buffer.size())
+            {
+                write_buffer();
+                if (size > buffer.size())
+                {
+                    buffer.resize(size);
+                }
+            }
+            return buffer.data() + buffer_used;
+        }
+
+        /**
+         * Append the given number of bytes that were written to the address of the last reservation.
+         */
+        void commit(uint64_t size)
+        {
+            ZonePbtStorage;
+
+            buffer_used += size;
+        }
+
+        /**
+         * Write out the buffer and close the file.
+         */
+        void close()
+        {
+            ZonePbtStorage;
+
+            write_buffer();
+            file.close();
+        }
+
+    private:
+        std::ofstream file;
+        std::string buffer;
+        uint64_t buffer_size;
+        uint64_t buffer_used = 0;
+
+        void write_buffer()
+        {
+            ZonePbtStorage;
+
+            file.write(buffer.data(), buffer_used);
+            buffer_used = 0;
+            // A buffer that grew for a large node is not kept
+            if (buffer.size() > buffer_size)
+            {
+                buffer.resize(buffer_size);
+                buffer.shrink_to_fit();
+            }
+        }
+    };
+}
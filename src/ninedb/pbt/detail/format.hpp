@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -13,11 +15,24 @@ namespace ninedb::pbt::detail
 {
     struct Format
     {
+        /**
+         * The number of bytes that read_uint() may read past the end of the integer.
+         */
+        static constexpr uint64_t MAX_OVER_READ = sizeof(uint64_t) - 1;
+
+        static uint64_t write_uint8(void *address, uint8_t value)
+        {
+            ZonePbtFormat;
+
+            std::memcpy(address, &value, sizeof(uint8_t));
+            return sizeof(uint8_t);
+        }
+
         static uint64_t write_uint16(void *address, uint16_t value)
         {
             ZonePbtFormat;
 
-            *reinterpret_cast<uint16_t *>(address) = value;
+            std::memcpy(address, &value, sizeof(uint16_t));
             return sizeof(uint16_t);
         }
 
@@ -25,7 +40,7 @@ namespace ninedb::pbt::detail
         {
             ZonePbtFormat;
 
-            *reinterpret_cast<uint32_t *>(address) = value;
+            std::memcpy(address, &value, sizeof(uint32_t));
             return sizeof(uint32_t);
         }
 
@@ -33,23 +48,82 @@ namespace ninedb::pbt::detail
         {
             ZonePbtFormat;
 
-            *reinterpret_cast<uint64_t *>(address) = value;
+            std::memcpy(address, &value, sizeof(uint64_t));
             return sizeof(uint64_t);
         }
 
+        /**
+         * Write an unsigned integer with the given width in bytes, which must be 1, 2, 4 or 8.
+         */
+        static uint64_t write_uint(void *address, uint8_t width, uint64_t value)
+        {
+            ZonePbtFormat;
+
+            // The file format is little-endian, so the integer is the first bytes of the value
+            std::memcpy(address, &value, width);
+            return width;
+        }
+
         static uint64_t write_string_data_only(void *address, std::string_view value)
         {
             ZonePbtFormat;
 
-            memcpy(address, value.data(), value.size());
+            std::memcpy(address, value.data(), value.size());
             return value.size();
         }
 
+        /**
+         * Get the maximum size of the LZ4 compressed form of data with the given size, or 0 if the data is too large for LZ4.
+         */
+        static uint64_t lz4_compress_bound(uint64_t size)
+        {
+            ZonePbtFormat;
+
+            if (size > LZ4_MAX_INPUT_SIZE)
+            {
+                return 0;
+            }
+            return LZ4_compressBound(static_cast<int>(size));
+        }
+
+        /**
+         * Compress the given data with LZ4 into at most capacity bytes.
+         * Returns the compressed size, or 0 if the data did not fit.
+         */
+        static uint64_t write_lz4(void *address, std::string_view data, uint64_t capacity)
+        {
+            ZonePbtFormat;
+
+            return LZ4_compress_default(data.data(), reinterpret_cast<char *>(address), static_cast<int>(data.size()), static_cast<int>(capacity));
+        }
+
+        /**
+         * Decompress LZ4 compressed data, which must decompress to exactly the given size.
+         */
+        static void read_lz4(void *address, uint64_t compressed_size, char *data, uint64_t size)
+        {
+            ZonePbtFormat;
+
+            int result = LZ4_decompress_safe(reinterpret_cast<char *>(address), data, static_cast<int>(compressed_size), static_cast<int>(size));
+            if (result < 0 || static_cast<uint64_t>(result) != size)
+            {
+                throw std::runtime_error("Invalid LZ4 compressed data");
+            }
+        }
+
+        static uint64_t read_uint8(void *address, uint8_t &value)
+        {
+            ZonePbtFormat;
+
+            std::memcpy(&value, address, sizeof(uint8_t));
+            return sizeof(uint8_t);
+        }
+
         static uint64_t read_uint16(void *address, uint16_t &value)
         {
             ZonePbtFormat;
 
-            value = *reinterpret_cast<uint16_t *>(address);
+            std::memcpy(&value, address, sizeof(uint16_t));
             return sizeof(uint16_t);
         }
 
@@ -57,7 +131,7 @@ namespace ninedb::pbt::detail
         {
             ZonePbtFormat;
 
-            value = *reinterpret_cast<uint32_t *>(address);
+            std::memcpy(&value, address, sizeof(uint32_t));
             return sizeof(uint32_t);
         }
 
@@ -65,10 +139,48 @@ namespace ninedb::pbt::detail
         {
             ZonePbtFormat;
 
-            value = *reinterpret_cast<uint64_t *>(address);
+            std::memcpy(&value, address, sizeof(uint64_t));
             return sizeof(uint64_t);
         }
 
+        /**
+         * Read an unsigned integer with the given width in bytes, which must be 1, 2, 4 or 8.
+         * Always loads 8 bytes without branching on the width, so up to MAX_OVER_READ bytes after the integer must be readable.
+         */
+        static uint64_t read_uint(void *address, uint8_t width, uint64_t &value)
+        {
+            ZonePbtFormat;
+
+            std::memcpy(&value, address, sizeof(uint64_t));
+            value &= ~uint64_t(0) >> (64 - 8 * width);
+            return width;
+        }
+
+        /**
+         * Get the smallest width in bytes out of 1, 2, 4 and 8 that can hold the given value.
+         */
+        static constexpr uint8_t width_of(uint64_t value)
+        {
+            if (value <= UINT8_MAX)
+            {
+                return 1;
+            }
+            if (value <= UINT16_MAX)
+            {
+                return 2;
+            }
+            if (value <= UINT32_MAX)
+            {
+                return 4;
+            }
+            return 8;
+        }
+
+        static constexpr uint64_t skip_uint8(uint64_t count = 1)
+        {
+            return count * sizeof(uint8_t);
+        }
+
         static constexpr uint64_t skip_uint16(uint64_t count = 1)
         {
             return count * sizeof(uint16_t);
@@ -0,0 +1,231 @@
+#pragma once
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define NINEDB_HAS_IO_URING
+#endif
+
+#ifdef NINEDB_HAS_IO_URING
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../../detail/profiling.hpp"
+
+#include "./storage.hpp"
+
+namespace ninedb::pbt::detail
+{
+    /**
+     * A minimal io_uring instance that reads batches of requests from a file, with many reads in flight at once.
+     * Uses the system calls directly, so it does not depend on liburing.
+     * Not thread-safe; get_for_thread() gives each thread its own instance.
+     */
+    struct IoUring
+    {
+        /**
+         * The maximum number of reads in flight.
+         */
+        static constexpr uint32_t QUEUE_DEPTH = 64;
+
+        IoUring(uint32_t num_entries)
+        {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, num_entries, &params));
+            if (ring_fd < 0)
+            {
+                // Not supported by the kernel, or not allowed in this process
+                ring_fd = -1;
+                return;
+            }
+
+            sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+            cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single_mmap)
+            {
+                sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+            }
+            sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+            sq_ring = map(sq_ring_size, IORING_OFF_SQ_RING);
+            cq_ring = single_mmap ? sq_ring : map(cq_ring_size, IORING_OFF_CQ_RING);
+            sqes = reinterpret_cast<io_uring_sqe *>(map(sqes_size, IORING_OFF_SQES));
+            if (sq_ring == nullptr || cq_ring == nullptr || sqes == nullptr)
+            {
+                unmap();
+                close(ring_fd);
+                ring_fd = -1;
+                return;
+            }
+
+            sq_tail = reinterpret_cast<uint32_t *>(sq_ring + params.sq_off.tail);
+            sq_head = reinterpret_cast<uint32_t *>(sq_ring + params.sq_off.head);
+            sq_mask = *reinterpret_cast<uint32_t *>(sq_ring + params.sq_off.ring_mask);
+            sq_array = reinterpret_cast<uint32_t *>(sq_ring + params.sq_off.array);
+            cq_head = reinterpret_cast<uint32_t *>(cq_ring + params.cq_off.head);
+            cq_tail = reinterpret_cast<uint32_t *>(cq_ring + params.cq_off.tail);
+            cq_mask = *reinterpret_cast<uint32_t *>(cq_ring + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe *>(cq_ring + params.cq_off.cqes);
+            this->num_entries = params.sq_entries;
+        }
+
+        ~IoUring()
+        {
+            if (ring_fd >= 0)
+            {
+                unmap();
+                close(ring_fd);
+            }
+        }
+
+        IoUring(const IoUring &) = delete;
+        IoUring &operator=(const IoUring &) = delete;
+
+        /**
+         * Get the instance of the calling thread, which is created on first use.
+         */
+        static IoUring &get_for_thread()
+        {
+            ZonePbtStorage;
+
+            thread_local IoUring ring(QUEUE_DEPTH);
+            return ring;
+        }
+
+        /**
+         * Check if io_uring could be set up, so read() can be used.
+         */
+        bool is_available() const
+        {
+            ZonePbtStorage;
+
+            return ring_fd >= 0;
+        }
+
+        /**
+         * Read the given requests from the given file, keeping up to the size of the ring in flight.
+         * Reads that come back short, or that the kernel does not support through io_uring, are finished with pread.
+         */
+        void read(int fd, const std::vector<ReadRequest> &requests)
+        {
+            ZonePbtStorage;
+
+            uint64_t num_submitted = 0;
+            uint64_t num_completed = 0;
+            while (num_completed < requests.size())
+            {
+                uint32_t tail = *sq_tail;
+                while (num_submitted < requests.size() && num_submitted - num_completed < num_entries)
+                {
+                    const ReadRequest &request = requests[num_submitted];
+                    uint32_t index = tail & sq_mask;
+                    io_uring_sqe *sqe = &sqes[index];
+                    std::memset(sqe, 0, sizeof(*sqe));
+                    sqe->opcode = IORING_OP_READ;
+                    sqe->fd = fd;
+                    sqe->addr = reinterpret_cast<uint64_t>(request.buffer);
+                    sqe->len = static_cast<uint32_t>(std::min<uint64_t>(request.size, UINT32_MAX));
+                    sqe->off = request.offset;
+                    sqe->user_data = num_submitted;
+                    sq_array[index] = index;
+                    tail++;
+                    num_submitted++;
+                }
+                __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+                uint32_t num_to_submit = tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+                if (syscall(__NR_io_uring_enter, ring_fd, num_to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+                {
+                    throw std::runtime_error("Failed to submit reads");
+                }
+
+                uint32_t head = *cq_head;
+                while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+                {
+                    const io_uring_cqe &cqe = cqes[head & cq_mask];
+                    complete(fd, requests[cqe.user_data], cqe.res);
+                    head++;
+                    num_completed++;
+                }
+                __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+            }
+        }
+
+    private:
+        int ring_fd = -1;
+        uint32_t num_entries = 0;
+        uint64_t sq_ring_size = 0;
+        uint64_t cq_ring_size = 0;
+        uint64_t sqes_size = 0;
+        char *sq_ring = nullptr;
+        char *cq_ring = nullptr;
+        io_uring_sqe *sqes = nullptr;
+        uint32_t *sq_head = nullptr;
+        uint32_t *sq_tail = nullptr;
+        uint32_t sq_mask = 0;
+        uint32_t *sq_array = nullptr;
+        uint32_t *cq_head = nullptr;
+        uint32_t *cq_tail = nullptr;
+        uint32_t cq_mask = 0;
+        io_uring_cqe *cqes = nullptr;
+
+        char *map(uint64_t size, uint64_t offset)
+        {
+            void *address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+            return address == MAP_FAILED ? nullptr : reinterpret_cast<char *>(address);
+        }
+
+        void unmap()
+        {
+            if (sqes != nullptr)
+            {
+                munmap(sqes, sqes_size);
+            }
+            if (cq_ring != nullptr && cq_ring != sq_ring)
+            {
+                munmap(cq_ring, cq_ring_size);
+            }
+            if (sq_ring != nullptr)
+            {
+                munmap(sq_ring, sq_ring_size);
+            }
+        }
+
+        /**
+         * Finish the given request, of which the given number of bytes were read, or which failed with the given negated error.
+         */
+        static void complete(int fd, const ReadRequest &request, int32_t result)
+        {
+            uint64_t num_read = result > 0 ? result : 0;
+            if (result < 0 && result != -EINVAL && result != -EOPNOTSUPP && result != -EAGAIN && result != -EINTR)
+            {
+                throw std::runtime_error("Failed to read file");
+            }
+            while (num_read < request.size)
+            {
+                ssize_t pread_result = ::pread(fd, request.buffer + num_read, request.size - num_read, request.offset + num_read);
+                if (pread_result < 0)
+                {
+                    throw std::runtime_error("Failed to read file");
+                }
+                if (pread_result == 0)
+                {
+                    throw std::runtime_error("Unexpected end of file");
+                }
+                num_read += pread_result;
+            }
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,528 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "../../detail/profiling.hpp"
+
+#include "../node_cache.hpp"
+#include "./storage.hpp"
+#include "./structures.hpp"
+
+namespace ninedb::pbt::detail
+{
+    /**
+     * A pin on a node in a node cache, which is released when the pin is destroyed.
+     * The pin also holds the node itself, so the node stays in memory even if it is replaced in the cache.
+     */
+    struct NodePin
+    {
+        NodePin(const std::shared_ptr<NodeCache> &cache, uint64_t file_id, const NodeRef &node)
+            : cache(cache), file_id(file_id), node(node) {}
+
+        NodePin(const NodePin &) = delete;
+        NodePin &operator=(const NodePin &) = delete;
+
+        ~NodePin()
+        {
+            ZonePbtReader;
+
+            cache->unpin(file_id, node.offset);
+        }
+
+    private:
+        std::shared_ptr<NodeCache> cache;
+        uint64_t file_id;
+        NodeRef node;
+    };
+
+    /**
+     * Loads the nodes of a PBT file, through the node caches if the reader has any.
+     * Without caches, nodes point directly into the storage, except for compressed leaf nodes, which are decompressed on every load.
+     * If the storage is not mapped into memory, every load that misses the cache reads the node from the file.
+     * The caches hold decompressed nodes.
+     */
+    struct NodeLoader
+    {
+        NodeLoader(const std::shared_ptr<Storage> &storage, bool compact, bool lz4_compression, const std::shared_ptr<NodeCache> &internal_node_cache, const std::shared_ptr<NodeCache> &leaf_node_cache, bool enable_access_advice)
+            : storage(storage), compact(compact), lz4_compression(lz4_compression), internal_node_cache(internal_node_cache), leaf_node_cache(leaf_node_cache), enable_access_advice(enable_access_advice), file_id(next_file_id()) {}
+
+        /**
+         * Check if the nodes of the file use the compact layout.
+         */
+        bool is_compact() const
+        {
+            ZonePbtReader;
+
+            return compact;
+        }
+
+        /**
+         * Load the leaf node at the given offset.
+         * If fill_cache is false, a node that is not in the cache yet is not added to it, so scans do not push out the nodes of lookups.
+         */
+        NodeRef load_leaf(uint64_t offset, bool fill_cache = true) const
+        {
+            ZonePbtReader;
+
+            return load<NodeLeaf>(offset, leaf_node_cache, fill_cache, nullptr);
+        }
+
+        /**
+         * Load the leaf node at the given offset, along with a pin that keeps the node in memory for as long as the pin exists.
+         * A node that is in the leaf node cache stays pinned there, so it is not evicted while it is in use.
+         */
+        NodeRef load_leaf_pinned(uint64_t offset, std::shared_ptr<const void> &pin) const
+        {
+            ZonePbtReader;
+
+            pin.reset();
+            NodeRef node = load<NodeLeaf>(offset, leaf_node_cache, true, &pin);
+            if (pin == nullptr)
+            {
+                pin = get_owner(node);
+            }
+            return node;
+        }
+
+        /**
+         * Get the owner of the memory of the given node, which keeps the node in memory for as long as it exists.
+         * This is the data of the node, or the storage if the node points into the memory mapping of the file.
+         */
+        std::shared_ptr<const void> get_owner(const NodeRef &node) const
+        {
+            ZonePbtReader;
+
+            if (node.data != nullptr)
+            {
+                return node.data;
+            }
+            return storage;
+        }
+
+        /**
+         * Load the leaf node that follows the given leaf node in the file.
+         */
+        NodeRef load_next_leaf(const NodeRef &node, bool fill_cache = true) const
+        {
+            ZonePbtReader;
+
+            uint64_t size = node.size != 0 ? node.size : NodeLeaf::size_of(node.address, compact);
+            return load_leaf(node.offset + size, fill_cache);
+        }
+
+        /**
+         * Load the internal node at the given offset.
+         */
+        NodeRef load_internal(uint64_t offset) const
+        {
+            ZonePbtReader;
+
+            return load<NodeInternal>(offset, internal_node_cache, true, nullptr);
+        }
+
+        /**
+         * Load the leaf nodes at the given offsets, reading the ones that are not cached with a batch of reads.
+         */
+        void load_leaf_batch(const std::vector<uint64_t> &offsets, std::vector<NodeRef> &nodes) const
+        {
+            ZonePbtReader;
+
+            load_batch<NodeLeaf>(offsets, leaf_node_cache, nodes);
+        }
+
+        /**
+         * Load the internal nodes at the given offsets, reading the ones that are not cached with a batch of reads.
+         */
+        void load_internal_batch(const std::vector<uint64_t> &offsets, std::vector<NodeRef> &nodes) const
+        {
+            ZonePbtReader;
+
+            load_batch<NodeInternal>(offsets, internal_node_cache, nodes);
+        }
+
+        /**
+         * Copy the internal nodes in the given range of the file into memory, where they stay for the lifetime of the loader.
+         * Loads of these nodes then never touch the file or the internal node cache.
+         */
+        void pin_internal_nodes(uint64_t start, uint64_t end)
+        {
+            ZonePbtReader;
+
+            pinned_nodes.assign(end - start + Format::MAX_OVER_READ, '\0');
+            storage->read(start, end - start, pinned_nodes.data());
+            pinned_nodes_start = start;
+            pinned_nodes_end = end;
+        }
+
+        /**
+         * Get the number of bytes of internal nodes that are pinned in memory.
+         */
+        uint64_t get_pinned_size() const
+        {
+            ZonePbtReader;
+
+            return pinned_nodes_end - pinned_nodes_start;
+        }
+
+        /**
+         * Give the system a hint about how the given range of the file is going to be read, unless hints are disabled.
+         */
+        void advise(uint64_t offset, uint64_t size, AccessAdvice advice) const
+        {
+            ZonePbtReader;
+
+            if (enable_access_advice)
+            {
+                storage->advise(offset, size, advice);
+            }
+        }
+
+        /**
+         * Check if the storage is mapped into memory, so offset_to_address() can be used.
+         */
+        bool is_mapped() const
+        {
+            ZonePbtReader;
+
+            return storage->get_address() != nullptr;
+        }
+
+        /**
+         * Read the given number of bytes at the given offset in the storage into the buffer.
+         */
+        void read(uint64_t offset, uint64_t size, std::string &buffer) const
+        {
+            ZonePbtReader;
+
+            buffer.resize(size);
+            storage->read(offset, size, buffer.data());
+        }
+
+        /**
+         * Get the memory address of the given offset in the storage, which must be mapped into memory.
+         */
+        char *offset_to_address(uint64_t offset) const
+        {
+            ZonePbtReader;
+
+            return reinterpret_cast<char *>(storage->get_address()) + offset;
+        }
+
+    private:
+        /**
+         * The number of bytes that are read at once from a storage that is not mapped into memory.
+         * Most nodes fit in one read, and larger nodes take a second read for the rest.
+         */
+        static constexpr uint64_t READ_BLOCK_SIZE = 4096;
+
+        std::shared_ptr<Storage> storage;
+        bool compact;
+        bool lz4_compression;
+        std::shared_ptr<NodeCache> internal_node_cache;
+        std::shared_ptr<NodeCache> leaf_node_cache;
+        bool enable_access_advice;
+        uint64_t file_id;
+        // The internal nodes that are kept in memory, which are all the nodes in the range from the start to the end
+        std::string pinned_nodes;
+        uint64_t pinned_nodes_start = 0;
+        uint64_t pinned_nodes_end = 0;
+
+        bool try_get_pinned(uint64_t offset, NodeRef &node) const
+        {
+            ZonePbtReader;
+
+            if (offset < pinned_nodes_start || offset >= pinned_nodes_end)
+            {
+                return false;
+            }
+            node.address = const_cast<char *>(pinned_nodes.data()) + (offset - pinned_nodes_start);
+            node.offset = offset;
+            return true;
+        }
+
+        /**
+         * Load the node at the given offset through the given cache.
+         * If a pin is requested and the node ends up in the cache, the node is pinned there and the pin is set.
+         */
+        template <typename N>
+        NodeRef load(uint64_t offset, const std::shared_ptr<NodeCache> &cache, bool fill_cache, std::shared_ptr<const void> *pin) const
+        {
+            ZonePbtReader;
+
+            NodeRef node;
+            if (std::is_same_v<N, NodeInternal> && try_get_pinned(offset, node))
+            {
+                return node;
+            }
+            if (cache != nullptr && pin == nullptr && cache->try_get(file_id, offset, node))
+            {
+                return node;
+            }
+            if (cache != nullptr && pin != nullptr && cache->try_get_and_pin(file_id, offset, node))
+            {
+                *pin = std::make_shared<NodePin>(cache, file_id, node);
+                return node;
+            }
+
+            if (!is_mapped())
+            {
+                read_node<N>(offset, node);
+                if (cache != nullptr && fill_cache)
+                {
+                    put(cache, node, pin);
+                }
+                return node;
+            }
+
+            node.address = offset_to_address(offset);
+            node.offset = offset;
+
+            uint64_t header_size = 0;
+            if (std::is_same_v<N, NodeLeaf> && lz4_compression)
+            {
+                if (NodeLeafFrame::is_compressed(node.address))
+                {
+                    node.data = std::make_shared<std::string>();
+                    node.size = NodeLeafFrame::decompress(node.address, *node.data);
+                    node.address = node.data->data();
+                    if (cache != nullptr && fill_cache)
+                    {
+                        put(cache, node, pin);
+                    }
+                    return node;
+                }
+
+                // The size of the frame is needed to find the next leaf node
+                header_size = NodeLeafFrame::UNCOMPRESSED_HEADER_SIZE;
+                node.address += header_size;
+                node.size = header_size + N::size_of(node.address, compact);
+            }
+
+            if (cache != nullptr && fill_cache)
+            {
+                if (node.size == 0)
+                {
+                    node.size = N::size_of(node.address, compact);
+                }
+                node.data = std::make_shared<std::string>(node.address, node.size - header_size);
+                // Padding for the header reads, which may read past the end of the node
+                node.data->append(Format::MAX_OVER_READ, '\0');
+                node.address = node.data->data();
+                put(cache, node, pin);
+            }
+            return node;
+        }
+
+        /**
+         * Add a node to the cache, and pin it there if a pin is requested.
+         */
+        void put(const std::shared_ptr<NodeCache> &cache, const NodeRef &node, std::shared_ptr<const void> *pin) const
+        {
+            ZonePbtReader;
+
+            if (pin == nullptr)
+            {
+                cache->put(file_id, node.offset, node);
+            }
+            else if (cache->put_and_pin(file_id, node.offset, node))
+            {
+                *pin = std::make_shared<NodePin>(cache, file_id, node);
+            }
+        }
+
+        /**
+         * A node that is being read from the storage, with the bytes that have been read so far.
+         */
+        struct PendingRead
+        {
+            uint64_t offset;
+            uint64_t read_size;
+            // Followed by padding for the header reads, which may read past the end of what has been read
+            std::string buffer;
+        };
+
+        /**
+         * Start reading the node at the given offset, with a read of one block.
+         */
+        ReadRequest start_read(uint64_t offset, PendingRead &read) const
+        {
+            ZonePbtReader;
+
+            read.offset = offset;
+            read.read_size = std::min(READ_BLOCK_SIZE, storage->get_size() - offset);
+            read.buffer.assign(read.read_size + Format::MAX_OVER_READ, '\0');
+            return ReadRequest{offset, read.read_size, read.buffer.data()};
+        }
+
+        /**
+         * Continue reading the node, up to the given size.
+         */
+        ReadRequest continue_read(uint64_t size, PendingRead &read) const
+        {
+            ZonePbtReader;
+
+            read.buffer.resize(size + Format::MAX_OVER_READ);
+            ReadRequest request{read.offset + read.read_size, size - read.read_size, read.buffer.data() + read.read_size};
+            read.read_size = size;
+            return request;
+        }
+
+        /**
+         * Get the number of bytes of the node that are needed to continue.
+         * Once this is no more than what has been read, it is the size of the node in the file.
+         */
+        template <typename N>
+        uint64_t get_needed_size(PendingRead &read) const
+        {
+            ZonePbtReader;
+
+            char *address = read.buffer.data();
+            uint64_t header_size = 0;
+            if (std::is_same_v<N, NodeLeaf> && lz4_compression)
+            {
+                if (read.read_size < NodeLeafFrame::COMPRESSED_HEADER_SIZE)
+                {
+                    return NodeLeafFrame::COMPRESSED_HEADER_SIZE;
+                }
+                if (NodeLeafFrame::is_compressed(address))
+                {
+                    return NodeLeafFrame::compressed_size_of(address);
+                }
+                header_size = NodeLeafFrame::UNCOMPRESSED_HEADER_SIZE;
+            }
+
+            uint64_t node_header_size = header_size + N::header_size_of(address + header_size, compact);
+            if (node_header_size > read.read_size)
+            {
+                return node_header_size;
+            }
+            return header_size + N::size_of(address + header_size, compact);
+        }
+
+        /**
+         * Make a node of size bytes out of a read that has read all of it.
+         * The node only keeps the memory it needs, so the buffer of the read can be reused.
+         */
+        template <typename N>
+        void finish_read(PendingRead &read, uint64_t size, NodeRef &node) const
+        {
+            ZonePbtReader;
+
+            node.offset = read.offset;
+            if (std::is_same_v<N, NodeLeaf> && lz4_compression)
+            {
+                if (NodeLeafFrame::is_compressed(read.buffer.data()))
+                {
+                    node.data = std::make_shared<std::string>();
+                    node.size = NodeLeafFrame::decompress(read.buffer.data(), *node.data);
+                    node.address = node.data->data();
+                    return;
+                }
+            }
+
+            uint64_t header_size = std::is_same_v<N, NodeLeaf> && lz4_compression ? NodeLeafFrame::UNCOMPRESSED_HEADER_SIZE : 0;
+            node.size = size;
+            node.data = std::make_shared<std::string>(read.buffer.data() + header_size, size - header_size);
+            node.data->append(Format::MAX_OVER_READ, '\0');
+            node.address = node.data->data();
+        }
+
+        /**
+         * Read the node at the given offset from the storage into memory.
+         * Reads a block, and then the rest of the node if it does not fit in the block.
+         */
+        template <typename N>
+        void read_node(uint64_t offset, NodeRef &node) const
+        {
+            ZonePbtReader;
+
+            thread_local PendingRead read;
+            ReadRequest request = start_read(offset, read);
+            storage->read(request.offset, request.size, request.buffer);
+            uint64_t size;
+            while ((size = get_needed_size<N>(read)) > read.read_size)
+            {
+                request = continue_read(size, read);
+                storage->read(request.offset, request.size, request.buffer);
+            }
+            finish_read<N>(read, size, node);
+        }
+
+        /**
+         * Load the nodes at the given offsets.
+         * The nodes that are not cached are read from the storage together, in a few batches of reads.
+         */
+        template <typename N>
+        void load_batch(const std::vector<uint64_t> &offsets, const std::shared_ptr<NodeCache> &cache, std::vector<NodeRef> &nodes) const
+        {
+            ZonePbtReader;
+
+            nodes.resize(offsets.size());
+            if (is_mapped())
+            {
+                for (uint64_t i = 0; i < offsets.size(); i++)
+                {
+                    nodes[i] = load<N>(offsets[i], cache, true, nullptr);
+                }
+                return;
+            }
+
+            std::vector<uint64_t> missing;
+            for (uint64_t i = 0; i < offsets.size(); i++)
+            {
+                if (std::is_same_v<N, NodeInternal> && try_get_pinned(offsets[i], nodes[i]))
+                {
+                    continue;
+                }
+                if (cache == nullptr || !cache->try_get(file_id, offsets[i], nodes[i]))
+                {
+                    missing.push_back(i);
+                }
+            }
+
+            std::vector<PendingRead> reads(missing.size());
+            std::vector<uint64_t> sizes(missing.size());
+            std::vector<ReadRequest> requests;
+            for (uint64_t j = 0; j < missing.size(); j++)
+            {
+                requests.push_back(start_read(offsets[missing[j]], reads[j]));
+            }
+            // The first batch reads the headers, and only nodes that are larger than a block need another batch
+            while (!requests.empty())
+            {
+                storage->read_batch(requests);
+                requests.clear();
+                for (uint64_t j = 0; j < missing.size(); j++)
+                {
+                    sizes[j] = get_needed_size<N>(reads[j]);
+                    if (sizes[j] > reads[j].read_size)
+                    {
+                        requests.push_back(continue_read(sizes[j], reads[j]));
+                    }
+                }
+            }
+
+            for (uint64_t j = 0; j < missing.size(); j++)
+            {
+                NodeRef &node = nodes[missing[j]];
+                finish_read<N>(reads[j], sizes[j], node);
+                if (cache != nullptr)
+                {
+                    cache->put(file_id, node.offset, node);
+                }
+            }
+        }
+
+        static uint64_t next_file_id()
+        {
+            static std::atomic<uint64_t> counter{0};
+            return counter.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+}
@@ -1,8 +1,17 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <stdexcept>
 #include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 #include <boost/interprocess/file_mapping.hpp>
 #include <boost/interprocess/mapped_region.hpp>
@@ -11,28 +20,46 @@
 
 namespace ninedb::pbt::detail
 {
+    /**
+     * A hint about how a range of a storage is going to be read.
+     */
+    enum class AccessAdvice
+    {
+        // Lookups that jump around the file, so reading ahead is wasted
+        RANDOM,
+        // Reads of the range in the near future, so it can be loaded ahead of time
+        WILLNEED,
+    };
+
+    /**
+     * A read of the given number of bytes at the given offset into the buffer.
+     */
+    struct ReadRequest
+    {
+        uint64_t offset;
+        uint64_t size;
+        char *buffer;
+    };
+
+    /**
+     * The bytes of a PBT file, which are either mapped into memory or read explicitly.
+     */
     struct Storage
     {
-        /**
-         * Create a new storage at the given path.
-         */
-        Storage(const std::string &path, bool read_only)
-            : path(path), read_only(read_only)
+        Storage(const std::string &path)
+            : path(path)
         {
             if (!std::filesystem::exists(path))
             {
                 throw std::runtime_error("File does not exist");
             }
-
-            load_mmap();
         }
 
-        ~Storage()
+        virtual ~Storage()
         {
-            if (region != nullptr)
+            if (remove_file_on_close.load(std::memory_order_acquire))
             {
-                flush();
-                unload_mmap();
+                std::filesystem::remove(path);
             }
         }
 
@@ -40,25 +67,124 @@ namespace ninedb::pbt::detail
         Storage &operator=(const Storage &) = delete;
 
         /**
-         * Get the memory address of the beginning of the storage.
+         * Get the memory address of the beginning of the storage, or nullptr if the storage is not mapped into memory and has to be read with read().
+         */
+        virtual void *get_address() const = 0;
+
+        /**
+         * Get the length of the storage in bytes.
+         */
+        virtual std::size_t get_size() const = 0;
+
+        /**
+         * Read the given number of bytes at the given offset into the buffer.
          */
-        void *get_address() const
+        virtual void read(uint64_t offset, uint64_t size, char *buffer) const = 0;
+
+        /**
+         * Read all given requests, which storages that support it keep in flight at the same time.
+         */
+        virtual void read_batch(const std::vector<ReadRequest> &requests) const
         {
             ZonePbtStorage;
 
-            return region->get_address();
+            for (const ReadRequest &request : requests)
+            {
+                read(request.offset, request.size, request.buffer);
+            }
         }
 
         /**
-         * Get the length of the storage in bytes.
+         * Give the system a hint about how the given range of the storage is going to be read.
+         * Storages that cannot pass on hints ignore them.
          */
-        std::size_t get_size() const
+        virtual void advise(uint64_t, uint64_t, AccessAdvice) const
+        {
+            ZonePbtStorage;
+        }
+
+        /**
+         * Remove the file once the storage is destroyed.
+         * Used for files that are no longer part of the db but may still be read through existing references.
+         */
+        void remove_on_close()
+        {
+            ZonePbtStorage;
+
+            remove_file_on_close.store(true, std::memory_order_release);
+        }
+
+    protected:
+        std::string path;
+
+    private:
+        std::atomic<bool> remove_file_on_close{false};
+    };
+
+    /**
+     * Storage that maps the whole file into memory.
+     * Unless it is read-only, it can also be resized and written to.
+     */
+    struct MmapStorage : Storage
+    {
+        MmapStorage(const std::string &path, bool read_only)
+            : Storage(path), read_only(read_only)
+        {
+            load_mmap();
+        }
+
+        ~MmapStorage() override
+        {
+            if (region != nullptr)
+            {
+                if (!read_only)
+                {
+                    flush();
+                }
+                unload_mmap();
+            }
+        }
+
+        void *get_address() const override
+        {
+            ZonePbtStorage;
+
+            return region->get_address();
+        }
+
+        std::size_t get_size() const override
         {
             ZonePbtStorage;
 
             return region->get_size();
         }
 
+        void read(uint64_t offset, uint64_t size, char *buffer) const override
+        {
+            ZonePbtStorage;
+
+            std::memcpy(buffer, reinterpret_cast<char *>(region->get_address()) + offset, size);
+        }
+
+        void advise(uint64_t offset, uint64_t size, AccessAdvice advice) const override
+        {
+            ZonePbtStorage;
+
+#ifndef _WIN32
+            // The range has to start at a page boundary, and the mapping starts at one
+            uint64_t page_size = boost::interprocess::mapped_region::get_page_size();
+            uint64_t start = offset / page_size * page_size;
+            uint64_t end = std::min<uint64_t>(offset + size, region->get_size());
+            if (start >= end)
+            {
+                return;
+            }
+            int flag = advice == AccessAdvice::RANDOM ? MADV_RANDOM : MADV_WILLNEED;
+            // A failed hint does not affect the reads, so errors are ignored
+            ::madvise(reinterpret_cast<char *>(region->get_address()) + start, end - start, flag);
+#endif
+        }
+
         /**
          * Ensure that the storage is at least the given size.
          */
@@ -117,7 +243,6 @@ namespace ninedb::pbt::detail
         }
 
     private:
-        std::string path;
         bool read_only;
         boost::interprocess::file_mapping *mapping = nullptr;
         boost::interprocess::mapped_region *region = nullptr;
@@ -127,9 +252,11 @@ namespace ninedb::pbt::detail
             ZonePbtStorage;
 
             {
+                // Read-only mappings cannot write to the file by accident, and their pages are never dirty
+                boost::interprocess::mode_t mode = read_only ? boost::interprocess::read_only : boost::interprocess::read_write;
                 size_t size = std::filesystem::file_size(path);
-                mapping = new boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_write);
-                region = new boost::interprocess::mapped_region(*mapping, boost::interprocess::read_write, 0, size);
+                mapping = new boost::interprocess::file_mapping(path.c_str(), mode);
+                region = new boost::interprocess::mapped_region(*mapping, mode, 0, size);
             }
         }
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 #include <string>
@@ -7,6 +8,7 @@
 #include <vector>
 
 #include "./format.hpp"
+#include "./utils.hpp"
 
 namespace ninedb::pbt::detail
 {
@@ -15,7 +17,8 @@ namespace ninedb::pbt::detail
     {
         static const uint32_t MAGIC = 0x1EAF1111;
         static const uint32_t VERSION_MAJOR = 0;
-        static const uint32_t VERSION_MINOR = 1;
+        static const uint32_t VERSION_MINOR = 3;
+        static const uint32_t VERSION_MINOR_MIN = 1;
 
         // Root node handle.
         uint64_t root_offset;
@@ -23,9 +26,6 @@ namespace ninedb::pbt::detail
 
         // Tree structure values.
         uint16_t tree_height;
-        // uint8_t enable_lz4_compression; // TODO: implement
-        // uint8_t enable_varint_compression; // TODO: implement
-        // uint8_t enable_prefix_compression; // TODO: implement
 
         // Metadata values.
         uint64_t global_start;
@@ -67,14 +67,26 @@ namespace ninedb::pbt::detail
         {
             ZonePbtFormat;
 
-            address += Format::read_uint64(address, footer.root_offset);
-            address += Format::read_uint64(address, footer.root_size);
-            address += Format::read_uint16(address, footer.tree_height);
-            address += Format::read_uint64(address, footer.global_start);
-            address += Format::read_uint64(address, footer.global_end);
-            address += Format::read_uint16(address, footer.version_major);
-            address += Format::read_uint16(address, footer.version_minor);
-            address += Format::read_uint32(address, footer.magic);
+            // The fields of the packed footer are not aligned, so they are read through aligned locals
+            uint64_t root_offset, root_size, global_start, global_end;
+            uint16_t tree_height, version_major, version_minor;
+            uint32_t magic;
+            address += Format::read_uint64(address, root_offset);
+            address += Format::read_uint64(address, root_size);
+            address += Format::read_uint16(address, tree_height);
+            address += Format::read_uint64(address, global_start);
+            address += Format::read_uint64(address, global_end);
+            address += Format::read_uint16(address, version_major);
+            address += Format::read_uint16(address, version_minor);
+            address += Format::read_uint32(address, magic);
+            footer.root_offset = root_offset;
+            footer.root_size = root_size;
+            footer.tree_height = tree_height;
+            footer.global_start = global_start;
+            footer.global_end = global_end;
+            footer.version_major = version_major;
+            footer.version_minor = version_minor;
+            footer.magic = magic;
 
             return Footer::size_of();
         }
@@ -96,14 +108,123 @@ namespace ninedb::pbt::detail
             {
                 throw std::runtime_error("Invalid major version");
             }
-            if (this->version_minor != VERSION_MINOR)
+            if (this->version_minor < VERSION_MINOR_MIN || this->version_minor > VERSION_MINOR)
             {
                 throw std::runtime_error("Invalid minor version");
             }
         }
+
+        /**
+         * Check if the footer is preceded by a footer extension, which was introduced in version 0.2.
+         */
+        bool has_extension() const
+        {
+            ZonePbtStructures;
+
+            return this->version_minor >= 2;
+        }
     };
 #pragma pack(pop)
 
+    /**
+     * Footer fields added in version 0.2, stored directly before the footer.
+     * The size of the extension is stored in its last field, so later versions can add fields after the existing ones.
+     * Fields that are not present in a file are read as zero.
+     */
+    struct FooterExtension
+    {
+        /**
+         * The nodes use the compact layout of version 0.3.
+         */
+        static const uint64_t FLAG_COMPACT_NODES = 1 << 0;
+
+        /**
+         * Leaf nodes may use prefix compression, which requires compact nodes.
+         */
+        static const uint64_t FLAG_PREFIX_COMPRESSION = 1 << 1;
+
+        /**
+         * Leaf nodes are stored in frames, which may compress them with LZ4.
+         */
+        static const uint64_t FLAG_LZ4_COMPRESSION = 1 << 2;
+
+        /**
+         * Internal nodes may leave out the entry starts of their children, which requires compact nodes.
+         * Readers compute them from the maximum number of children instead.
+         */
+        static const uint64_t FLAG_IMPLICIT_ENTRY_STARTS = 1 << 3;
+
+        /**
+         * Flags for features that a reader must support to read the file.
+         * A reader must reject files with flags it does not know.
+         */
+        static const uint64_t SUPPORTED_FLAGS = FLAG_COMPACT_NODES | FLAG_PREFIX_COMPRESSION | FLAG_LZ4_COMPRESSION | FLAG_IMPLICIT_ENTRY_STARTS;
+
+        // Feature flags.
+        uint64_t flags = 0;
+
+        // Bloom filter handle, with a size of zero if the file has no filter.
+        uint64_t filter_offset = 0;
+        uint64_t filter_size = 0;
+
+        // The maximum number of children of a node, or zero if the file does not store it.
+        // Every node except the last one of each level has this many children.
+        uint64_t max_node_children = 0;
+
+        static uint64_t write(char *address, const FooterExtension &extension)
+        {
+            ZonePbtStructures;
+
+            address += Format::write_uint64(address, extension.flags);
+            address += Format::write_uint64(address, extension.filter_offset);
+            address += Format::write_uint64(address, extension.filter_size);
+            address += Format::write_uint64(address, extension.max_node_children);
+            address += Format::write_uint64(address, FooterExtension::size_of());
+
+            return FooterExtension::size_of();
+        }
+
+        /**
+         * Read the extension that ends at the given address.
+         */
+        static uint64_t read(char *end_address, FooterExtension &extension)
+        {
+            ZonePbtStructures;
+
+            uint64_t size;
+            Format::read_uint64(end_address - sizeof(uint64_t), size);
+
+            char *address = end_address - size;
+            uint64_t num_fields = size / sizeof(uint64_t) - 1;
+            uint64_t *fields[] = {&extension.flags, &extension.filter_offset, &extension.filter_size, &extension.max_node_children};
+            for (uint64_t i = 0; i < sizeof(fields) / sizeof(fields[0]) && i < num_fields; i++)
+            {
+                address += Format::read_uint64(address, *fields[i]);
+            }
+
+            return size;
+        }
+
+        static constexpr uint64_t size_of()
+        {
+            return 5 * sizeof(uint64_t);
+        }
+
+        void validate() const
+        {
+            ZonePbtStructures;
+
+            if ((this->flags & ~SUPPORTED_FLAGS) != 0)
+            {
+                throw std::runtime_error("Unsupported feature flags");
+            }
+            if ((this->flags & FLAG_IMPLICIT_ENTRY_STARTS) != 0 && this->max_node_children == 0)
+            {
+                throw std::runtime_error("Missing maximum number of node children");
+            }
+        }
+    };
+
     /**
      * Write-only structure for leaf nodes.
      */
@@ -113,22 +234,54 @@ namespace ninedb::pbt::detail
         std::vector<uint64_t> data_offsets;
         std::vector<uint64_t> key_sizes;
         std::vector<uint64_t> value_sizes;
+        std::vector<uint64_t> shared_sizes;
         std::string data;
 
-        NodeLeafBuilder() : num_children(0) {}
+        /**
+         * The number of entries between restart points of prefix compression, or 0 to not use prefix compression.
+         */
+        uint64_t restart_interval;
+
+        NodeLeafBuilder(uint64_t restart_interval = 0) : num_children(0), restart_interval(restart_interval) {}
 
         void add_key_value(const std::string_view &key, const std::string_view &value)
         {
             ZonePbtStructures;
 
+            uint64_t shared_size = 0;
+            if (num_children > 0)
+            {
+                std::string_view previous_key = get_key(num_children - 1);
+                uint64_t max_shared_size = std::min(previous_key.size(), key.size());
+                while (shared_size < max_shared_size && previous_key[shared_size] == key[shared_size])
+                {
+                    shared_size++;
+                }
+            }
+
             num_children++;
             data_offsets.push_back(data.size());
             key_sizes.push_back(key.size());
             value_sizes.push_back(value.size());
+            shared_sizes.push_back(shared_size);
             data.append(key);
             data.append(value);
         }
 
+        std::string_view get_key(uint16_t index) const
+        {
+            ZonePbtStructures;
+
+            return std::string_view(data.data() + data_offsets[index], key_sizes[index]);
+        }
+
+        std::string_view get_value(uint16_t index) const
+        {
+            ZonePbtStructures;
+
+            return std::string_view(data.data() + data_offsets[index] + key_sizes[index], value_sizes[index]);
+        }
+
         void clear()
         {
             ZonePbtStructures;
@@ -137,63 +290,189 @@ namespace ninedb::pbt::detail
             data_offsets.clear();
             key_sizes.clear();
             value_sizes.clear();
+            shared_sizes.clear();
             data.clear();
         }
 
-        uint64_t size_of() const
+        uint64_t size_of(bool compact) const
         {
             ZonePbtStructures;
 
+            if (compact)
+            {
+                bool prefix = use_prefix_compression();
+                return header_size_of(get_compact_width(prefix), prefix) + get_data_size(prefix);
+            }
+
             uint64_t size = sizeof(uint16_t);
             size += 3 * sizeof(uint64_t) * this->num_children;
             size += this->data.size();
 
             return size;
         }
+
+        /**
+         * Get the size of the header of the node in the compact layout, with the given width of the fields.
+         */
+        uint64_t header_size_of(uint8_t width, bool prefix) const
+        {
+            ZonePbtStructures;
+
+            if (prefix)
+            {
+                return sizeof(uint16_t) + sizeof(uint8_t) + sizeof(uint16_t) + 4 * width * this->num_children;
+            }
+            return sizeof(uint16_t) + sizeof(uint8_t) + 3 * width * this->num_children;
+        }
+
+        /**
+         * Get the smallest width of the fields in the compact layout that can hold every offset and size in the node.
+         */
+        uint8_t get_compact_width(bool prefix) const
+        {
+            ZonePbtStructures;
+
+            uint8_t width = 1;
+            while (Format::width_of(header_size_of(width, prefix) + get_data_size(prefix)) > width)
+            {
+                width *= 2;
+            }
+            return width;
+        }
+
+        /**
+         * Check if entry i is a restart point, whose key is stored in full.
+         * The last entry is always a restart point, so the first and last key of a node can be read directly.
+         */
+        bool is_restart(uint16_t i) const
+        {
+            ZonePbtStructures;
+
+            return i % restart_interval == 0 || i == num_children - 1;
+        }
+
+        /**
+         * Get the size of the prefix that the key of entry i shares with the key of the previous entry, as stored with prefix compression.
+         */
+        uint64_t get_shared_size(uint16_t i) const
+        {
+            ZonePbtStructures;
+
+            return is_restart(i) ? 0 : shared_sizes[i];
+        }
+
+        /**
+         * Check if prefix compression is enabled and makes the node smaller in the compact layout.
+         */
+        bool use_prefix_compression() const
+        {
+            ZonePbtStructures;
+
+            if (restart_interval == 0)
+            {
+                return false;
+            }
+            return header_size_of(get_compact_width(true), true) + get_data_size(true) < header_size_of(get_compact_width(false), false) + get_data_size(false);
+        }
+
+    private:
+        uint64_t get_data_size(bool prefix) const
+        {
+            if (!prefix)
+            {
+                return this->data.size();
+            }
+
+            uint64_t size = this->data.size();
+            for (uint16_t i = 0; i < this->num_children; i++)
+            {
+                size -= get_shared_size(i);
+            }
+            return size;
+        }
     };
 
     /**
      * Read-only structure for leaf nodes.
+     * In the compact layout of version 0.3, the offsets and sizes in the header have the smallest width that fits the node,
+     * which is stored after the number of children.
+     * With prefix compression, keys only store the part that differs from the previous key, except at restart points.
+     * Keys of entries that are not restart points are reconstructed by scanning forward from the previous restart point.
      */
     struct NodeLeaf
     {
-        static uint64_t write(char *address, const NodeLeafBuilder &node)
+        /**
+         * Flag in the width byte of compact leaf nodes that indicates that the node uses prefix compression.
+         */
+        static const uint8_t FLAG_PREFIX_COMPRESSION = 0x80;
+
+        static const uint8_t WIDTH_MASK = 0x0F;
+
+        /**
+         * The number of entries below which lower_bound() scans instead of binary searching.
+         */
+        static const uint16_t LINEAR_SEARCH_SIZE = 8;
+
+        static uint64_t write(char *address, const NodeLeafBuilder &node, bool compact)
         {
             ZonePbtStructures;
 
+            if (compact && node.use_prefix_compression())
+            {
+                return write_prefix_compressed(address, node);
+            }
+
             char *base = address;
-            uint64_t header_size = sizeof(uint16_t) + 3 * sizeof(uint64_t) * node.num_children;
+            uint8_t width = compact ? node.get_compact_width(false) : sizeof(uint64_t);
+            uint64_t header_size = compact ? node.header_size_of(width, false) : sizeof(uint16_t) + 3 * sizeof(uint64_t) * node.num_children;
 
             address += Format::write_uint16(address, node.num_children);
+            if (compact)
+            {
+                address += Format::write_uint8(address, width);
+            }
             for (uint16_t i = 0; i < node.num_children; i++)
             {
-                address += Format::write_uint64(address, node.data_offsets[i] + header_size);
-                address += Format::write_uint64(address, node.key_sizes[i]);
-                address += Format::write_uint64(address, node.value_sizes[i]);
+                address += Format::write_uint(address, width, node.data_offsets[i] + header_size);
+                address += Format::write_uint(address, width, node.key_sizes[i]);
+                address += Format::write_uint(address, width, node.value_sizes[i]);
             }
             address += Format::write_string_data_only(address, node.data);
 
             return address - base;
         }
 
-        static uint64_t size_of(char *address)
+        static uint64_t size_of(char *address, bool compact)
         {
             ZonePbtStructures;
 
             uint16_t num_children;
             Format::read_uint16(address, num_children);
 
-            address += sizeof(uint16_t) + 3 * sizeof(uint64_t) * (num_children - 1);
             uint64_t data_offset;
             uint64_t key_size;
             uint64_t value_size;
-            address += Format::read_uint64(address, data_offset);
-            address += Format::read_uint64(address, key_size);
-            address += Format::read_uint64(address, value_size);
+            read_entry(address, num_children - 1, compact, data_offset, key_size, value_size);
 
             return data_offset + key_size + value_size;
         }
 
+        /**
+         * Get the size of the header of the node, which is all that size_of() reads.
+         * Only reads the first few bytes of the node.
+         */
+        static uint64_t header_size_of(char *address, bool compact)
+        {
+            ZonePbtStructures;
+
+            uint16_t num_children;
+            Format::read_uint16(address, num_children);
+
+            uint8_t width;
+            uint8_t prefix;
+            return get_entry_address(address, num_children, compact, width, prefix) - address;
+        }
+
         static uint16_t read_num_children(char *address)
         {
             ZonePbtStructures;
@@ -203,34 +482,387 @@ namespace ninedb::pbt::detail
             return num_children;
         }
 
-        static std::string_view read_key(char *address, uint16_t i)
+        /**
+         * Read the key of entry i.
+         * With prefix compression, only the keys of restart points can be read, which includes the first and last key.
+         */
+        static std::string_view read_key(char *address, uint16_t i, bool compact)
         {
             ZonePbtStructures;
 
-            char *base = address;
-            address += sizeof(uint16_t) + 3 * sizeof(uint64_t) * i;
+            uint8_t width;
+            uint8_t prefix;
+            char *entry_address = get_entry_address(address, i, compact, width, prefix);
             uint64_t data_offset;
             uint64_t key_size;
-            address += Format::read_uint64(address, data_offset);
-            address += Format::read_uint64(address, key_size);
+            Format::read_uint(entry_address, width, data_offset);
+            Format::read_uint(entry_address + (1 + prefix) * width, width, key_size);
 
-            return std::string_view((char *)base + data_offset, key_size);
+            return std::string_view(address + data_offset, key_size);
         }
 
-        static std::string_view read_value(char *address, uint16_t i)
+        /**
+         * Read the key of entry i.
+         * With prefix compression, the key is reconstructed in the given buffer, and the view points into the buffer.
+         */
+        static std::string_view read_key(char *address, uint16_t i, bool compact, std::string &buffer)
+        {
+            ZonePbtStructures;
+
+            if (!is_prefix_compressed(address, compact))
+            {
+                return read_key(address, i, compact);
+            }
+
+            buffer.clear();
+            for (uint16_t j = i - i % read_restart_interval(address); j <= i; j++)
+            {
+                append_key(address, j, buffer);
+            }
+            return buffer;
+        }
+
+        /**
+         * Read the key of entry i, given that the buffer holds the key of entry i - 1 if the node uses prefix compression.
+         * This lets iterators reconstruct each key in constant time.
+         */
+        static std::string_view read_next_key(char *address, uint16_t i, bool compact, std::string &buffer)
+        {
+            ZonePbtStructures;
+
+            if (!is_prefix_compressed(address, compact))
+            {
+                return read_key(address, i, compact);
+            }
+
+            append_key(address, i, buffer);
+            return buffer;
+        }
+
+        static std::string_view read_value(char *address, uint16_t i, bool compact)
         {
             ZonePbtStructures;
 
-            char *base = address;
-            address += sizeof(uint16_t) + 3 * sizeof(uint64_t) * i;
             uint64_t data_offset;
             uint64_t key_size;
             uint64_t value_size;
-            address += Format::read_uint64(address, data_offset);
-            address += Format::read_uint64(address, key_size);
-            address += Format::read_uint64(address, value_size);
+            read_entry(address, i, compact, data_offset, key_size, value_size);
 
-            return std::string_view((char *)base + data_offset + key_size, value_size);
+            return std::string_view(address + data_offset + key_size, value_size);
+        }
+
+        /**
+         * Check if the node uses prefix compression.
+         */
+        static bool is_prefix_compressed(char *address, bool compact)
+        {
+            ZonePbtStructures;
+
+            if (!compact)
+            {
+                return false;
+            }
+            uint8_t flags;
+            Format::read_uint8(address + sizeof(uint16_t), flags);
+            return (flags & FLAG_PREFIX_COMPRESSION) != 0;
+        }
+
+        /**
+         * Find the first entry with a key greater than or equal to the given key, which is the first occurrence of duplicate keys.
+         * Returns the number of children if there is no such entry.
+         * The entries are binary searched, and with prefix compression the restart points are binary searched before scanning the entries between them.
+         */
+        static uint16_t lower_bound(char *address, std::string_view key, bool compact, bool &is_equal)
+        {
+            ZonePbtStructures;
+
+            uint16_t num_children = read_num_children(address);
+
+            if (!is_prefix_compressed(address, compact))
+            {
+                // Narrow the range down with a binary search, then scan the few remaining entries, which is faster than searching them
+                uint16_t lo = 0;
+                uint16_t hi = num_children;
+                while (hi - lo > LINEAR_SEARCH_SIZE)
+                {
+                    uint16_t mid = lo + (hi - lo) / 2;
+                    if (read_key(address, mid, compact).compare(key) < 0)
+                    {
+                        lo = mid + 1;
+                    }
+                    else
+                    {
+                        hi = mid;
+                    }
+                }
+                while (lo < hi && read_key(address, lo, compact).compare(key) < 0)
+                {
+                    lo++;
+                }
+
+                is_equal = lo < num_children && read_key(address, lo, compact) == key;
+                return lo;
+            }
+
+            uint16_t restart_interval = read_restart_interval(address);
+
+            // Find the first restart point with a key greater than or equal to the given key
+            uint64_t num_restarts = div_ceil(num_children, restart_interval);
+            uint64_t lo = 0;
+            uint64_t hi = num_restarts;
+            while (lo < hi)
+            {
+                uint64_t mid = lo + (hi - lo) / 2;
+                if (read_key(address, mid * restart_interval, compact).compare(key) < 0)
+                {
+                    lo = mid + 1;
+                }
+                else
+                {
+                    hi = mid;
+                }
+            }
+
+            // The entry lies after the previous restart point, and at the latest at the found one
+            uint16_t start = lo == 0 ? 0 : (lo - 1) * restart_interval;
+            uint16_t end = lo < num_restarts ? lo * restart_interval + 1 : num_children;
+
+            // Compare without reconstructing keys, by tracking the size of the prefix that the previous key shares with the given key.
+            // While the previous key is smaller, a key that shares more with it is smaller too, and a key that shares less is greater.
+            uint64_t matched_size = 0;
+            for (uint16_t i = start; i < end; i++)
+            {
+                uint64_t shared_size;
+                std::string_view suffix = read_key_suffix(address, i, shared_size);
+                if (i % restart_interval == 0 || i == num_children - 1)
+                {
+                    matched_size = 0;
+                }
+                if (shared_size > matched_size)
+                {
+                    continue;
+                }
+                if (shared_size < matched_size)
+                {
+                    is_equal = false;
+                    return i;
+                }
+
+                std::string_view remainder = key.substr(matched_size);
+                uint64_t size = std::min(suffix.size(), remainder.size());
+                uint64_t j = 0;
+                while (j < size && suffix[j] == remainder[j])
+                {
+                    j++;
+                }
+                if (j == size ? suffix.size() >= remainder.size() : static_cast<uint8_t>(suffix[j]) > static_cast<uint8_t>(remainder[j]))
+                {
+                    is_equal = suffix.size() == remainder.size() && j == size;
+                    return i;
+                }
+                matched_size += j;
+            }
+
+            is_equal = false;
+            return num_children;
+        }
+
+    private:
+        static uint64_t write_prefix_compressed(char *address, const NodeLeafBuilder &node)
+        {
+            char *base = address;
+            uint8_t width = node.get_compact_width(true);
+            uint64_t data_offset = node.header_size_of(width, true);
+
+            address += Format::write_uint16(address, node.num_children);
+            address += Format::write_uint8(address, width | FLAG_PREFIX_COMPRESSION);
+            address += Format::write_uint16(address, node.restart_interval);
+            for (uint16_t i = 0; i < node.num_children; i++)
+            {
+                uint64_t shared_size = node.get_shared_size(i);
+                address += Format::write_uint(address, width, data_offset);
+                address += Format::write_uint(address, width, shared_size);
+                address += Format::write_uint(address, width, node.key_sizes[i] - shared_size);
+                address += Format::write_uint(address, width, node.value_sizes[i]);
+                data_offset += node.key_sizes[i] - shared_size + node.value_sizes[i];
+            }
+            for (uint16_t i = 0; i < node.num_children; i++)
+            {
+                uint64_t shared_size = node.get_shared_size(i);
+                std::string_view data(node.data.data() + node.data_offsets[i] + shared_size, node.key_sizes[i] - shared_size + node.value_sizes[i]);
+                address += Format::write_string_data_only(address, data);
+            }
+
+            return address - base;
+        }
+
+        /**
+         * Get the address of the header entry of entry i, the width of its fields, and whether the node uses prefix compression.
+         * With prefix compression, the header entry has a field for the size of the shared prefix after the data offset.
+         */
+        static char *get_entry_address(char *address, uint16_t i, bool compact, uint8_t &width, uint8_t &prefix)
+        {
+            if (compact)
+            {
+                uint8_t flags;
+                Format::read_uint8(address + sizeof(uint16_t), flags);
+                width = flags & WIDTH_MASK;
+                prefix = flags >> 7;
+                return address + sizeof(uint16_t) + sizeof(uint8_t) + prefix * sizeof(uint16_t) + (3 + prefix) * width * i;
+            }
+
+            width = sizeof(uint64_t);
+            prefix = 0;
+            return address + sizeof(uint16_t) + 3 * sizeof(uint64_t) * i;
+        }
+
+        /**
+         * Read the data offset, the size of the stored part of the key, and the size of the value of entry i.
+         */
+        static void read_entry(char *address, uint16_t i, bool compact, uint64_t &data_offset, uint64_t &key_size, uint64_t &value_size)
+        {
+            uint8_t width;
+            uint8_t prefix;
+            address = get_entry_address(address, i, compact, width, prefix);
+            Format::read_uint(address, width, data_offset);
+            Format::read_uint(address + (1 + prefix) * width, width, key_size);
+            Format::read_uint(address + (2 + prefix) * width, width, value_size);
+        }
+
+        static uint16_t read_restart_interval(char *address)
+        {
+            uint16_t restart_interval;
+            Format::read_uint16(address + sizeof(uint16_t) + sizeof(uint8_t), restart_interval);
+            return restart_interval;
+        }
+
+        /**
+         * Read the stored part of the key of entry i of a node with prefix compression, and the size of the prefix it shares with the key of the previous entry.
+         */
+        static std::string_view read_key_suffix(char *address, uint16_t i, uint64_t &shared_size)
+        {
+            uint8_t width;
+            uint8_t prefix;
+            char *entry_address = get_entry_address(address, i, true, width, prefix);
+            uint64_t data_offset;
+            uint64_t key_size;
+            Format::read_uint(entry_address, width, data_offset);
+            Format::read_uint(entry_address + width, width, shared_size);
+            Format::read_uint(entry_address + 2 * width, width, key_size);
+
+            return std::string_view(address + data_offset, key_size);
+        }
+
+        /**
+         * Turn the key of entry i - 1 in the given buffer into the key of entry i of a node with prefix compression.
+         * At restart points, no prefix is shared, so the buffer may hold anything.
+         */
+        static void append_key(char *address, uint16_t i, std::string &buffer)
+        {
+            uint64_t shared_size;
+            std::string_view suffix = read_key_suffix(address, i, shared_size);
+            buffer.resize(shared_size);
+            buffer.append(suffix);
+        }
+    };
+
+    /**
+     * Frame around a leaf node in files with LZ4 compression.
+     * A frame either holds the node as is, or LZ4 compressed if that saves enough space to be worth decompressing it.
+     */
+    struct NodeLeafFrame
+    {
+        static const uint8_t TYPE_UNCOMPRESSED = 0;
+        static const uint8_t TYPE_LZ4 = 1;
+
+        /**
+         * The size of the frame header of an uncompressed node, after which the node follows.
+         */
+        static constexpr uint64_t UNCOMPRESSED_HEADER_SIZE = sizeof(uint8_t);
+
+        /**
+         * The size of the frame header of a compressed node: the type, the compressed size and the size of the node.
+         */
+        static constexpr uint64_t COMPRESSED_HEADER_SIZE = sizeof(uint8_t) + 2 * sizeof(uint32_t);
+
+        /**
+         * Get the maximum size of the frame of a node with the given size.
+         */
+        static uint64_t max_size_of(uint64_t node_size)
+        {
+            ZonePbtStructures;
+
+            return std::max(UNCOMPRESSED_HEADER_SIZE + node_size, COMPRESSED_HEADER_SIZE + Format::lz4_compress_bound(node_size));
+        }
+
+        /**
+         * Write the frame of the given node, which must have room for max_size_of() bytes.
+         * The node is only stored compressed if that makes it at least 1/8 smaller,
+         * as smaller savings do not make up for the cost of decompressing the node on reads.
+         */
+        static uint64_t write(char *address, std::string_view node)
+        {
+            ZonePbtStructures;
+
+            uint64_t capacity = Format::lz4_compress_bound(node.size());
+            if (capacity > 0 && node.size() <= UINT32_MAX)
+            {
+                uint64_t compressed_size = Format::write_lz4(address + COMPRESSED_HEADER_SIZE, node, capacity);
+                if (compressed_size > 0 && compressed_size < node.size() - node.size() / 8)
+                {
+                    address += Format::write_uint8(address, TYPE_LZ4);
+                    address += Format::write_uint32(address, compressed_size);
+                    address += Format::write_uint32(address, node.size());
+                    return COMPRESSED_HEADER_SIZE + compressed_size;
+                }
+            }
+
+            address += Format::write_uint8(address, TYPE_UNCOMPRESSED);
+            address += Format::write_string_data_only(address, node);
+            return UNCOMPRESSED_HEADER_SIZE + node.size();
+        }
+
+        static bool is_compressed(char *address)
+        {
+            ZonePbtStructures;
+
+            uint8_t type;
+            Format::read_uint8(address, type);
+            if (type > TYPE_LZ4)
+            {
+                throw std::runtime_error("Invalid node frame type");
+            }
+            return type == TYPE_LZ4;
+        }
+
+        /**
+         * Get the size of the given compressed frame.
+         */
+        static uint64_t compressed_size_of(char *address)
+        {
+            ZonePbtStructures;
+
+            uint32_t compressed_size;
+            Format::read_uint32(address + sizeof(uint8_t), compressed_size);
+            return COMPRESSED_HEADER_SIZE + compressed_size;
+        }
+
+        /**
+         * Decompress the node in the given compressed frame into the given data, followed by padding for the header reads.
+         * Returns the size of the frame.
+         */
+        static uint64_t decompress(char *address, std::string &data)
+        {
+            ZonePbtStructures;
+
+            uint32_t compressed_size;
+            uint32_t size;
+            Format::read_uint32(address + sizeof(uint8_t), compressed_size);
+            Format::read_uint32(address + sizeof(uint8_t) + sizeof(uint32_t), size);
+
+            data.resize(size + Format::MAX_OVER_READ);
+            Format::read_lz4(address + COMPRESSED_HEADER_SIZE, compressed_size, data.data(), size);
+            return COMPRESSED_HEADER_SIZE + compressed_size;
         }
     };
 
@@ -248,6 +880,9 @@ namespace ninedb::pbt::detail
         std::vector<uint64_t> child_sizes;
         std::string data;
 
+        // Whether the compact layout leaves out the entry starts of the children, which requires a packed tree.
+        bool implicit_entry_starts = true;
+
         NodeInternalBuilder() : num_children(0) {}
 
         void add_first_child(const std::string_view &left_key, const std::string_view &right_key, const std::string_view &reduced_value, uint64_t child_entry_start, uint64_t child_offset, uint64_t child_size)
@@ -289,10 +924,16 @@ namespace ninedb::pbt::detail
             data.clear();
         }
 
-        uint64_t size_of() const
+        uint64_t size_of(bool compact) const
         {
             ZonePbtStructures;
 
+            if (compact)
+            {
+                uint8_t child_width = get_compact_child_width();
+                return header_size_of(get_compact_data_width(child_width), child_width) + this->data.size();
+            }
+
             uint64_t size = sizeof(uint16_t);
             size += 2 * sizeof(uint64_t);
             size += 6 * sizeof(uint64_t) * this->num_children;
@@ -300,32 +941,93 @@ namespace ninedb::pbt::detail
 
             return size;
         }
+
+        /**
+         * Get the size of the header of the node in the compact layout, with the given widths of the fields.
+         */
+        uint64_t header_size_of(uint8_t data_width, uint8_t child_width) const
+        {
+            ZonePbtStructures;
+
+            uint64_t num_child_fields = this->implicit_entry_starts ? 2 : 3;
+            return sizeof(uint16_t) + 2 * sizeof(uint8_t) + 2 * data_width + (3 * data_width + num_child_fields * child_width) * this->num_children;
+        }
+
+        /**
+         * Get the smallest width of the child fields in the compact layout that can hold every child offset and size, and entry start if they are stored.
+         */
+        uint8_t get_compact_child_width() const
+        {
+            ZonePbtStructures;
+
+            uint64_t max_value = 0;
+            for (uint16_t i = 0; i < this->num_children; i++)
+            {
+                max_value = std::max({max_value, this->child_offsets[i], this->child_sizes[i]});
+                if (!this->implicit_entry_starts)
+                {
+                    max_value = std::max(max_value, this->child_entry_starts[i]);
+                }
+            }
+            return Format::width_of(max_value);
+        }
+
+        /**
+         * Get the smallest width of the data fields in the compact layout that can hold every offset and size of the keys and reduced values.
+         */
+        uint8_t get_compact_data_width(uint8_t child_width) const
+        {
+            ZonePbtStructures;
+
+            uint8_t width = 1;
+            while (Format::width_of(header_size_of(width, child_width) + this->data.size()) > width)
+            {
+                width *= 2;
+            }
+            return width;
+        }
     };
 
     /**
      * Read-only structure for internal nodes.
+     * In the compact layout of version 0.3, the fields describing the keys and reduced values, and the fields describing the child nodes,
+     * each have the smallest width that fits the node, which are stored after the number of children.
+     * Compact nodes with implicit entry starts flag this in the width of the child fields, and leave out the entry starts of their children.
      */
     struct NodeInternal
     {
-        static uint64_t write(char *address, const NodeInternalBuilder &node)
+        static const uint8_t FLAG_IMPLICIT_ENTRY_STARTS = 0x80;
+        static const uint8_t WIDTH_MASK = 0x0F;
+
+        static uint64_t write(char *address, const NodeInternalBuilder &node, bool compact)
         {
             ZonePbtStructures;
 
             char *base = address;
-            uint64_t header_size = sizeof(uint16_t) + 2 * sizeof(uint64_t) + 6 * sizeof(uint64_t) * node.num_children;
+            uint8_t child_width = compact ? node.get_compact_child_width() : sizeof(uint64_t);
+            uint8_t data_width = compact ? node.get_compact_data_width(child_width) : sizeof(uint64_t);
+            uint64_t header_size = compact ? node.header_size_of(data_width, child_width) : sizeof(uint16_t) + 2 * sizeof(uint64_t) + 6 * sizeof(uint64_t) * node.num_children;
 
             address += Format::write_uint16(address, node.num_children);
+            if (compact)
+            {
+                address += Format::write_uint8(address, data_width);
+                address += Format::write_uint8(address, node.implicit_entry_starts ? child_width | FLAG_IMPLICIT_ENTRY_STARTS : child_width);
+            }
 
-            address += Format::write_uint64(address, node.data_offsets[0] + header_size);
-            address += Format::write_uint64(address, node.key_sizes[0]);
+            address += Format::write_uint(address, data_width, node.data_offsets[0] + header_size);
+            address += Format::write_uint(address, data_width, node.key_sizes[0]);
             for (uint16_t i = 0; i < node.num_children; i++)
             {
-                address += Format::write_uint64(address, node.data_offsets[i + 1] + header_size);
-                address += Format::write_uint64(address, node.key_sizes[i + 1]);
-                address += Format::write_uint64(address, node.reduced_value_sizes[i]);
-                address += Format::write_uint64(address, node.child_entry_starts[i]);
-                address += Format::write_uint64(address, node.child_offsets[i]);
-                address += Format::write_uint64(address, node.child_sizes[i]);
+                address += Format::write_uint(address, data_width, node.data_offsets[i + 1] + header_size);
+                address += Format::write_uint(address, data_width, node.key_sizes[i + 1]);
+                address += Format::write_uint(address, data_width, node.reduced_value_sizes[i]);
+                if (!compact || !node.implicit_entry_starts)
+                {
+                    address += Format::write_uint(address, child_width, node.child_entry_starts[i]);
+                }
+                address += Format::write_uint(address, child_width, node.child_offsets[i]);
+                address += Format::write_uint(address, child_width, node.child_sizes[i]);
             }
 
             address += Format::write_string_data_only(address, node.data);
@@ -333,24 +1035,38 @@ namespace ninedb::pbt::detail
             return address - base;
         }
 
-        static uint64_t size_of(char *address)
+        static uint64_t size_of(char *address, bool compact)
         {
             ZonePbtStructures;
 
             uint16_t num_children;
             Format::read_uint16(address, num_children);
 
-            address += sizeof(uint16_t) + 2 * sizeof(uint64_t) + 6 * sizeof(uint64_t) * (num_children - 1);
             uint64_t data_offset;
             uint64_t key_size;
             uint64_t reduced_value_size;
-            address += Format::read_uint64(address, data_offset);
-            address += Format::read_uint64(address, key_size);
-            address += Format::read_uint64(address, reduced_value_size);
+            read_child_data(address, num_children - 1, compact, data_offset, key_size, reduced_value_size);
 
             return data_offset + key_size + reduced_value_size;
         }
 
+        /**
+         * Get the size of the header of the node, which is all that size_of() reads.
+         * Only reads the first few bytes of the node.
+         */
+        static uint64_t header_size_of(char *address, bool compact)
+        {
+            ZonePbtStructures;
+
+            uint16_t num_children;
+            Format::read_uint16(address, num_children);
+
+            uint8_t data_width;
+            uint8_t child_width;
+            uint8_t num_child_fields;
+            return get_child_address(address, num_children, compact, data_width, child_width, num_child_fields) - address;
+        }
+
         static uint16_t read_num_children(char *address)
         {
             ZonePbtStructures;
@@ -360,84 +1076,130 @@ namespace ninedb::pbt::detail
             return num_children;
         }
 
-        static std::string_view read_left_key(char *address)
+        static std::string_view read_left_key(char *address, bool compact)
         {
             ZonePbtStructures;
 
             char *base = address;
+            uint8_t data_width = sizeof(uint64_t);
             address += sizeof(uint16_t);
+            if (compact)
+            {
+                address += Format::read_uint8(address, data_width);
+                address += Format::skip_uint8();
+            }
             uint64_t data_offset;
             uint64_t key_size;
-            address += Format::read_uint64(address, data_offset);
-            address += Format::read_uint64(address, key_size);
+            address += Format::read_uint(address, data_width, data_offset);
+            address += Format::read_uint(address, data_width, key_size);
 
-            return std::string_view((char *)base + data_offset, key_size);
+            return std::string_view(base + data_offset, key_size);
         }
 
-        static std::string_view read_right_key(char *address, uint16_t i)
+        static std::string_view read_right_key(char *address, uint16_t i, bool compact)
         {
             ZonePbtStructures;
 
-            char *base = address;
-            address += sizeof(uint16_t) + 2 * sizeof(uint64_t) + 6 * sizeof(uint64_t) * i;
             uint64_t data_offset;
             uint64_t key_size;
-            address += Format::read_uint64(address, data_offset);
-            address += Format::read_uint64(address, key_size);
+            uint64_t reduced_value_size;
+            read_child_data(address, i, compact, data_offset, key_size, reduced_value_size);
 
-            return std::string_view((char *)base + data_offset, key_size);
+            return std::string_view(address + data_offset, key_size);
         }
 
-        static std::string_view read_reduced_value(char *address, uint16_t i)
+        static std::string_view read_reduced_value(char *address, uint16_t i, bool compact)
         {
             ZonePbtStructures;
 
-            char *base = address;
-            address += sizeof(uint16_t) + 2 * sizeof(uint64_t) + 6 * sizeof(uint64_t) * i;
             uint64_t data_offset;
             uint64_t key_size;
             uint64_t reduced_value_size;
-            address += Format::read_uint64(address, data_offset);
-            address += Format::read_uint64(address, key_size);
-            address += Format::read_uint64(address, reduced_value_size);
+            read_child_data(address, i, compact, data_offset, key_size, reduced_value_size);
 
-            return std::string_view((char *)base + data_offset + key_size, reduced_value_size);
+            return std::string_view(address + data_offset + key_size, reduced_value_size);
         }
 
-        static uint64_t read_child_entry_start(char *address, uint16_t i)
+        /**
+         * Read the index of the first entry of child i.
+         * Only available in nodes without implicit entry starts.
+         */
+        static uint64_t read_child_entry_start(char *address, uint16_t i, bool compact)
         {
             ZonePbtStructures;
 
-            address += sizeof(uint16_t) + 2 * sizeof(uint64_t) + 6 * sizeof(uint64_t) * i;
-            uint64_t child_entry_start;
-            address += Format::skip_uint64(3);
-            address += Format::read_uint64(address, child_entry_start);
+            return read_child_field(address, i, compact, 0);
+        }
 
-            return child_entry_start;
+        static uint64_t read_child_offset(char *address, uint16_t i, bool compact)
+        {
+            ZonePbtStructures;
+
+            return read_child_field(address, i, compact, 1);
         }
 
-        static uint64_t read_child_offset(char *address, uint16_t i)
+        static uint64_t read_child_size(char *address, uint16_t i, bool compact)
         {
             ZonePbtStructures;
 
-            address += sizeof(uint16_t) + 2 * sizeof(uint64_t) + 6 * sizeof(uint64_t) * i;
-            uint64_t child_offset;
-            address += Format::skip_uint64(4);
-            address += Format::read_uint64(address, child_offset);
+            return read_child_field(address, i, compact, 2);
+        }
 
-            return child_offset;
+    private:
+        /**
+         * Get the address of the header entry of child i, the widths of its fields, and the number of child fields per entry.
+         */
+        static char *get_child_address(char *address, uint16_t i, bool compact, uint8_t &data_width, uint8_t &child_width, uint8_t &num_child_fields)
+        {
+            if (compact)
+            {
+                uint8_t flags;
+                Format::read_uint8(address + sizeof(uint16_t), data_width);
+                Format::read_uint8(address + sizeof(uint16_t) + sizeof(uint8_t), flags);
+                child_width = flags & WIDTH_MASK;
+                num_child_fields = (flags & FLAG_IMPLICIT_ENTRY_STARTS) != 0 ? 2 : 3;
+                return address + sizeof(uint16_t) + 2 * sizeof(uint8_t) + 2 * data_width + (3 * data_width + num_child_fields * child_width) * i;
+            }
+
+            data_width = sizeof(uint64_t);
+            child_width = sizeof(uint64_t);
+            num_child_fields = 3;
+            return address + sizeof(uint16_t) + 2 * sizeof(uint64_t) + 6 * sizeof(uint64_t) * i;
         }
 
-        static uint64_t read_child_size(char *address, uint16_t i)
+        static void read_child_data(char *address, uint16_t i, bool compact, uint64_t &data_offset, uint64_t &key_size, uint64_t &reduced_value_size)
         {
-            ZonePbtStructures;
+            uint8_t data_width;
+            uint8_t child_width;
+            uint8_t num_child_fields;
+            address = get_child_address(address, i, compact, data_width, child_width, num_child_fields);
+            address += Format::read_uint(address, data_width, data_offset);
+            address += Format::read_uint(address, data_width, key_size);
+            address += Format::read_uint(address, data_width, reduced_value_size);
+        }
 
-            address += sizeof(uint16_t) + 2 * sizeof(uint64_t) + 6 * sizeof(uint64_t) * i;
-            uint64_t child_size;
-            address += Format::skip_uint64(5);
-            address += Format::read_uint64(address, child_size);
+        /**
+         * Read the child entry start, offset or size of child i, for a field index of 0, 1 or 2 respectively.
+         */
+        static uint64_t read_child_field(char *address, uint16_t i, bool compact, uint64_t field_index)
+        {
+            uint8_t data_width;
+            uint8_t child_width;
+            uint8_t num_child_fields;
+            address = get_child_address(address, i, compact, data_width, child_width, num_child_fields);
+            if (num_child_fields < 3)
+            {
+                if (field_index == 0)
+                {
+                    throw std::runtime_error("Node has implicit entry starts");
+                }
+                field_index--;
+            }
+            address += 3 * data_width + field_index * child_width;
+            uint64_t value;
+            Format::read_uint(address, child_width, value);
 
-            return child_size;
+            return value;
         }
     };
 }
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "../detail/profiling.hpp"
+
+namespace ninedb::pbt
+{
+    /**
+     * Counters for the reads from PBT files that are not mapped into memory.
+     * One instance can be shared by the readers of many files, and updated from multiple threads.
+     */
+    struct IoStats
+    {
+        IoStats() = default;
+
+        IoStats(const IoStats &) = delete;
+        IoStats &operator=(const IoStats &) = delete;
+
+        /**
+         * Count a read of the given number of bytes.
+         */
+        void add_read(uint64_t num_bytes)
+        {
+            ZonePbtStorage;
+
+            num_reads.fetch_add(1, std::memory_order_relaxed);
+            num_bytes_read.fetch_add(num_bytes, std::memory_order_relaxed);
+        }
+
+        /**
+         * Get the number of reads from the files.
+         */
+        uint64_t get_num_reads() const
+        {
+            ZonePbtStorage;
+
+            return num_reads.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * Get the number of bytes read from the files.
+         */
+        uint64_t get_num_bytes_read() const
+        {
+            ZonePbtStorage;
+
+            return num_bytes_read.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<uint64_t> num_reads{0};
+        std::atomic<uint64_t> num_bytes_read{0};
+    };
+}
@@ -1,35 +1,49 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <utility>
 
+#include "./detail/node_loader.hpp"
 #include "./detail/structures.hpp"
 
 namespace ninedb::pbt
 {
     struct Iterator
     {
-        Iterator(char *node_address, uint64_t entry_index, uint64_t remaining_entries)
-            : node_address(node_address), entry_index(entry_index), remaining_entries(remaining_entries)
+        Iterator(std::shared_ptr<const detail::NodeLoader> loader, detail::NodeRef node, uint64_t entry_index, uint64_t remaining_entries)
+            : loader(std::move(loader)), node(std::move(node)), entry_index(entry_index), remaining_entries(remaining_entries)
         {
             ZonePbtIterator;
 
             if (remaining_entries >= 1)
             {
-                current_num_children = detail::NodeLeaf::read_num_children(node_address);
+                compact = this->loader->is_compact();
+                current_num_children = detail::NodeLeaf::read_num_children(this->node.address);
+                prefix_compressed = detail::NodeLeaf::is_prefix_compressed(this->node.address, compact);
+                if (prefix_compressed)
+                {
+                    detail::NodeLeaf::read_key(this->node.address, entry_index, compact, key_buffer);
+                }
             }
         }
 
         /**
          * Get the key at the current position.
+         * With prefix compression, the key is only valid until the iterator moves.
          */
         std::string_view get_key() const
         {
             ZonePbtIterator;
 
-            return detail::NodeLeaf::read_key(node_address, entry_index);
+            if (prefix_compressed)
+            {
+                return key_buffer;
+            }
+            return detail::NodeLeaf::read_key(node.address, entry_index, compact);
         }
 
         /**
@@ -39,7 +53,7 @@ namespace ninedb::pbt
         {
             ZonePbtIterator;
 
-            return detail::NodeLeaf::read_value(node_address, entry_index);
+            return detail::NodeLeaf::read_value(node.address, entry_index, compact);
         }
 
         /**
@@ -56,10 +70,16 @@ namespace ninedb::pbt
                 entry_index = 0;
                 if (remaining_entries >= 1)
                 {
-                    node_address += detail::NodeLeaf::size_of(node_address);
-                    current_num_children = detail::NodeLeaf::read_num_children(node_address);
+                    node = loader->load_next_leaf(node, false);
+                    read_ahead();
+                    current_num_children = detail::NodeLeaf::read_num_children(node.address);
+                    prefix_compressed = detail::NodeLeaf::is_prefix_compressed(node.address, compact);
                 }
             }
+            if (prefix_compressed && remaining_entries >= 1)
+            {
+                detail::NodeLeaf::read_next_key(node.address, entry_index, compact, key_buffer);
+            }
         }
 
         /**
@@ -72,10 +92,85 @@ namespace ninedb::pbt
             return remaining_entries <= 0;
         }
 
+        /**
+         * Check if the iterator is at the first entry of a leaf node.
+         */
+        bool is_at_leaf_start() const
+        {
+            ZonePbtIterator;
+
+            return remaining_entries >= 1 && entry_index == 0;
+        }
+
+        /**
+         * Get the number of entries in the current leaf node.
+         */
+        uint64_t get_leaf_num_entries() const
+        {
+            ZonePbtIterator;
+
+            return current_num_children;
+        }
+
+        /**
+         * Get the last key of the current leaf node.
+         */
+        std::string_view get_leaf_last_key() const
+        {
+            ZonePbtIterator;
+
+            return detail::NodeLeaf::read_key(node.address, current_num_children - 1, compact);
+        }
+
+        /**
+         * Get the current leaf node as it is stored in the file, including its frame in files with LZ4 compression.
+         * If the file is not mapped into memory, the node is read again, and is only valid until the next call.
+         */
+        std::string_view get_stored_leaf()
+        {
+            ZonePbtIterator;
+
+            uint64_t size = node.size != 0 ? node.size : detail::NodeLeaf::size_of(node.address, compact);
+            if (!loader->is_mapped())
+            {
+                loader->read(node.offset, size, stored_leaf_buffer);
+                return stored_leaf_buffer;
+            }
+            return std::string_view(loader->offset_to_address(node.offset), size);
+        }
+
     private:
-        char *node_address;
+        /**
+         * The range of the file that is requested ahead of a scan starts at this size, so short scans do not load much more than they read.
+         * It doubles every time the scan gets halfway through it, up to the maximum size.
+         */
+        static constexpr uint64_t MIN_READ_AHEAD_SIZE = 1 << 16;
+        static constexpr uint64_t MAX_READ_AHEAD_SIZE = 1 << 21;
+
+        std::shared_ptr<const detail::NodeLoader> loader;
+        detail::NodeRef node;
         uint64_t entry_index;
         uint64_t remaining_entries;
         uint64_t current_num_children;
+        bool compact = false;
+        bool prefix_compressed = false;
+        std::string key_buffer;
+        std::string stored_leaf_buffer;
+        uint64_t read_ahead_size = 0;
+        uint64_t read_ahead_end = 0;
+
+        void read_ahead()
+        {
+            ZonePbtIterator;
+
+            if (node.offset + read_ahead_size / 2 < read_ahead_end)
+            {
+                return;
+            }
+            uint64_t start = std::max(read_ahead_end, node.offset);
+            read_ahead_size = std::min(std::max(2 * read_ahead_size, MIN_READ_AHEAD_SIZE), MAX_READ_AHEAD_SIZE);
+            loader->advise(start, read_ahead_size, detail::AccessAdvice::WILLNEED);
+            read_ahead_end = start + read_ahead_size;
+        }
     };
 }
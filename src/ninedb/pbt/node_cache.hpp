@@ -0,0 +1,195 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "../detail/profiling.hpp"
+#include "../detail/sharded_rlru_cache.hpp"
+
+namespace ninedb::pbt
+{
+    namespace detail
+    {
+        /**
+         * A node loaded from a PBT file.
+         * The address points either into the storage of the file, or into data owned by the reference.
+         */
+        struct NodeRef
+        {
+            char *address = nullptr;
+
+            // Position of the node in the file, with a size of zero if it was not needed to load the node.
+            uint64_t offset = 0;
+            uint64_t size = 0;
+
+            // Owner of the node in memory, if the node does not point into the storage.
+            std::shared_ptr<std::string> data;
+        };
+
+        struct NodeCacheKey
+        {
+            uint64_t file_id;
+            uint64_t offset;
+
+            bool operator==(const NodeCacheKey &other) const
+            {
+                return file_id == other.file_id && offset == other.offset;
+            }
+        };
+
+        struct NodeCacheKeyHash
+        {
+            std::size_t operator()(const NodeCacheKey &key) const
+            {
+                return std::hash<uint64_t>()(key.file_id * 0x9e3779b97f4a7c15ULL ^ key.offset);
+            }
+        };
+    }
+
+    /**
+     * Cache of nodes loaded from PBT files, with a capacity in bytes.
+     * One cache can be shared by the readers of many files, as nodes are keyed by file and offset.
+     * Safe to use from multiple threads.
+     * The cache can be split by key into a number of shards, each with its own lock and an equal part of the capacity,
+     * which reduces contention when many threads read at once on many cores.
+     * With a single shard, all threads share one lock, which is cheaper when there is little contention.
+     */
+    struct NodeCache
+    {
+        NodeCache(uint64_t capacity, uint64_t num_shards = 1)
+            : cache(capacity, [](const detail::NodeRef &node)
+                    { return node.data->size(); }, num_shards) {}
+
+        NodeCache(const NodeCache &) = delete;
+        NodeCache &operator=(const NodeCache &) = delete;
+
+        /**
+         * Look up the node at the given offset in the file with the given id.
+         */
+        bool try_get(uint64_t file_id, uint64_t offset, detail::NodeRef &node)
+        {
+            ZoneLruCache;
+
+            bool found = cache.try_get({file_id, offset}, node);
+            if (found)
+            {
+                num_hits.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                num_misses.fetch_add(1, std::memory_order_relaxed);
+            }
+            return found;
+        }
+
+        /**
+         * Look up the node at the given offset in the file with the given id, and pin it in the cache until it is unpinned.
+         */
+        bool try_get_and_pin(uint64_t file_id, uint64_t offset, detail::NodeRef &node)
+        {
+            ZoneLruCache;
+
+            bool found = cache.try_get_and_pin({file_id, offset}, node);
+            if (found)
+            {
+                num_hits.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                num_misses.fetch_add(1, std::memory_order_relaxed);
+            }
+            return found;
+        }
+
+        /**
+         * Release a pin on the node at the given offset in the file with the given id.
+         */
+        void unpin(uint64_t file_id, uint64_t offset)
+        {
+            ZoneLruCache;
+
+            cache.unpin({file_id, offset});
+        }
+
+        /**
+         * Add a node that owns its data to the cache.
+         */
+        void put(uint64_t file_id, uint64_t offset, const detail::NodeRef &node)
+        {
+            ZoneLruCache;
+
+            cache.put({file_id, offset}, node);
+        }
+
+        /**
+         * Add a node that owns its data to the cache, and pin it in the cache until it is unpinned.
+         * Returns false if the node was evicted by another thread before it could be pinned.
+         */
+        bool put_and_pin(uint64_t file_id, uint64_t offset, const detail::NodeRef &node)
+        {
+            ZoneLruCache;
+
+            cache.put({file_id, offset}, node);
+            detail::NodeRef cached_node;
+            return cache.try_get_and_pin({file_id, offset}, cached_node);
+        }
+
+        /**
+         * Get the number of lookups that found a node in the cache.
+         */
+        uint64_t get_num_hits() const
+        {
+            ZoneLruCache;
+
+            return num_hits.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * Get the number of lookups that did not find a node in the cache.
+         */
+        uint64_t get_num_misses() const
+        {
+            ZoneLruCache;
+
+            return num_misses.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * Get the number of bytes of the nodes in the cache.
+         */
+        uint64_t get_size() const
+        {
+            ZoneLruCache;
+
+            return cache.get_size();
+        }
+
+        /**
+         * Get the maximum number of bytes of the nodes in the cache.
+         */
+        uint64_t get_capacity() const
+        {
+            ZoneLruCache;
+
+            return cache.get_max_size();
+        }
+
+        /**
+         * Get the number of shards the cache is split into.
+         */
+        uint64_t get_num_shards() const
+        {
+            ZoneLruCache;
+
+            return cache.get_num_shards();
+        }
+
+    private:
+        ninedb::detail::ShardedRLRUCache<detail::NodeCacheKey, detail::NodeRef, detail::NodeCacheKeyHash> cache;
+        std::atomic<uint64_t> num_hits{0};
+        std::atomic<uint64_t> num_misses{0};
+    };
+}
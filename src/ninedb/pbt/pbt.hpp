@@ -1,6 +1,9 @@
 #pragma once
 
 #include "./config.hpp"
+#include "./io_stats.hpp"
 #include "./iterator.hpp"
+#include "./node_cache.hpp"
+#include "./pinned_view.hpp"
 #include "./reader.hpp"
 #include "./writer.hpp"
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "../detail/profiling.hpp"
+
+namespace ninedb::pbt
+{
+    /**
+     * A key or value read from a db, which keeps the memory it points into alive for as long as the view exists.
+     * This is the node it was read from, which stays pinned in the node cache if it came from there, the file mapped into memory,
+     * or the buffer it was read from. Keys that had to be rebuilt from a prefix compressed node are owned by the view.
+     * Copies of a view share the pin.
+     */
+    struct PinnedView
+    {
+        PinnedView() = default;
+
+        PinnedView(std::string_view view, std::shared_ptr<const void> pin)
+            : view(view), pin(std::move(pin)) {}
+
+        /**
+         * Take ownership of the given string.
+         */
+        explicit PinnedView(std::string &&data)
+        {
+            ZonePbtReader;
+
+            auto owned = std::make_shared<std::string>(std::move(data));
+            view = *owned;
+            pin = std::move(owned);
+        }
+
+        std::string_view get() const
+        {
+            ZonePbtReader;
+
+            return view;
+        }
+
+        operator std::string_view() const
+        {
+            ZonePbtReader;
+
+            return view;
+        }
+
+        bool operator==(std::string_view other) const
+        {
+            ZonePbtReader;
+
+            return view == other;
+        }
+
+        bool operator!=(std::string_view other) const
+        {
+            ZonePbtReader;
+
+            return view != other;
+        }
+
+    private:
+        std::string_view view;
+        std::shared_ptr<const void> pin;
+    };
+}
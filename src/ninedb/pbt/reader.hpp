@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <functional>
 #include <fstream>
@@ -10,13 +11,18 @@
 #include <utility>
 #include <vector>
 
-#include "../detail/rlru_cache.hpp"
 #include "../detail/profiling.hpp"
 
+#include "./detail/bloom_filter.hpp"
+#include "./detail/file_storage.hpp"
+#include "./detail/node_loader.hpp"
 #include "./detail/storage.hpp"
 #include "./detail/structures.hpp"
 
+#include "./config.hpp"
 #include "./iterator.hpp"
+#include "./node_cache.hpp"
+#include "./pinned_view.hpp"
 
 namespace ninedb::pbt
 {
@@ -29,12 +35,26 @@ namespace ninedb::pbt
     struct Reader
     {
         Reader(const std::string &path)
-            : Reader(std::make_shared<detail::Storage>(path, true)) {}
+            : Reader(path, ReaderConfig()) {}
+
+        Reader(const std::string &path, const ReaderConfig &config)
+            : Reader(open_storage(path, config), config) {}
 
         Reader(const std::shared_ptr<detail::Storage> &storage)
+            : Reader(storage, ReaderConfig()) {}
+
+        Reader(const std::shared_ptr<detail::Storage> &storage, const ReaderConfig &config)
             : storage(storage)
         {
             read_footer();
+            read_filter();
+            loader = std::make_shared<detail::NodeLoader>(storage, compact, lz4_compression, config.internal_node_cache, config.leaf_node_cache, config.enable_access_advice);
+            loader->advise(0, storage->get_size(), detail::AccessAdvice::RANDOM);
+            if (config.pin_internal_nodes)
+            {
+                pin_internal_nodes();
+            }
+            read_key_range();
         }
 
         uint64_t get_global_start() const
@@ -44,41 +64,71 @@ namespace ninedb::pbt
             return footer.global_start;
         }
 
+        /**
+         * Get the smallest key in the PBT.
+         * Empty if the PBT has no entries.
+         */
+        std::string_view get_min_key() const
+        {
+            ZonePbtReader;
+
+            return min_key;
+        }
+
+        /**
+         * Get the largest key in the PBT.
+         * Empty if the PBT has no entries.
+         */
+        std::string_view get_max_key() const
+        {
+            ZonePbtReader;
+
+            return max_key;
+        }
+
+        /**
+         * Check if the given key lies within the range of keys in the PBT.
+         * If not, the key is certainly not in the PBT.
+         */
+        bool is_in_key_range(std::string_view key) const
+        {
+            ZonePbtReader;
+
+            return footer.tree_height > 0 && key.compare(min_key) >= 0 && key.compare(max_key) <= 0;
+        }
+
         /**
          * Get the value for the given key.
          * Returns true if the key exists, false otherwise.
          * If the key exists, the value is written to the given string.
          * If the key occurs multiple times, the value of the first occurrence is written.
+         * The value keeps the node it points into in memory, so it stays valid for as long as it exists.
          */
-        bool get(std::string_view key, std::string_view &value)
+        bool get(std::string_view key, PinnedView &value)
         {
             ZonePbtReader;
 
-            if (footer.tree_height == 0)
-            {
-                return false;
-            }
-
-            char *node_leaf_address;
+            detail::NodeRef node_leaf;
             uint64_t entry_index;
+            std::shared_ptr<const void> pin;
 
-            if (!find<EXACT>(key, node_leaf_address, entry_index, nullptr))
+            if (!find_key(key, node_leaf, entry_index, &pin))
             {
                 return false;
             }
 
-            value = detail::NodeLeaf::read_value(node_leaf_address, entry_index);
+            value = PinnedView(detail::NodeLeaf::read_value(node_leaf.address, entry_index, compact), std::move(pin));
             return true;
         }
 
         /**
          * Get the value for the given key.
          */
-        std::optional<std::string_view> get(std::string_view key)
+        std::optional<PinnedView> get(std::string_view key)
         {
             ZonePbtReader;
 
-            std::string_view value;
+            PinnedView value;
             if (get(key, value))
             {
                 return value;
@@ -86,12 +136,101 @@ namespace ninedb::pbt
             return std::nullopt;
         }
 
+        /**
+         * Get the values for the given keys, in the same order.
+         * The tree is descended for all keys at once, a level at a time, and the nodes of each level that are not cached are read in one batch.
+         * Without a memory mapping, this keeps many reads in flight instead of waiting for them one at a time.
+         * Each value keeps the node it points into in memory, so it stays valid for as long as it exists.
+         */
+        void get_batch(const std::vector<std::string_view> &keys, std::vector<std::optional<PinnedView>> &values)
+        {
+            ZonePbtReader;
+
+            values.assign(keys.size(), std::nullopt);
+
+            // The keys that are still being looked up, and the offsets of the nodes they are in on the current level
+            std::vector<uint64_t> key_indices;
+            std::vector<uint64_t> key_offsets;
+            for (uint64_t i = 0; i < keys.size(); i++)
+            {
+                if (!is_in_key_range(keys[i]))
+                {
+                    continue;
+                }
+                if (footer_extension.filter_size > 0 && !detail::BloomFilter::may_contain(filter_address, keys[i]))
+                {
+                    continue;
+                }
+                key_indices.push_back(i);
+                key_offsets.push_back(footer.root_offset);
+            }
+
+            std::vector<uint64_t> offsets;
+            std::vector<detail::NodeRef> nodes;
+            auto load_level = [&](bool is_leaf)
+            {
+                // Keys that are close together share nodes, which are only loaded once
+                offsets = key_offsets;
+                std::sort(offsets.begin(), offsets.end());
+                offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+                if (is_leaf)
+                {
+                    loader->load_leaf_batch(offsets, nodes);
+                }
+                else
+                {
+                    loader->load_internal_batch(offsets, nodes);
+                }
+            };
+            auto get_node = [&](uint64_t offset) -> detail::NodeRef &
+            {
+                return nodes[std::lower_bound(offsets.begin(), offsets.end(), offset) - offsets.begin()];
+            };
+
+            for (uint64_t height = footer.tree_height; height >= 2 && !key_indices.empty(); height--)
+            {
+                load_level(false);
+                uint64_t num_remaining = 0;
+                for (uint64_t j = 0; j < key_indices.size(); j++)
+                {
+                    char *node_internal_address = get_node(key_offsets[j]).address;
+                    uint64_t child_index;
+                    if (find_child<EXACT>(keys[key_indices[j]], node_internal_address, child_index))
+                    {
+                        key_indices[num_remaining] = key_indices[j];
+                        key_offsets[num_remaining] = detail::NodeInternal::read_child_offset(node_internal_address, child_index, compact);
+                        num_remaining++;
+                    }
+                }
+                key_indices.resize(num_remaining);
+                key_offsets.resize(num_remaining);
+            }
+            if (key_indices.empty())
+            {
+                return;
+            }
+
+            load_level(true);
+            for (uint64_t j = 0; j < key_indices.size(); j++)
+            {
+                const detail::NodeRef &node_leaf = get_node(key_offsets[j]);
+                bool is_equal;
+                uint16_t i = detail::NodeLeaf::lower_bound(node_leaf.address, keys[key_indices[j]], compact, is_equal);
+                if (is_equal && i < detail::NodeLeaf::read_num_children(node_leaf.address))
+                {
+                    values[key_indices[j]] = PinnedView(detail::NodeLeaf::read_value(node_leaf.address, i, compact), loader->get_owner(node_leaf));
+                }
+            }
+        }
+
         /**
          * Get the key and value at the given index.
          * Returns true if the index is in bounds, false otherwise.
          * If the index is in bounds, the key and value are written to the given strings.
+         * The key and value keep the node they point into in memory, so they stay valid for as long as they exist.
+         * A key that is rebuilt from a prefix compressed node is owned by the key itself.
          */
-        bool at(uint64_t index, std::string_view &key, std::string_view &value)
+        bool at(uint64_t index, PinnedView &key, PinnedView &value)
         {
             ZonePbtReader;
 
@@ -100,16 +239,26 @@ namespace ninedb::pbt
                 return false;
             }
 
-            char *node_leaf_address;
+            detail::NodeRef node_leaf;
             uint64_t entry_index;
+            std::shared_ptr<const void> pin;
 
-            if (!find_index(index, node_leaf_address, entry_index))
+            if (!find_index(index, node_leaf, entry_index, &pin))
             {
                 return false;
             }
 
-            key = detail::NodeLeaf::read_key(node_leaf_address, entry_index);
-            value = detail::NodeLeaf::read_value(node_leaf_address, entry_index);
+            if (detail::NodeLeaf::is_prefix_compressed(node_leaf.address, compact))
+            {
+                std::string key_buffer;
+                detail::NodeLeaf::read_key(node_leaf.address, entry_index, compact, key_buffer);
+                key = PinnedView(std::move(key_buffer));
+            }
+            else
+            {
+                key = PinnedView(detail::NodeLeaf::read_key(node_leaf.address, entry_index, compact), pin);
+            }
+            value = PinnedView(detail::NodeLeaf::read_value(node_leaf.address, entry_index, compact), std::move(pin));
             return true;
         }
 
@@ -117,12 +266,12 @@ namespace ninedb::pbt
          * Get the key and value at the given index.
          * The first element of the pair is the key, the second element is the value.
          */
-        std::optional<std::pair<std::string_view, std::string_view>> at(uint64_t index)
+        std::optional<std::pair<PinnedView, PinnedView>> at(uint64_t index)
         {
             ZonePbtReader;
 
-            std::string_view key;
-            std::string_view value;
+            PinnedView key;
+            PinnedView value;
             if (at(index, key, value))
             {
                 return std::make_pair(key, value);
@@ -145,16 +294,16 @@ namespace ninedb::pbt
                 return end();
             }
 
-            char *node_leaf_address;
+            detail::NodeRef node_leaf;
             uint64_t entry_index;
             uint64_t entry_start = 0;
 
-            if (!find<GREATER_OR_EQUAL>(key, node_leaf_address, entry_index, &entry_start))
+            if (!find<GREATER_OR_EQUAL>(key, node_leaf, entry_index, &entry_start, nullptr))
             {
                 return end();
             }
 
-            return Iterator(node_leaf_address, entry_index, count() - entry_start);
+            return Iterator(loader, node_leaf, entry_index, count() - entry_start);
         }
 
         /**
@@ -225,15 +374,15 @@ namespace ninedb::pbt
                 return end();
             }
 
-            char *node_leaf_address;
+            detail::NodeRef node_leaf;
             uint64_t entry_index;
 
-            if (!find_index(index, node_leaf_address, entry_index))
+            if (!find_index(index, node_leaf, entry_index, nullptr))
             {
                 return end();
             }
 
-            return Iterator(node_leaf_address, entry_index, count() - index);
+            return Iterator(loader, node_leaf, entry_index, count() - index);
         }
 
         /**
@@ -244,7 +393,12 @@ namespace ninedb::pbt
         {
             ZonePbtReader;
 
-            return Iterator(offset_to_address(0), 0, count());
+            if (footer.tree_height == 0)
+            {
+                return end();
+            }
+
+            return Iterator(loader, loader->load_leaf(0, false), 0, count());
         }
 
         /**
@@ -255,18 +409,24 @@ namespace ninedb::pbt
         {
             ZonePbtReader;
 
-            return Iterator(nullptr, 0, 0);
+            return Iterator(nullptr, detail::NodeRef(), 0, 0);
         }
 
         /**
          * Visits all the nodes in the PBT in order.
          * At the leaf nodes, values tested positively against the predicate are added to the accumulator.
          * Internal nodes are also tested against the predicate on their reduced values, and their subtrees are skipped if the predicate returns false.
+         * With LZ4 compression, the accumulated values stay valid until the next traversal on the same thread that starts with an empty accumulator.
          */
         void traverse(const std::function<bool(std::string_view value)> &predicate, std::vector<std::string_view> &accumulator)
         {
             ZonePbtReader;
 
+            // Traversals may accumulate over multiple readers, so nodes are only released once no value points into them
+            if (accumulator.empty())
+            {
+                get_traversed_nodes().clear();
+            }
             if (footer.tree_height == 0)
             {
                 return;
@@ -285,6 +445,72 @@ namespace ninedb::pbt
             return footer.global_end - footer.global_start;
         }
 
+        /**
+         * Get keys that split the PBT into ranges with similar numbers of key-value pairs.
+         * These are the largest keys below the nodes of the highest level under the root that has at least the given number of nodes,
+         * or of the level above the leaf nodes if there is none, so they are read from internal nodes only.
+         * Returns no keys if the PBT has no internal nodes.
+         */
+        std::vector<std::string> sample_keys(uint64_t num_keys)
+        {
+            ZonePbtReader;
+
+            std::vector<std::string> keys;
+            std::vector<uint64_t> offsets{footer.root_offset};
+            for (uint64_t height = footer.tree_height; height >= 2; height--)
+            {
+                keys.clear();
+                std::vector<uint64_t> child_offsets;
+                for (uint64_t offset : offsets)
+                {
+                    detail::NodeRef node_internal = loader->load_internal(offset);
+                    char *node_internal_address = node_internal.address;
+                    uint16_t num_children = detail::NodeInternal::read_num_children(node_internal_address);
+                    for (uint16_t i = 0; i < num_children; i++)
+                    {
+                        keys.emplace_back(detail::NodeInternal::read_right_key(node_internal_address, i, compact));
+                        child_offsets.push_back(detail::NodeInternal::read_child_offset(node_internal_address, i, compact));
+                    }
+                }
+                if (keys.size() >= num_keys || height == 2)
+                {
+                    break;
+                }
+                offsets = std::move(child_offsets);
+            }
+            return keys;
+        }
+
+        /**
+         * Get the footer extension, which holds the feature flags of the file.
+         */
+        const detail::FooterExtension &get_footer_extension() const
+        {
+            ZonePbtReader;
+
+            return footer_extension;
+        }
+
+        /**
+         * Get the number of bytes of internal nodes that are pinned in memory.
+         */
+        uint64_t get_pinned_size() const
+        {
+            ZonePbtReader;
+
+            return loader->get_pinned_size();
+        }
+
+        /**
+         * Remove the PBT file once the last reference to its storage is gone.
+         */
+        void remove_on_close()
+        {
+            ZonePbtReader;
+
+            storage->remove_on_close();
+        }
+
         /**
          * Read only the footer of a PBT file.
          */
@@ -311,7 +537,29 @@ namespace ninedb::pbt
 
     private:
         detail::Footer footer;
+        detail::FooterExtension footer_extension;
+        bool compact = false;
+        bool lz4_compression = false;
+        // The maximum number of entries below a child of the root node, or zero if the file does not store the maximum number of children.
+        uint64_t root_child_entry_count = 0;
         std::shared_ptr<detail::Storage> storage;
+        std::shared_ptr<detail::NodeLoader> loader;
+        std::string min_key;
+        std::string max_key;
+        // The Bloom filter, which is read into filter_data if the storage is not mapped into memory.
+        char *filter_address = nullptr;
+        std::string filter_data;
+
+        static std::shared_ptr<detail::Storage> open_storage(const std::string &path, const ReaderConfig &config)
+        {
+            ZonePbtReader;
+
+            if (config.enable_mmap)
+            {
+                return std::make_shared<detail::MmapStorage>(path, true);
+            }
+            return std::make_shared<detail::FileStorage>(path, config.io_stats, config.enable_io_uring);
+        }
 
         void traverse(const std::function<bool(std::string_view value)> &predicate, std::vector<std::string_view> &accumulator, uint64_t offset, uint64_t height)
         {
@@ -319,25 +567,41 @@ namespace ninedb::pbt
 
             if (height >= 2)
             {
-                char *node_internal_address = offset_to_address(offset);
+                detail::NodeRef node_internal = loader->load_internal(offset);
+                char *node_internal_address = node_internal.address;
                 uint16_t num_children = detail::NodeInternal::read_num_children(node_internal_address);
 
                 for (uint64_t i = 0; i < num_children; i++)
                 {
-                    if (predicate(detail::NodeInternal::read_reduced_value(node_internal_address, i)))
+                    if (predicate(detail::NodeInternal::read_reduced_value(node_internal_address, i, compact)))
                     {
-                        traverse(predicate, accumulator, detail::NodeInternal::read_child_offset(node_internal_address, i), height - 1);
+                        traverse(predicate, accumulator, detail::NodeInternal::read_child_offset(node_internal_address, i, compact), height - 1);
                     }
                 }
             }
             else
             {
-                char *node_leaf_address = offset_to_address(offset);
+                char *node_leaf_address;
+                if (lz4_compression || !loader->is_mapped())
+                {
+                    // Decompressed and read nodes are kept in memory until the next traversal, so the accumulated values stay valid
+                    detail::NodeRef node_leaf = loader->load_leaf(offset, false);
+                    node_leaf_address = node_leaf.address;
+                    if (node_leaf.data != nullptr)
+                    {
+                        get_traversed_nodes().push_back(node_leaf.data);
+                    }
+                }
+                else
+                {
+                    // Bypasses the cache, so the accumulated values point into the storage and stay valid
+                    node_leaf_address = loader->offset_to_address(offset);
+                }
                 uint16_t num_children = detail::NodeLeaf::read_num_children(node_leaf_address);
 
                 for (uint64_t i = 0; i < num_children; i++)
                 {
-                    std::string_view value = detail::NodeLeaf::read_value(node_leaf_address, i);
+                    std::string_view value = detail::NodeLeaf::read_value(node_leaf_address, i, compact);
 
                     if (predicate(value))
                     {
@@ -347,7 +611,11 @@ namespace ninedb::pbt
             }
         }
 
-        bool find_index(uint64_t index, char *&node_leaf_address, uint64_t &entry_index)
+        /**
+         * Find the leaf node and the entry in it at the given index.
+         * If a pin is given, it is set to keep the leaf node in memory.
+         */
+        bool find_index(uint64_t index, detail::NodeRef &node_leaf, uint64_t &entry_index, std::shared_ptr<const void> *pin)
         {
             ZonePbtReader;
 
@@ -359,125 +627,305 @@ namespace ninedb::pbt
             uint64_t offset = footer.root_offset;
             uint64_t height = footer.tree_height;
 
-            char *node_internal_address;
             uint64_t leaf_entry_start = 0;
+            uint64_t child_entry_count = root_child_entry_count;
 
             while (height >= 2)
             {
-                node_internal_address = offset_to_address(offset);
+                detail::NodeRef node_internal = loader->load_internal(offset);
+                char *node_internal_address = node_internal.address;
 
-                uint16_t num_children = detail::NodeInternal::read_num_children(node_internal_address);
-                for (uint16_t i = 0; i < num_children; i++)
+                if (child_entry_count > 0)
                 {
-                    if (i == num_children - 1)
-                    {
-                        offset = detail::NodeInternal::read_child_offset(node_internal_address, i);
-                        break;
-                    }
-
-                    uint64_t read_child_entry_start = detail::NodeInternal::read_child_entry_start(node_internal_address, i + 1);
-
-                    if (index < read_child_entry_start)
+                    // Every child except the last one is full, so the child follows from the index
+                    uint16_t i = (index - leaf_entry_start) / child_entry_count;
+                    leaf_entry_start += i * child_entry_count;
+                    offset = detail::NodeInternal::read_child_offset(node_internal_address, i, compact);
+                    child_entry_count /= footer_extension.max_node_children;
+                }
+                else
+                {
+                    // Children may have any number of entries, so find the last child that starts at or before the index
+                    uint16_t num_children = detail::NodeInternal::read_num_children(node_internal_address);
+                    uint16_t lo = 0;
+                    uint16_t hi = num_children - 1;
+                    while (lo < hi)
                     {
-                        offset = detail::NodeInternal::read_child_offset(node_internal_address, i);
-                        break;
+                        uint16_t mid = lo + (hi - lo + 1) / 2;
+                        if (detail::NodeInternal::read_child_entry_start(node_internal_address, mid, compact) <= index)
+                        {
+                            lo = mid;
+                        }
+                        else
+                        {
+                            hi = mid - 1;
+                        }
                     }
-
-                    leaf_entry_start = read_child_entry_start;
+                    leaf_entry_start = detail::NodeInternal::read_child_entry_start(node_internal_address, lo, compact);
+                    offset = detail::NodeInternal::read_child_offset(node_internal_address, lo, compact);
                 }
 
                 height--;
             }
 
-            node_leaf_address = offset_to_address(offset);
-            uint16_t num_children = detail::NodeLeaf::read_num_children(node_leaf_address);
+            node_leaf = pin != nullptr ? loader->load_leaf_pinned(offset, *pin) : loader->load_leaf(offset);
             entry_index = index - leaf_entry_start;
 
             return true;
         }
 
+        /**
+         * Find the first occurrence of the given key, checking the key range and Bloom filter before searching the tree.
+         */
+        bool find_key(std::string_view key, detail::NodeRef &node_leaf, uint64_t &entry_index, std::shared_ptr<const void> *pin)
+        {
+            ZonePbtReader;
+
+            if (!is_in_key_range(key))
+            {
+                return false;
+            }
+
+            if (footer_extension.filter_size > 0 && !detail::BloomFilter::may_contain(filter_address, key))
+            {
+                return false;
+            }
+
+            return find<EXACT>(key, node_leaf, entry_index, nullptr, pin);
+        }
+
+        /**
+         * Find the leaf node and the entry in it for the given key.
+         * If a pin is given, it is set to keep the leaf node in memory.
+         */
         template <ReaderFindMode mode>
-        bool find(std::string_view key, char *&node_leaf_address, uint64_t &entry_index, uint64_t *entry_start)
+        bool find(std::string_view key, detail::NodeRef &node_leaf, uint64_t &entry_index, uint64_t *entry_start, std::shared_ptr<const void> *pin)
         {
             ZonePbtReader;
 
             uint64_t offset = footer.root_offset;
             uint64_t height = footer.tree_height;
+            uint64_t child_entry_count = root_child_entry_count;
 
-            char *node_internal_address = nullptr;
+            if (entry_start != nullptr)
+            {
+                *entry_start = 0;
+            }
 
             while (height >= 2)
             {
-                node_internal_address = offset_to_address(offset);
+                detail::NodeRef node_internal = loader->load_internal(offset);
+                char *node_internal_address = node_internal.address;
 
-                if (mode == EXACT)
+                uint64_t lo;
+                if (!find_child<mode>(key, node_internal_address, lo))
                 {
-                    if (key.compare(detail::NodeInternal::read_left_key(node_internal_address)) < 0)
-                    {
-                        return false;
-                    }
+                    return false;
                 }
 
-                uint16_t num_children = detail::NodeInternal::read_num_children(node_internal_address);
-
-                uint64_t lo = 0;
-                uint64_t hi = num_children - 1;
-                while (lo < hi)
+                if (entry_start != nullptr)
                 {
-                    uint64_t mid = lo + (hi - lo) / 2;
-                    if (key.compare(detail::NodeInternal::read_right_key(node_internal_address, mid)) <= 0)
+                    if (child_entry_count > 0)
                     {
-                        hi = mid;
+                        *entry_start += lo * child_entry_count;
+                        child_entry_count /= footer_extension.max_node_children;
                     }
                     else
                     {
-                        lo = mid + 1;
+                        *entry_start = detail::NodeInternal::read_child_entry_start(node_internal_address, lo, compact);
                     }
                 }
 
-                if (mode == EXACT)
+                offset = detail::NodeInternal::read_child_offset(node_internal_address, lo, compact);
+                height--;
+            }
+
+            node_leaf = pin != nullptr ? loader->load_leaf_pinned(offset, *pin) : loader->load_leaf(offset);
+            char *node_leaf_address = node_leaf.address;
+            uint16_t num_children = detail::NodeLeaf::read_num_children(node_leaf_address);
+
+            bool is_equal;
+            uint16_t i = detail::NodeLeaf::lower_bound(node_leaf_address, key, compact, is_equal);
+            if (i >= num_children || (mode == EXACT && !is_equal))
+            {
+                return false;
+            }
+
+            if (entry_start != nullptr)
+            {
+                *entry_start += i;
+            }
+            entry_index = i;
+            return true;
+        }
+
+        /**
+         * Read all internal nodes into memory.
+         * They are written after the leaf nodes a level at a time, so they start with the first node of the lowest level and end with the root node.
+         */
+        void pin_internal_nodes()
+        {
+            ZonePbtReader;
+
+            if (footer.tree_height < 2)
+            {
+                return;
+            }
+
+            uint64_t offset = footer.root_offset;
+            for (uint64_t height = footer.tree_height; height > 2; height--)
+            {
+                detail::NodeRef node_internal = loader->load_internal(offset);
+                offset = detail::NodeInternal::read_child_offset(node_internal.address, 0, compact);
+            }
+            loader->pin_internal_nodes(offset, footer.root_offset + footer.root_size);
+        }
+
+        /**
+         * Find the first child of the internal node whose key range may contain the given key.
+         */
+        template <ReaderFindMode mode>
+        bool find_child(std::string_view key, char *node_internal_address, uint64_t &child_index) const
+        {
+            ZonePbtReader;
+
+            if (mode == EXACT)
+            {
+                if (key.compare(detail::NodeInternal::read_left_key(node_internal_address, compact)) < 0)
                 {
-                    if (key.compare(detail::NodeInternal::read_right_key(node_internal_address, lo)) > 0)
-                    {
-                        return false;
-                    }
+                    return false;
                 }
+            }
 
-                if (entry_start != nullptr)
+            uint16_t num_children = detail::NodeInternal::read_num_children(node_internal_address);
+
+            uint64_t lo = 0;
+            uint64_t hi = num_children - 1;
+            while (lo < hi)
+            {
+                uint64_t mid = lo + (hi - lo) / 2;
+                if (key.compare(detail::NodeInternal::read_right_key(node_internal_address, mid, compact)) <= 0)
                 {
-                    *entry_start = detail::NodeInternal::read_child_entry_start(node_internal_address, lo);
+                    hi = mid;
+                }
+                else
+                {
+                    lo = mid + 1;
                 }
-
-                offset = detail::NodeInternal::read_child_offset(node_internal_address, lo);
-                height--;
             }
 
-            node_leaf_address = offset_to_address(offset);
-            uint16_t num_children = detail::NodeLeaf::read_num_children(node_leaf_address);
-
-            for (uint64_t i = 0; i < num_children; i++)
+            if (mode == EXACT)
             {
-                if (mode == EXACT && detail::NodeLeaf::read_key(node_leaf_address, i).compare(key) == 0 || mode == GREATER_OR_EQUAL && detail::NodeLeaf::read_key(node_leaf_address, i).compare(key) >= 0)
+                if (key.compare(detail::NodeInternal::read_right_key(node_internal_address, lo, compact)) > 0)
                 {
-                    if (entry_start != nullptr)
-                    {
-                        *entry_start += i;
-                    }
-                    entry_index = i;
-                    return true;
+                    return false;
                 }
             }
 
-            return false;
+            child_index = lo;
+            return true;
         }
 
         void read_footer()
         {
             ZonePbtReader;
 
-            char *address = offset_to_address(storage->get_size() - detail::Footer::size_of());
-            detail::Footer::read(address, footer);
+            if (storage->get_size() < detail::Footer::size_of())
+            {
+                throw std::runtime_error("File is too small to contain a footer");
+            }
+            uint64_t footer_offset = storage->get_size() - detail::Footer::size_of();
+            std::string buffer(detail::Footer::size_of(), '\0');
+            storage->read(footer_offset, buffer.size(), buffer.data());
+            detail::Footer::read(buffer.data(), footer);
             footer.validate();
+
+            if (footer.has_extension())
+            {
+                // The extension ends with its size, so it is read in two steps
+                uint64_t extension_size;
+                buffer.resize(sizeof(uint64_t));
+                storage->read(footer_offset - sizeof(uint64_t), sizeof(uint64_t), buffer.data());
+                detail::Format::read_uint64(buffer.data(), extension_size);
+                if (extension_size > footer_offset)
+                {
+                    throw std::runtime_error("Invalid footer extension size");
+                }
+                buffer.resize(extension_size);
+                storage->read(footer_offset - extension_size, extension_size, buffer.data());
+                detail::FooterExtension::read(buffer.data() + extension_size, footer_extension);
+                footer_extension.validate();
+                compact = (footer_extension.flags & detail::FooterExtension::FLAG_COMPACT_NODES) != 0;
+                lz4_compression = (footer_extension.flags & detail::FooterExtension::FLAG_LZ4_COMPRESSION) != 0;
+            }
+
+            if (footer_extension.max_node_children > 0 && footer.tree_height >= 2)
+            {
+                root_child_entry_count = 1;
+                for (uint64_t height = 2; height <= footer.tree_height; height++)
+                {
+                    root_child_entry_count *= footer_extension.max_node_children;
+                }
+            }
+        }
+
+        void read_filter()
+        {
+            ZonePbtReader;
+
+            if (footer_extension.filter_size == 0)
+            {
+                return;
+            }
+            if (storage->get_address() != nullptr)
+            {
+                filter_address = offset_to_address(footer_extension.filter_offset);
+                return;
+            }
+            filter_data.resize(footer_extension.filter_size);
+            storage->read(footer_extension.filter_offset, footer_extension.filter_size, filter_data.data());
+            filter_address = filter_data.data();
+        }
+
+        /**
+         * Get the nodes that the accumulated values of the last traversal on this thread point into.
+         */
+        static std::vector<std::shared_ptr<std::string>> &get_traversed_nodes()
+        {
+            ZonePbtReader;
+
+            thread_local std::vector<std::shared_ptr<std::string>> traversed_nodes;
+            return traversed_nodes;
+        }
+
+        /**
+         * Read the smallest and largest key from the root node, so they are available without touching the file.
+         */
+        void read_key_range()
+        {
+            ZonePbtReader;
+
+            if (footer.tree_height == 0)
+            {
+                return;
+            }
+
+            if (footer.tree_height >= 2)
+            {
+                detail::NodeRef root = loader->load_internal(footer.root_offset);
+                char *root_address = root.address;
+                uint16_t num_children = detail::NodeInternal::read_num_children(root_address);
+                min_key = detail::NodeInternal::read_left_key(root_address, compact);
+                max_key = detail::NodeInternal::read_right_key(root_address, num_children - 1, compact);
+            }
+            else
+            {
+                detail::NodeRef root = loader->load_leaf(footer.root_offset);
+                char *root_address = root.address;
+                uint16_t num_children = detail::NodeLeaf::read_num_children(root_address);
+                min_key = detail::NodeLeaf::read_key(root_address, 0, compact);
+                max_key = detail::NodeLeaf::read_key(root_address, num_children - 1, compact);
+            }
         }
 
         char *offset_to_address(uint64_t offset) const
@@ -1,22 +1,30 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <cstring>
+#include <exception>
 #include <filesystem>
 #include <fstream>
 #include <functional>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
+#include "../detail/loser_tree.hpp"
 #include "../detail/profiling.hpp"
 #include "../detail/traits.hpp"
 
+#include "./detail/bloom_filter.hpp"
+#include "./detail/file_writer.hpp"
 #include "./detail/storage.hpp"
 #include "./detail/structures.hpp"
 #include "./detail/utils.hpp"
@@ -30,7 +38,7 @@ namespace ninedb::pbt
     struct Writer
     {
         Writer(uint64_t global_start, const std::string &path, const WriterConfig &config)
-            : global_start(global_start), config(config)
+            : config(config), global_start(global_start), path(path)
         {
             if (std::filesystem::exists(path))
             {
@@ -39,7 +47,13 @@ namespace ninedb::pbt
                     throw std::runtime_error("File already exists");
                 }
             }
-            else
+            if (config.enable_streaming_writes)
+            {
+                file_writer = std::make_unique<detail::FileWriter>(path, config.write_buffer_size);
+                init_buffer_leaf();
+                return;
+            }
+            if (!std::filesystem::exists(path))
             {
                 std::ofstream ofs;
                 ofs.exceptions(std::ofstream::failbit | std::ofstream::badbit);
@@ -47,23 +61,30 @@ namespace ninedb::pbt
                 ofs.close();
             }
             std::filesystem::resize_file(path, config.initial_pbt_size);
-            storage = std::make_shared<detail::Storage>(path, false);
+            storage = std::make_shared<detail::MmapStorage>(path, false);
             storage->clear();
+            init_buffer_leaf();
         }
 
-        Writer(uint64_t global_start, const std::shared_ptr<detail::Storage> &storage, const WriterConfig &config)
+        Writer(uint64_t global_start, const std::shared_ptr<detail::MmapStorage> &storage, const WriterConfig &config)
             : global_start(global_start), storage(storage), config(config)
         {
             storage->clear();
+            init_buffer_leaf();
         }
 
         /**
          * Create a reader from the writer.
          * Should only be called after finish() has been called.
          */
-        Reader to_reader() const
+        Reader to_reader(const ReaderConfig &reader_config = ReaderConfig()) const
         {
-            return Reader(storage);
+            // Readers of a file use their own storage, which is mapped read-only
+            if (!path.empty())
+            {
+                return Reader(path, reader_config);
+            }
+            return Reader(storage, reader_config);
         }
 
         /**
@@ -74,6 +95,10 @@ namespace ninedb::pbt
             ZonePbtWriter;
 
             buffer_leaf.add_key_value(key, value);
+            if (config.bloom_filter_bits_per_key > 0)
+            {
+                bloom_filter.add_key(key);
+            }
 
             num_entries++;
             if (buffer_leaf.num_children >= config.max_node_children)
@@ -85,6 +110,8 @@ namespace ninedb::pbt
         template <typename R>
         /**
          * Merge multiple PBTs into one.
+         * The inputs are merged with a loser tree, and a leaf node whose keys all come before the current keys of the other inputs is taken over as a whole.
+         * If the input has the same node layout as the output and the leaf node lines up with the leaf nodes of the output, it is copied without decoding it.
          */
         void merge(const std::vector<R> &readers)
         {
@@ -92,53 +119,146 @@ namespace ninedb::pbt
 
             ZonePbtWriter;
 
-            std::vector<Iterator> itrs;
-            std::vector<std::string_view> keys;
+            merge_range(readers, std::nullopt, std::nullopt);
+        }
 
-            uint64_t num_storages = readers.size();
-            itrs.reserve(num_storages);
-            keys.resize(num_storages);
+        template <typename R>
+        /**
+         * Merge multiple PBTs into one, with the keys split into the given number of ranges that are merged in parallel.
+         * The ranges are shared out over the calling thread and further threads, up to one thread per core.
+         * The ranges are chosen from the keys of the internal nodes of the inputs, so they hold similar numbers of entries.
+         * Each range is merged into a temporary file next to this PBT, named after it with a ".part" suffix,
+         * and the leaf nodes of these files are then concatenated into this PBT.
+         * As the last leaf node of each range may not be full, the PBT is then not packed.
+         * Falls back to merging on the calling thread if the PBT is not written to a file.
+         */
+        void merge(const std::vector<R> &readers, uint64_t num_parts)
+        {
+            static_assert(ninedb::detail::is_dereferenceable_to_v<R, Reader>, "R must be dereferencable to a Reader");
 
-            uint64_t total_num_entries = 0;
-            for (size_t i = 0; i < num_storages; i++)
+            ZonePbtWriter;
+
+            std::vector<std::string> boundaries;
+            if (num_parts > 1 && !path.empty())
             {
-                ZonePbtWriterN("ninedb::pbt::Writer::merge init loop");
+                boundaries = find_boundaries(readers, num_parts);
+            }
+            if (boundaries.empty())
+            {
+                merge(readers);
+                return;
+            }
 
-                itrs.push_back(readers[i]->begin());
+            // The entries are concatenated afterwards, so the temporary files need no filter or reduced values
+            WriterConfig part_config = config;
+            part_config.reduce = nullptr;
+            part_config.bloom_filter_bits_per_key = 0;
+            part_config.error_if_exists = false;
 
-                if (!itrs[i].is_end())
+            uint64_t num_ranges = boundaries.size() + 1;
+            std::vector<std::shared_ptr<Reader>> part_readers(num_ranges);
+            std::vector<std::exception_ptr> errors(num_ranges);
+            auto merge_part = [&](uint64_t i)
+            {
+                std::string part_path = path + ".part" + std::to_string(i);
+                try
                 {
-                    keys[i] = itrs[i].get_key();
+                    std::optional<std::string_view> start;
+                    std::optional<std::string_view> end;
+                    if (i > 0)
+                    {
+                        start = boundaries[i - 1];
+                    }
+                    if (i < boundaries.size())
+                    {
+                        end = boundaries[i];
+                    }
+
+                    Writer part_writer(0, part_path, part_config);
+                    part_writer.merge_range(readers, start, end);
+                    part_writer.finish();
+                    part_readers[i] = std::make_shared<Reader>(part_writer.to_reader());
+                    part_readers[i]->remove_on_close();
                 }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                    std::error_code error_code;
+                    std::filesystem::remove(part_path, error_code);
+                }
+            };
 
-                total_num_entries += readers[i]->count();
+            std::atomic<uint64_t> next_range{0};
+            auto merge_parts = [&]()
+            {
+                for (uint64_t i = next_range.fetch_add(1); i < num_ranges; i = next_range.fetch_add(1))
+                {
+                    merge_part(i);
+                }
+            };
+            uint64_t num_threads = std::min<uint64_t>(num_ranges, std::max(1u, std::thread::hardware_concurrency()));
+            std::vector<std::thread> threads;
+            for (uint64_t i = 1; i < num_threads; i++)
+            {
+                threads.emplace_back(merge_parts);
+            }
+            merge_parts();
+            for (auto &thread : threads)
+            {
+                thread.join();
+            }
+            for (const auto &error : errors)
+            {
+                if (error)
+                {
+                    std::rethrow_exception(error);
+                }
             }
 
-            for (uint64_t i = 0; i < total_num_entries; i++)
+            concatenate(part_readers);
+        }
+
+        template <typename R>
+        /**
+         * Write the entries of multiple PBTs whose key ranges do not overlap, given in the order of their keys.
+         * The leaf nodes of PBTs with a node layout that this PBT can hold are copied as they are, so only the internal nodes are rebuilt.
+         * If this leaves leaf nodes that are not full before the last one, the PBT is not packed, and its internal nodes store the entry starts of their children.
+         */
+        void concatenate(const std::vector<R> &readers)
+        {
+            static_assert(ninedb::detail::is_dereferenceable_to_v<R, Reader>, "R must be dereferencable to a Reader");
+
+            ZonePbtWriter;
+
+            std::string_view max_key;
+            bool has_max_key = false;
+            for (const auto &reader : readers)
             {
-                ZonePbtWriterN("ninedb::pbt::Writer::merge merge loop");
+                if (reader->count() == 0)
+                {
+                    continue;
+                }
+                if (has_max_key && reader->get_min_key().compare(max_key) <= 0)
+                {
+                    throw std::runtime_error("Key ranges of the PBTs overlap");
+                }
+                max_key = reader->get_max_key();
+                has_max_key = true;
 
-                std::string_view min_key;
-                uint64_t min_index = 0;
-                for (size_t i = 0; i < num_storages; i++)
+                if (!can_copy_leaves(*reader))
                 {
-                    if (itrs[i].is_end())
-                    {
-                        continue;
-                    }
-                    if (min_key.empty() || keys[i].compare(min_key) < 0)
+                    for (Iterator itr = reader->begin(); !itr.is_end(); itr.next())
                     {
-                        min_key = keys[i];
-                        min_index = i;
+                        add(itr.get_key(), itr.get_value());
                     }
+                    continue;
                 }
 
-                add(keys[min_index], itrs[min_index].get_value());
-                itrs[min_index].next();
-
-                if (!itrs[min_index].is_end())
+                // Leaf nodes can only be copied at a leaf node boundary
+                flush();
+                for (Iterator itr = reader->begin(); !itr.is_end();)
                 {
-                    keys[min_index] = itrs[min_index].get_key();
+                    copy_leaf(itr);
                 }
             }
         }
@@ -154,95 +274,152 @@ namespace ninedb::pbt
 
             flush();
 
-            std::vector<uint64_t> entry_counts;
-            uint64_t entry_count = num_entries;
-            if (entry_count >= 1)
-            {
-                entry_counts.push_back(entry_count);
-            }
-            while (entry_count > config.max_node_children)
-            {
-                entry_count = detail::div_ceil(entry_count, config.max_node_children);
-                entry_counts.push_back(entry_count);
-            }
-
             detail::Footer footer = detail::Footer();
-            footer.tree_height = entry_counts.size();
             footer.global_start = global_start;
             footer.global_end = global_start + num_entries;
 
-            std::vector<std::string_view> keys;
+            // Build each level of internal nodes from the summaries of the nodes of the level below, until one node is left
+            std::vector<NodeSummary> level = std::move(leaf_summaries);
+            std::vector<NodeSummary> parents;
             std::vector<std::string_view> values;
-            std::vector<std::string> reduced_values;
-            keys.resize(config.max_node_children + 1);
-            values.resize(config.max_node_children);
-            reduced_values.resize(config.max_node_children);
+            footer.tree_height = level.empty() ? 0 : 1;
+            buffer_internal.implicit_entry_starts = is_packed;
 
-            uint64_t read_offset = 0;
-            uint64_t child_entry_count_packed = config.max_node_children;
-
-            for (size_t i = 1; i < footer.tree_height; i++)
+            while (level.size() > 1)
             {
-                uint64_t num_level_entries = entry_counts[i];
                 uint64_t child_entry_start = 0;
+                parents.clear();
 
-                for (uint64_t j = 0; j < num_level_entries; j += config.max_node_children)
+                for (uint64_t j = 0; j < level.size(); j += config.max_node_children)
                 {
-                    uint16_t num_children = std::min(config.max_node_children, num_level_entries - j);
+                    uint16_t num_children = std::min(config.max_node_children, level.size() - j);
+                    NodeSummary parent;
+                    parent.offset = write_offset;
+                    parent.num_entries = 0;
+                    values.clear();
 
                     for (uint16_t k = 0; k < num_children; k++)
                     {
-                        uint64_t child_offset = read_offset;
-                        uint64_t child_size;
-
-                        if (k == 0)
-                        {
-                            child_size = read_node_metadata(read_offset, i, values, &keys[0], &keys[1]);
-                        }
-                        else
-                        {
-                            child_size = read_node_metadata(read_offset, i, values, nullptr, &keys[k + 1]);
-                        }
-
-                        if (config.reduce != nullptr)
-                        {
-                            config.reduce(values, reduced_values[k]);
-                        }
-
+                        const NodeSummary &child = level[j + k];
                         if (k == 0)
                         {
-                            buffer_internal.add_first_child(keys[0], keys[1], reduced_values[0], child_entry_start, child_offset, child_size);
+                            buffer_internal.add_first_child(child.first_key, child.last_key, child.reduced_value, child_entry_start, child.offset, child.size);
                         }
                         else
                         {
-                            buffer_internal.add_child(keys[k + 1], reduced_values[k], child_entry_start, child_offset, child_size);
+                            buffer_internal.add_child(child.last_key, child.reduced_value, child_entry_start, child.offset, child.size);
                         }
-
-                        read_offset += child_size;
-                        child_entry_start += child_entry_count_packed;
+                        values.push_back(child.reduced_value);
+                        child_entry_start += child.num_entries;
+                        parent.num_entries += child.num_entries;
                     }
 
-                    write_offset += write_node_internal(write_offset, buffer_internal);
+                    parent.size = write_node_internal(write_offset, buffer_internal);
+                    write_offset += parent.size;
                     buffer_internal.clear();
+
+                    // The reduced value of the root node is not stored
+                    if (config.reduce != nullptr && level.size() > config.max_node_children)
+                    {
+                        config.reduce(values, parent.reduced_value);
+                    }
+                    if (parents.size() % config.max_node_children == 0)
+                    {
+                        parent.first_key = std::move(level[j].first_key);
+                    }
+                    parent.last_key = std::move(level[j + num_children - 1].last_key);
+                    parents.push_back(std::move(parent));
                 }
 
-                child_entry_count_packed *= config.max_node_children;
+                std::swap(level, parents);
+                footer.tree_height++;
+            }
+
+            // An empty PBT has no root node
+            footer.root_offset = level.empty() ? 0 : level[0].offset;
+            footer.root_size = level.empty() ? 0 : level[0].size;
+
+            detail::FooterExtension footer_extension;
+            if (is_packed)
+            {
+                footer_extension.max_node_children = config.max_node_children;
+            }
+            if (config.enable_compact_nodes)
+            {
+                footer_extension.flags |= detail::FooterExtension::FLAG_COMPACT_NODES;
+                if (is_packed)
+                {
+                    footer_extension.flags |= detail::FooterExtension::FLAG_IMPLICIT_ENTRY_STARTS;
+                }
+            }
+            if (buffer_leaf.restart_interval > 0)
+            {
+                footer_extension.flags |= detail::FooterExtension::FLAG_PREFIX_COMPRESSION;
+            }
+            if (config.enable_lz4_compression)
+            {
+                footer_extension.flags |= detail::FooterExtension::FLAG_LZ4_COMPRESSION;
+            }
+            if (config.bloom_filter_bits_per_key > 0 && num_entries > 0)
+            {
+                footer_extension.filter_offset = write_offset;
+                footer_extension.filter_size = write_bloom_filter(write_offset);
+                write_offset += footer_extension.filter_size;
             }
 
-            footer.root_offset = read_offset;
-            footer.root_size = write_offset - read_offset;
+            write_offset += write_footer_extension(write_offset, footer_extension);
             write_offset += write_footer(write_offset, footer);
-            storage->set_size(write_offset);
+            if (file_writer != nullptr)
+            {
+                file_writer->close();
+                file_writer.reset();
+            }
+            else
+            {
+                storage->set_size(write_offset);
+            }
         }
 
     private:
         WriterConfig config;
-        std::shared_ptr<detail::Storage> storage;
+        // Null when writes are streamed, in which case the file is opened again by to_reader().
+        std::shared_ptr<detail::MmapStorage> storage;
+        // Appends to the file when writes are streamed.
+        std::unique_ptr<detail::FileWriter> file_writer;
         uint64_t global_start;
+        // The path of the file of the PBT, or empty if it was given a storage.
+        std::string path;
         uint64_t write_offset = 0;
         uint64_t num_entries = 0;
+        uint64_t num_leaves = 0;
+        uint64_t last_leaf_num_entries = 0;
+        // Whether every leaf node except the last one is full, so the position of an entry follows from its index.
+        bool is_packed = true;
         detail::NodeLeafBuilder buffer_leaf;
         detail::NodeInternalBuilder buffer_internal;
+        detail::BloomFilterBuilder bloom_filter;
+
+        /**
+         * What the parent of a node needs to know about the node.
+         * Kept from when the node is written, so finish() builds the internal nodes without reading the nodes back.
+         */
+        struct NodeSummary
+        {
+            // Only kept for the first child of each parent, which is the only one whose smallest key the parent stores.
+            std::string first_key;
+            std::string last_key;
+            std::string reduced_value;
+            uint64_t offset;
+            uint64_t size;
+            uint64_t num_entries;
+        };
+
+        std::vector<NodeSummary> leaf_summaries;
+        // The values of the leaf node that is summarized, if there is a reduce function.
+        std::vector<std::string_view> leaf_values;
+
+        // Serialized leaf node before compression.
+        std::string node_buffer;
 
         /**
          * Write the leaf node buffer to the storage and clear it.
@@ -256,88 +433,346 @@ namespace ninedb::pbt
                 return;
             }
 
+            uint64_t offset = write_offset;
             write_offset += write_node_leaf(write_offset, buffer_leaf);
+
+            leaf_values.clear();
+            if (config.reduce != nullptr)
+            {
+                for (uint16_t i = 0; i < buffer_leaf.num_children; i++)
+                {
+                    leaf_values.push_back(buffer_leaf.get_value(i));
+                }
+            }
+            summarize_leaf(offset, write_offset - offset, buffer_leaf.num_children, buffer_leaf.get_key(0), buffer_leaf.get_key(buffer_leaf.num_children - 1));
+            count_leaf(buffer_leaf.num_children);
             buffer_leaf.clear();
         }
 
-        uint64_t write_footer(uint64_t offset, const detail::Footer &footer)
+        /**
+         * Keep what the parent of a leaf node needs to know about it, with its values in leaf_values.
+         */
+        void summarize_leaf(uint64_t offset, uint64_t size, uint64_t num_leaf_entries, std::string_view first_key, std::string_view last_key)
         {
             ZonePbtWriter;
 
-            storage->ensure_size(offset + detail::Footer::size_of());
-            char *address = reinterpret_cast<char *>(storage->get_address()) + offset;
-            return detail::Footer::write(address, footer);
+            NodeSummary summary;
+            if (leaf_summaries.size() % config.max_node_children == 0)
+            {
+                summary.first_key = first_key;
+            }
+            summary.last_key = last_key;
+            if (config.reduce != nullptr)
+            {
+                config.reduce(leaf_values, summary.reduced_value);
+            }
+            summary.offset = offset;
+            summary.size = size;
+            summary.num_entries = num_leaf_entries;
+            leaf_summaries.push_back(std::move(summary));
         }
 
-        uint64_t write_node_leaf(uint64_t offset, const detail::NodeLeafBuilder &node)
+        /**
+         * Keep track of the leaf nodes after writing one with the given number of entries.
+         */
+        void count_leaf(uint64_t num_leaf_entries)
         {
             ZonePbtWriter;
 
-            char *address = reinterpret_cast<char *>(storage->get_address()) + offset;
-            storage->ensure_size(offset + node.size_of());
-            return detail::NodeLeaf::write(address, node);
+            if ((num_leaves > 0 && last_leaf_num_entries != config.max_node_children) || num_leaf_entries > config.max_node_children)
+            {
+                is_packed = false;
+            }
+            num_leaves++;
+            last_leaf_num_entries = num_leaf_entries;
         }
 
-        uint64_t write_node_internal(uint64_t offset, const detail::NodeInternalBuilder &node)
+        template <typename R>
+        /**
+         * Merge the entries of multiple PBTs with keys from the given start key, up to but excluding the given end key.
+         * The inputs are merged with a loser tree, and a leaf node whose keys all come before the current keys of the other inputs is taken over as a whole.
+         * If the input has the same node layout as the output and the leaf node lines up with the leaf nodes of the output, it is copied without decoding it.
+         */
+        void merge_range(const std::vector<R> &readers, std::optional<std::string_view> start, std::optional<std::string_view> end)
         {
             ZonePbtWriter;
 
-            char *address = reinterpret_cast<char *>(storage->get_address()) + offset;
-            storage->ensure_size(offset + node.size_of());
-            return detail::NodeInternal::write(address, node);
+            std::vector<Iterator> itrs;
+            std::vector<bool> can_copy;
+
+            uint64_t num_storages = readers.size();
+            itrs.reserve(num_storages);
+            can_copy.resize(num_storages);
+            std::vector<std::string_view> keys(num_storages);
+            std::vector<bool> ended(num_storages);
+
+            uint64_t num_inputs = 0;
+            for (size_t i = 0; i < num_storages; i++)
+            {
+                ZonePbtWriterN("ninedb::pbt::Writer::merge_range init loop");
+
+                itrs.push_back(start.has_value() ? readers[i]->seek_first(start.value()) : readers[i]->begin());
+                can_copy[i] = can_copy_leaves(*readers[i]);
+
+                ended[i] = itrs[i].is_end() || (end.has_value() && itrs[i].get_key().compare(end.value()) >= 0);
+                if (!ended[i])
+                {
+                    keys[i] = itrs[i].get_key();
+                    num_inputs++;
+                }
+            }
+
+            ninedb::detail::LoserTree tree(std::move(keys), std::move(ended));
+            while (!tree.is_empty())
+            {
+                ZonePbtWriterN("ninedb::pbt::Writer::merge_range merge loop");
+
+                uint64_t i = tree.top();
+                Iterator &itr = itrs[i];
+
+                if (itr.is_at_leaf_start() && tree.would_stay_top(itr.get_leaf_last_key()) &&
+                    (!end.has_value() || itr.get_leaf_last_key().compare(end.value()) < 0))
+                {
+                    // A leaf node that is not full keeps the output packed only as its last leaf node, which it can be if no other input is left
+                    bool is_aligned = buffer_leaf.num_children == 0 && (itr.get_leaf_num_entries() == config.max_node_children || num_inputs == 1);
+                    if (can_copy[i] && is_aligned)
+                    {
+                        copy_leaf(itr);
+                    }
+                    else
+                    {
+                        add_leaf(itr);
+                    }
+                }
+                else
+                {
+                    add(tree.get_key(i), itr.get_value());
+                    itr.next();
+                }
+
+                if (itr.is_end() || (end.has_value() && itr.get_key().compare(end.value()) >= 0))
+                {
+                    tree.remove_top();
+                    num_inputs--;
+                }
+                else
+                {
+                    tree.replace_top(itr.get_key());
+                }
+            }
         }
 
-        uint64_t read_node_metadata(uint64_t offset, uint64_t level, std::vector<std::string_view> &values, std::string_view *first_key, std::string_view *last_key) const
+        template <typename R>
+        /**
+         * Find keys that split the entries of the given PBTs into the given number of ranges with similar numbers of entries.
+         * Each key sampled from the internal nodes of a PBT stands for an equal share of its entries, and the boundaries are the keys at which the running total of these shares crosses a multiple of the range size.
+         * Returns fewer keys if the PBTs have too few internal nodes, and none if they have none at all.
+         */
+        static std::vector<std::string> find_boundaries(const std::vector<R> &readers, uint64_t num_parts)
         {
             ZonePbtWriter;
 
-            char *address = reinterpret_cast<char *>(storage->get_address()) + offset;
-            if (level <= 1)
+            std::vector<std::pair<std::string, double>> samples;
+            double total_weight = 0;
+            for (const auto &reader : readers)
             {
-                return read_node_leaf_metadata(address, values, first_key, last_key);
+                std::vector<std::string> keys = reader->sample_keys(num_parts);
+                for (auto &key : keys)
+                {
+                    double weight = static_cast<double>(reader->count()) / keys.size();
+                    samples.emplace_back(std::move(key), weight);
+                    total_weight += weight;
+                }
             }
-            else
+            std::sort(samples.begin(), samples.end());
+
+            std::vector<std::string> boundaries;
+            double running_weight = 0;
+            for (const auto &[key, weight] : samples)
             {
-                return read_node_internal_metadata(address, values, first_key, last_key);
+                running_weight += weight;
+                if (boundaries.size() + 1 >= num_parts)
+                {
+                    break;
+                }
+                if (running_weight >= total_weight * (boundaries.size() + 1) / num_parts && (boundaries.empty() || boundaries.back() < key))
+                {
+                    boundaries.push_back(key);
+                }
             }
+            return boundaries;
         }
 
-        uint64_t read_node_leaf_metadata(char *address, std::vector<std::string_view> &values, std::string_view *first_key, std::string_view *last_key) const
+        /**
+         * Check if the leaf nodes of the given PBT can be copied into this one as they are, which requires a node layout that this PBT can hold.
+         */
+        bool can_copy_leaves(const Reader &reader) const
         {
-            uint16_t num_children = detail::NodeLeaf::read_num_children(address);
-            values.resize(num_children);
-            for (uint16_t i = 0; i < num_children; i++)
+            ZonePbtWriter;
+
+            const detail::FooterExtension &footer_extension = reader.get_footer_extension();
+            bool compact = (footer_extension.flags & detail::FooterExtension::FLAG_COMPACT_NODES) != 0;
+            bool prefix_compression = (footer_extension.flags & detail::FooterExtension::FLAG_PREFIX_COMPRESSION) != 0;
+            bool lz4_compression = (footer_extension.flags & detail::FooterExtension::FLAG_LZ4_COMPRESSION) != 0;
+
+            return compact == config.enable_compact_nodes &&
+                   lz4_compression == config.enable_lz4_compression &&
+                   (!prefix_compression || buffer_leaf.restart_interval > 0);
+        }
+
+        /**
+         * Copy the leaf node of the iterator into the storage as it is, and move the iterator past it.
+         * The leaf node buffer must be empty.
+         */
+        void copy_leaf(Iterator &itr)
+        {
+            ZonePbtWriter;
+
+            std::string_view leaf = itr.get_stored_leaf();
+            uint64_t num_leaf_entries = itr.get_leaf_num_entries();
+            uint64_t offset = write_offset;
+            char *address = reserve(write_offset, leaf.size());
+            std::memcpy(address, leaf.data(), leaf.size());
+            commit(leaf.size());
+            write_offset += leaf.size();
+            num_entries += num_leaf_entries;
+
+            // The keys and values only stay valid until the iterator moves past the leaf node, so it is summarized at its last entry
+            std::string first_key;
+            leaf_values.clear();
+            for (uint64_t k = 0; k < num_leaf_entries; k++)
             {
-                values[i] = detail::NodeLeaf::read_value(address, i);
+                std::string_view key = itr.get_key();
+                if (config.bloom_filter_bits_per_key > 0)
+                {
+                    bloom_filter.add_key(key);
+                }
+                if (k == 0)
+                {
+                    first_key = key;
+                }
+                if (config.reduce != nullptr)
+                {
+                    leaf_values.push_back(itr.get_value());
+                }
+                if (k == num_leaf_entries - 1)
+                {
+                    summarize_leaf(offset, leaf.size(), num_leaf_entries, first_key, key);
+                }
+                itr.next();
             }
-            if (first_key != nullptr)
+            count_leaf(num_leaf_entries);
+        }
+
+        /**
+         * Add the entries of the leaf node of the iterator, and move the iterator past it.
+         */
+        void add_leaf(Iterator &itr)
+        {
+            ZonePbtWriter;
+
+            uint64_t num_leaf_entries = itr.get_leaf_num_entries();
+            for (uint64_t k = 0; k < num_leaf_entries; k++)
             {
-                *first_key = detail::NodeLeaf::read_key(address, 0);
+                add(itr.get_key(), itr.get_value());
+                itr.next();
             }
-            if (last_key != nullptr)
+        }
+
+        /**
+         * Set up the leaf node buffer for prefix compression, if it is enabled.
+         */
+        void init_buffer_leaf()
+        {
+            ZonePbtWriter;
+
+            if (!config.enable_compact_nodes || !config.enable_prefix_compression)
+            {
+                return;
+            }
+            if (config.prefix_restart_interval < 1 || config.prefix_restart_interval > UINT16_MAX)
             {
-                *last_key = detail::NodeLeaf::read_key(address, num_children - 1);
+                throw std::runtime_error("Prefix restart interval must be between 1 and 65535");
             }
-            return detail::NodeLeaf::size_of(address);
+            buffer_leaf.restart_interval = config.prefix_restart_interval;
         }
 
-        uint64_t read_node_internal_metadata(char *address, std::vector<std::string_view> &values, std::string_view *first_key, std::string_view *last_key) const
+        /**
+         * Get the address to write at most the given number of bytes to at the given offset, which must be the end of what has been written.
+         */
+        char *reserve(uint64_t offset, uint64_t size)
         {
-            uint16_t num_children = detail::NodeInternal::read_num_children(address);
-            values.resize(num_children);
-            for (uint16_t i = 0; i < num_children; i++)
+            ZonePbtWriter;
+
+            if (file_writer != nullptr)
             {
-                values[i] = detail::NodeInternal::read_reduced_value(address, i);
+                return file_writer->reserve(size);
             }
-            if (first_key != nullptr)
+            storage->ensure_size(offset + size);
+            return reinterpret_cast<char *>(storage->get_address()) + offset;
+        }
+
+        /**
+         * Mark the given number of bytes at the address of the last reservation as written, and return that number.
+         */
+        uint64_t commit(uint64_t size)
+        {
+            ZonePbtWriter;
+
+            if (file_writer != nullptr)
             {
-                *first_key = detail::NodeInternal::read_left_key(address);
+                file_writer->commit(size);
             }
-            if (last_key != nullptr)
+            return size;
+        }
+
+        uint64_t write_footer(uint64_t offset, const detail::Footer &footer)
+        {
+            ZonePbtWriter;
+
+            char *address = reserve(offset, detail::Footer::size_of());
+            return commit(detail::Footer::write(address, footer));
+        }
+
+        uint64_t write_footer_extension(uint64_t offset, const detail::FooterExtension &footer_extension)
+        {
+            ZonePbtWriter;
+
+            char *address = reserve(offset, detail::FooterExtension::size_of());
+            return commit(detail::FooterExtension::write(address, footer_extension));
+        }
+
+        uint64_t write_bloom_filter(uint64_t offset)
+        {
+            ZonePbtWriter;
+
+            char *address = reserve(offset, detail::BloomFilter::size_of(bloom_filter, config.bloom_filter_bits_per_key));
+            return commit(detail::BloomFilter::write(address, bloom_filter, config.bloom_filter_bits_per_key));
+        }
+
+        uint64_t write_node_leaf(uint64_t offset, const detail::NodeLeafBuilder &node)
+        {
+            ZonePbtWriter;
+
+            uint64_t size = node.size_of(config.enable_compact_nodes);
+            if (config.enable_lz4_compression)
             {
-                *last_key = detail::NodeInternal::read_right_key(address, num_children - 1);
+                node_buffer.resize(size);
+                detail::NodeLeaf::write(node_buffer.data(), node, config.enable_compact_nodes);
+                char *address = reserve(offset, detail::NodeLeafFrame::max_size_of(size));
+                return commit(detail::NodeLeafFrame::write(address, node_buffer));
             }
-            return detail::NodeInternal::size_of(address);
+
+            char *address = reserve(offset, size);
+            return commit(detail::NodeLeaf::write(address, node, config.enable_compact_nodes));
+        }
+
+        uint64_t write_node_internal(uint64_t offset, const detail::NodeInternalBuilder &node)
+        {
+            ZonePbtWriter;
+
+            char *address = reserve(offset, node.size_of(config.enable_compact_nodes));
+            return commit(detail::NodeInternal::write(address, node, config.enable_compact_nodes));
         }
     };
 }
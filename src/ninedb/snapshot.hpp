@@ -0,0 +1,280 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "./detail/profiling.hpp"
+#include "./detail/version.hpp"
+
+#include "./iterator.hpp"
+
+namespace ninedb
+{
+    /**
+     * A point-in-time view of a db.
+     * The snapshot pins the PBT files and buffers of the db as they were when it was taken,
+     * including the entries in the write buffer at that time, and ignores everything added afterwards.
+     * Files replaced by merges are kept until the last snapshot or iterator referencing them is destroyed.
+     * Keys and values returned by get() and at() keep what they point into in memory, so they stay valid for as long as they exist, even after the snapshot is destroyed.
+     * Keys and values returned by iterators stay valid for as long as the iterator exists,
+     * or with a leaf node cache, or files with prefix or LZ4 compression, until the iterator moves to the next entry.
+     */
+    struct Snapshot
+    {
+        Snapshot(std::shared_ptr<const detail::Version> version)
+            : version(std::move(version))
+        {
+            ZoneDb;
+
+            if (!this->version->buffers.empty())
+            {
+                active_buffer_count = this->version->buffers.back()->get_count();
+            }
+        }
+
+        /**
+         * Get the first value for the given key.
+         * If the key does not exist, false will be returned.
+         * Otherwise, true will be returned and the value will be set.
+         */
+        bool get(std::string_view key, pbt::PinnedView &value) const
+        {
+            ZoneDb;
+
+            for (const auto &[file_name, reader] : version->readers)
+            {
+                if (reader->is_in_key_range(key) && reader->get(key, value))
+                {
+                    return true;
+                }
+            }
+            for (uint64_t i = 0; i < version->buffers.size(); i++)
+            {
+                std::string_view buffer_value;
+                if (version->buffers[i]->get(key, buffer_value, get_buffer_count(i)))
+                {
+                    value = pbt::PinnedView(buffer_value, version->buffers[i]);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * Get the first value for the given key.
+         */
+        std::optional<pbt::PinnedView> get(std::string_view key) const
+        {
+            ZoneDb;
+
+            pbt::PinnedView value;
+            if (get(key, value))
+            {
+                return value;
+            }
+            return std::nullopt;
+        }
+
+        /**
+         * Get the key and value at the given index.
+         * If the index is out of range, false will be returned.
+         * Otherwise, true will be returned and the key and value will be set.
+         */
+        bool at(uint64_t index, pbt::PinnedView &key, pbt::PinnedView &value) const
+        {
+            ZoneDb;
+
+            uint64_t i = find_reader(index);
+            if (i < version->ordered_readers.size())
+            {
+                return version->ordered_readers[i]->at(index - get_reader_start(i), key, value);
+            }
+            index -= get_reader_start(i);
+            for (uint64_t i = 0; i < version->buffers.size(); i++)
+            {
+                if (index < get_buffer_count(i))
+                {
+                    std::string_view buffer_key;
+                    std::string_view buffer_value;
+                    if (!version->buffers[i]->at(index, buffer_key, buffer_value, get_buffer_count(i)))
+                    {
+                        return false;
+                    }
+                    key = pbt::PinnedView(buffer_key, version->buffers[i]);
+                    value = pbt::PinnedView(buffer_value, version->buffers[i]);
+                    return true;
+                }
+                index -= get_buffer_count(i);
+            }
+            return false;
+        }
+
+        /**
+         * Get the key-value pair at the given index.
+         * If the index is out of range, std::nullopt will be returned.
+         */
+        std::optional<std::pair<pbt::PinnedView, pbt::PinnedView>> at(uint64_t index) const
+        {
+            ZoneDb;
+
+            std::pair<pbt::PinnedView, pbt::PinnedView> result;
+            if (at(index, result.first, result.second))
+            {
+                return result;
+            }
+            return std::nullopt;
+        }
+
+        /**
+         * Get the number of entries in the snapshot.
+         */
+        uint64_t count() const
+        {
+            ZoneDb;
+
+            uint64_t num_entries = get_reader_start(version->ordered_readers.size());
+            for (uint64_t i = 0; i < version->buffers.size(); i++)
+            {
+                num_entries += get_buffer_count(i);
+            }
+            return num_entries;
+        }
+
+        /**
+         * Return an iterator to the first key-value pair in the snapshot.
+         */
+        Iterator begin() const
+        {
+            ZoneDb;
+
+            std::vector<pbt::Iterator> itrs;
+            for (const auto &[file_name, reader] : version->readers)
+            {
+                itrs.push_back(reader->begin());
+            }
+            std::vector<detail::BufferIterator> buffer_itrs;
+            for (uint64_t i = 0; i < version->buffers.size(); i++)
+            {
+                buffer_itrs.push_back(version->buffers[i]->begin(get_buffer_count(i)));
+            }
+            return Iterator(std::move(itrs), std::move(buffer_itrs), version);
+        }
+
+        /**
+         * Return an iterator to the first key-value pair in the snapshot with a key equal to the given key.
+         * If no such key exists, the iterator will be at the first key greater than the given key.
+         * If no such key exists, the iterator will be at the end.
+         */
+        Iterator seek(std::string_view key) const
+        {
+            ZoneDb;
+
+            std::vector<pbt::Iterator> itrs;
+            for (const auto &[file_name, reader] : version->readers)
+            {
+                // Readers with only smaller keys would be at the end, so they are left out of the merge
+                if (reader->count() > 0 && key.compare(reader->get_max_key()) <= 0)
+                {
+                    itrs.push_back(reader->seek_first(key));
+                }
+            }
+            std::vector<detail::BufferIterator> buffer_itrs;
+            for (uint64_t i = 0; i < version->buffers.size(); i++)
+            {
+                buffer_itrs.push_back(version->buffers[i]->seek_first(key, get_buffer_count(i)));
+            }
+            return Iterator(std::move(itrs), std::move(buffer_itrs), version);
+        }
+
+        /**
+         * Return an iterator to the key-value pair at the given index in the snapshot.
+         * If the index is out of range, the iterator will be at the end.
+         */
+        Iterator seek(uint64_t index) const
+        {
+            ZoneDb;
+
+            // Readers before the one holding the index would be at the end, so they are left out of the merge
+            std::vector<pbt::Iterator> itrs;
+            uint64_t first = find_reader(index);
+            for (uint64_t i = first; i < version->ordered_readers.size(); i++)
+            {
+                itrs.push_back(i == first ? version->ordered_readers[i]->seek(index - get_reader_start(i)) : version->ordered_readers[i]->begin());
+            }
+            index -= std::min(index, get_reader_start(version->ordered_readers.size()));
+            std::vector<detail::BufferIterator> buffer_itrs;
+            for (uint64_t i = 0; i < version->buffers.size(); i++)
+            {
+                buffer_itrs.push_back(version->buffers[i]->seek(index, get_buffer_count(i)));
+                index -= std::min(index, get_buffer_count(i));
+            }
+            return Iterator(std::move(itrs), std::move(buffer_itrs), version);
+        }
+
+        /**
+         * Visit all nodes in the trees in the snapshot in order.
+         * At the leaf nodes, values are tested with the given predicate and accumulated if the predicate returns true.
+         * Internal nodes are also tested against the predicate on their reduced values, and their subtrees are skipped if the predicate returns false.
+         */
+        void traverse(const std::function<bool(std::string_view value)> &predicate, std::vector<std::string_view> &accumulator) const
+        {
+            ZoneDb;
+
+            for (const auto &[file_name, reader] : version->readers)
+            {
+                reader->traverse(predicate, accumulator);
+            }
+            for (uint64_t i = 0; i < version->buffers.size(); i++)
+            {
+                for (auto it = version->buffers[i]->begin(get_buffer_count(i)); !it.is_end(); it.next())
+                {
+                    if (predicate(it.get_value()))
+                    {
+                        accumulator.push_back(it.get_value());
+                    }
+                }
+            }
+        }
+
+    private:
+        std::shared_ptr<const detail::Version> version;
+        uint64_t active_buffer_count = 0;
+
+        /**
+         * Get the position of the reader holding the given index in the ordered readers.
+         * If the index is past the entries of the readers, the number of readers is returned.
+         */
+        uint64_t find_reader(uint64_t index) const
+        {
+            const std::vector<uint64_t> &reader_ends = version->reader_ends;
+            return std::upper_bound(reader_ends.begin(), reader_ends.end(), index) - reader_ends.begin();
+        }
+
+        /**
+         * Get the index of the first entry of the ordered reader at the given position, counted across the readers.
+         */
+        uint64_t get_reader_start(uint64_t i) const
+        {
+            return i == 0 ? 0 : version->reader_ends[i - 1];
+        }
+
+        /**
+         * Get the number of entries of the buffer at the given position that are part of the snapshot.
+         * Only the last buffer receives writes, the others are full and no longer change.
+         */
+        uint64_t get_buffer_count(uint64_t i) const
+        {
+            if (i + 1 == version->buffers.size())
+            {
+                return active_buffer_count;
+            }
+            return version->buffers[i]->get_count();
+        }
+    };
+}
@@ -1,7 +1,12 @@
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <filesystem>
+#include <numeric>
+#include <random>
 #include <string>
+#include <thread>
 #include <vector>
 
 // #define NINEDB_PROFILING
@@ -59,7 +64,7 @@ void test_get_by_key()
     }
     db.flush();
 
-    std::string_view value;
+    pbt::PinnedView value;
     for (uint64_t i = 0; i < keys.size(); i++)
     {
         bool found = db.get(keys[i], value);
@@ -92,8 +97,8 @@ void test_get_by_index()
     }
     db.flush();
 
-    std::string_view key;
-    std::string_view value;
+    pbt::PinnedView key;
+    pbt::PinnedView value;
     for (uint64_t i = 0; i < keys.size(); i++)
     {
         bool found = db.at(i, key, value);
@@ -131,8 +136,8 @@ void test_negative_results()
     }
     db.flush();
 
-    std::string_view key;
-    std::string_view value;
+    pbt::PinnedView key;
+    pbt::PinnedView value;
 
     std::vector<std::string> negative_keys = {"", "key", "key_-1", "key_10000", "zzz"};
     for (uint64_t i = 0; i < negative_keys.size(); i++)
@@ -303,6 +308,63 @@ void test_iterator_seek_index()
     std::cout << "test_iterator_seek_index done" << std::endl;
 }
 
+void test_iterator_merge_order()
+{
+    // Every file holds every key, twice, so the merge has to order equal keys by file
+    uint64_t num_files = 7;
+    std::vector<std::string> keys;
+    generate_keys_sequence(1000, keys);
+
+    std::vector<std::shared_ptr<pbt::Reader>> readers;
+    for (uint64_t f = 0; f < num_files; f++)
+    {
+        std::string file_path = "test_iterator_merge_order_" + std::to_string(f) + ".pbt";
+        pbt::Writer writer(0, file_path, pbt::WriterConfig());
+        // Files with an odd number skip the first half of the keys, so files start at different keys
+        for (uint64_t i = f % 2 == 0 ? 0 : keys.size() / 2; i < keys.size(); i++)
+        {
+            writer.add(keys[i], std::to_string(f) + "_a");
+            writer.add(keys[i], std::to_string(f) + "_b");
+        }
+        writer.finish();
+        readers.push_back(std::make_shared<pbt::Reader>(writer.to_reader()));
+    }
+
+    std::vector<pbt::Iterator> itrs;
+    for (auto &reader : readers)
+    {
+        itrs.push_back(reader->begin());
+    }
+    Iterator it(std::move(itrs));
+
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        for (uint64_t f = 0; f < num_files; f++)
+        {
+            if (f % 2 == 1 && i < keys.size() / 2)
+            {
+                continue;
+            }
+            for (std::string suffix : {"_a", "_b"})
+            {
+                if (it.is_end() || it.get_key() != keys[i] || it.get_value() != std::to_string(f) + suffix)
+                {
+                    std::cout << "merge order mismatch: " << keys[i] << " " << f << suffix << std::endl;
+                    exit(1);
+                }
+                it.next();
+            }
+        }
+    }
+    if (!it.is_end())
+    {
+        std::cout << "merge not at end" << std::endl;
+        exit(1);
+    }
+
+    std::cout << "test_iterator_merge_order done" << std::endl;
+}
+
 void test_iterator_end()
 {
     std::vector<std::string> keys;
@@ -348,7 +410,7 @@ void test_reopen()
     }
     db2.flush();
 
-    std::string_view value;
+    pbt::PinnedView value;
     for (uint64_t i = 0; i < keys.size(); i++)
     {
         bool found = db2.get(keys[i], value);
@@ -367,79 +429,1143 @@ void test_reopen()
     std::cout << "test_reopen done" << std::endl;
 }
 
-void benchmark_add()
+void test_compact_nodes()
 {
     std::vector<std::string> keys;
     std::vector<std::string> values;
-    generate_keys_sequence(100000, keys);
-    generate_values_sequence(100000, values);
+    generate_keys_sequence(10000, keys);
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        // Mix small and large values, so nodes need headers of different widths
+        values.push_back(std::string(i % 100 == 0 ? 5000 : i % 50, 'a' + i % 26));
+    }
 
-    KvDb db = KvDb::open("benchmark_add", get_benchmark_config());
-    auto t1 = std::chrono::high_resolution_clock::now();
+    // Files with the fixed-width layout of version 0.1 must stay readable and mergeable with compact files
+    Config config = get_test_config();
+    config.writer.enable_compact_nodes = false;
+    KvDb db1 = KvDb::open("test_compact_nodes", config);
+    for (uint64_t i = 0; i < keys.size() / 2; i++)
+    {
+        db1.add(keys[i], values[i]);
+    }
+    db1.flush();
+
+    config = get_test_config(false);
+    config.writer.enable_compact_nodes = true;
+    KvDb db2 = KvDb::open("test_compact_nodes", config);
+    for (uint64_t i = keys.size() / 2; i < keys.size(); i++)
+    {
+        db2.add(keys[i], values[i]);
+    }
+    db2.flush();
+
+    pbt::PinnedView key;
+    pbt::PinnedView value;
     for (uint64_t i = 0; i < keys.size(); i++)
     {
-        db.add(keys[i], values[i]);
+        if (!db2.get(keys[i], value) || value != values[i])
+        {
+            std::cout << "get mismatch" << std::endl;
+            exit(1);
+        }
+        if (!db2.at(i, key, value) || key != keys[i] || value != values[i])
+        {
+            std::cout << "at mismatch" << std::endl;
+            exit(1);
+        }
     }
-    db.compact();
-    auto t2 = std::chrono::high_resolution_clock::now();
 
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
-    std::cout << "benchmark_add: " << duration.count() << " μs" << std::endl;
+    uint64_t i = 0;
+    for (auto it = db2.begin(); !it.is_end(); it.next())
+    {
+        if (it.get_key() != keys[i] || it.get_value() != values[i])
+        {
+            std::cout << "iterator mismatch" << std::endl;
+            exit(1);
+        }
+        i++;
+    }
+    if (i != keys.size())
+    {
+        std::cout << "iterator count mismatch" << std::endl;
+        exit(1);
+    }
+
+    std::cout << "test_compact_nodes done" << std::endl;
 }
 
-void benchmark_get()
+void test_prefix_compression()
 {
     std::vector<std::string> keys;
     std::vector<std::string> values;
-    generate_keys_sequence(100000, keys);
-    generate_values_sequence(100000, values);
+    for (uint64_t i = 0; i < 10000; i++)
+    {
+        keys.push_back("tenant_" + std::to_string(i / 1000) + "/region_" + std::to_string(i / 100 % 10) + "/entity_" + std::to_string(i));
+    }
+    std::sort(keys.begin(), keys.end());
+    generate_values_sequence(10000, values);
 
-    KvDb db = KvDb::open("benchmark_get", get_benchmark_config());
+    for (uint64_t with_cache = 0; with_cache < 2; with_cache++)
+    {
+        Config config = get_test_config();
+        config.writer.enable_prefix_compression = true;
+        config.writer.prefix_restart_interval = 5;
+        if (with_cache)
+        {
+            config.internal_node_cache_size = 1 << 16;
+            config.leaf_node_cache_size = 1 << 14;
+        }
+
+        KvDb db = KvDb::open("test_prefix_compression", config);
+        for (uint64_t i = 0; i < keys.size(); i++)
+        {
+            db.add(keys[i], values[i]);
+        }
+        db.flush();
+
+        pbt::PinnedView key;
+        pbt::PinnedView value;
+        for (uint64_t i = 0; i < keys.size(); i++)
+        {
+            if (!db.get(keys[i], value) || value != values[i])
+            {
+                std::cout << "get mismatch" << std::endl;
+                exit(1);
+            }
+            // Missing keys that share all but the last byte with a key
+            if (db.get(keys[i] + "_", value) || db.get(keys[i].substr(0, keys[i].size() - 1) + "/", value))
+            {
+                std::cout << "get found missing key" << std::endl;
+                exit(1);
+            }
+            if (!db.at(i, key, value) || key != keys[i] || value != values[i])
+            {
+                std::cout << "at mismatch" << std::endl;
+                exit(1);
+            }
+        }
+
+        uint64_t i = 0;
+        for (auto it = db.begin(); !it.is_end(); it.next())
+        {
+            if (it.get_key() != keys[i] || it.get_value() != values[i])
+            {
+                std::cout << "iterator mismatch" << std::endl;
+                exit(1);
+            }
+            i++;
+        }
+        if (i != keys.size())
+        {
+            std::cout << "iterator count mismatch" << std::endl;
+            exit(1);
+        }
+
+        for (uint64_t i = 0; i < keys.size(); i += 997)
+        {
+            Iterator it = db.seek(keys[i]);
+            if (it.is_end() || it.get_key() != keys[i] || it.get_value() != values[i])
+            {
+                std::cout << "seek mismatch" << std::endl;
+                exit(1);
+            }
+        }
+    }
+
+    std::cout << "test_prefix_compression done" << std::endl;
+}
+
+void test_lz4_compression()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(10000, keys);
+    std::mt19937_64 rng(0);
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        // Runs of compressible values, and values of random bytes that do not compress, so nodes of both kinds are written
+        std::string value;
+        if (i / 100 % 2 == 0)
+        {
+            value = std::string(i % 200, 'a' + i % 26);
+        }
+        else
+        {
+            for (uint64_t j = 0; j < i % 200; j++)
+            {
+                value.push_back(static_cast<char>(rng()));
+            }
+        }
+        values.push_back(value);
+    }
+
+    for (uint64_t mode = 0; mode < 3; mode++)
+    {
+        Config config = get_test_config();
+        config.writer.enable_lz4_compression = true;
+        config.writer.enable_prefix_compression = mode == 2;
+        if (mode >= 1)
+        {
+            config.internal_node_cache_size = 1 << 16;
+            config.leaf_node_cache_size = 1 << 14;
+        }
+
+        KvDb db = KvDb::open("test_lz4_compression", config);
+        for (uint64_t i = 0; i < keys.size(); i++)
+        {
+            db.add(keys[i], values[i]);
+        }
+        db.flush();
+
+        pbt::PinnedView key;
+        pbt::PinnedView value;
+        for (uint64_t i = 0; i < keys.size(); i++)
+        {
+            if (!db.get(keys[i], value) || value != values[i])
+            {
+                std::cout << "get mismatch" << std::endl;
+                exit(1);
+            }
+            if (!db.at(i, key, value) || key != keys[i] || value != values[i])
+            {
+                std::cout << "at mismatch" << std::endl;
+                exit(1);
+            }
+        }
+
+        uint64_t i = 0;
+        for (auto it = db.begin(); !it.is_end(); it.next())
+        {
+            if (it.get_key() != keys[i] || it.get_value() != values[i])
+            {
+                std::cout << "iterator mismatch" << std::endl;
+                exit(1);
+            }
+            i++;
+        }
+        if (i != keys.size())
+        {
+            std::cout << "iterator count mismatch" << std::endl;
+            exit(1);
+        }
+
+        for (uint64_t i = 0; i < keys.size(); i += 997)
+        {
+            Iterator it = db.seek(keys[i]);
+            if (it.is_end() || it.get_key() != keys[i] || it.get_value() != values[i])
+            {
+                std::cout << "seek mismatch" << std::endl;
+                exit(1);
+            }
+        }
+
+        // Values accumulated by a traversal stay valid while it decompresses further nodes
+        std::vector<std::string_view> accumulator;
+        db.traverse([](std::string_view)
+                    { return true; },
+                    accumulator);
+        std::vector<std::string> sorted_values(values);
+        std::sort(sorted_values.begin(), sorted_values.end());
+        std::vector<std::string> accumulated_values(accumulator.begin(), accumulator.end());
+        std::sort(accumulated_values.begin(), accumulated_values.end());
+        if (accumulated_values != sorted_values)
+        {
+            std::cout << "traverse mismatch" << std::endl;
+            exit(1);
+        }
+    }
+
+    std::cout << "test_lz4_compression done" << std::endl;
+}
+
+void test_key_range_pruning()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(10000, keys);
+    generate_values_sequence(10000, values);
+
+    // Many files with disjoint key ranges
+    Config config = get_test_config();
+    config.max_buffer_size = 1 << 12;
+    config.max_level_count = 100;
+
+    KvDb db = KvDb::open("test_key_range_pruning", config);
     for (uint64_t i = 0; i < keys.size(); i++)
     {
         db.add(keys[i], values[i]);
     }
-    db.compact();
+    db.flush();
 
-    auto t1 = std::chrono::high_resolution_clock::now();
-    std::string_view value;
+    pbt::PinnedView value;
     for (uint64_t i = 0; i < keys.size(); i++)
     {
-        bool found = db.get(keys[i], value);
-        if (!found)
+        if (!db.get(keys[i], value) || value != values[i])
         {
-            std::cout << "not found" << std::endl;
+            std::cout << "get mismatch" << std::endl;
+            exit(1);
+        }
+        if (db.get(keys[i] + "_", value))
+        {
+            std::cout << "get found missing key" << std::endl;
+            exit(1);
         }
     }
-    auto t2 = std::chrono::high_resolution_clock::now();
+    if (db.get("a", value) || db.get("z", value))
+    {
+        std::cout << "get found key out of range" << std::endl;
+        exit(1);
+    }
 
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
-    std::cout << "benchmark_get: " << duration.count() << " μs" << std::endl;
+    for (uint64_t i = 0; i < keys.size(); i += 997)
+    {
+        Iterator it = db.seek(keys[i]);
+        uint64_t count = i;
+        for (; !it.is_end(); it.next())
+        {
+            if (it.get_key() != keys[count])
+            {
+                std::cout << "seek mismatch" << std::endl;
+                exit(1);
+            }
+            count++;
+        }
+        if (count != keys.size())
+        {
+            std::cout << "seek count mismatch" << std::endl;
+            exit(1);
+        }
+    }
+    if (!db.seek("z").is_end())
+    {
+        std::cout << "seek past last key not at end" << std::endl;
+        exit(1);
+    }
+
+    std::cout << "test_key_range_pruning done" << std::endl;
 }
 
-void benchmark_at()
+void test_node_cache()
 {
     std::vector<std::string> keys;
     std::vector<std::string> values;
-    generate_keys_sequence(100000, keys);
-    generate_values_sequence(100000, values);
+    generate_keys_sequence(10000, keys);
+    generate_values_sequence(10000, values);
 
-    KvDb db = KvDb::open("benchmark_at", get_benchmark_config());
+    Config config = get_test_config();
+    config.internal_node_cache_size = 1 << 16;
+    config.leaf_node_cache_size = 1 << 14;
+
+    KvDb db = KvDb::open("test_node_cache", config);
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        db.add(keys[i], values[i]);
+    }
+    db.flush();
+
+    pbt::PinnedView key;
+    pbt::PinnedView value;
+    for (uint64_t n = 0; n < 2; n++)
+    {
+        for (uint64_t i = 0; i < keys.size(); i++)
+        {
+            if (!db.get(keys[i], value) || value != values[i])
+            {
+                std::cout << "get mismatch" << std::endl;
+                exit(1);
+            }
+            if (!db.at(i, key, value) || key != keys[i] || value != values[i])
+            {
+                std::cout << "at mismatch" << std::endl;
+                exit(1);
+            }
+        }
+    }
+
+    auto internal_node_cache = db.get_internal_node_cache();
+    auto leaf_node_cache = db.get_leaf_node_cache();
+    if (internal_node_cache->get_num_hits() == 0 || leaf_node_cache->get_num_hits() == 0 || leaf_node_cache->get_num_misses() == 0)
+    {
+        std::cout << "cache not used" << std::endl;
+        exit(1);
+    }
+    if (leaf_node_cache->get_size() > leaf_node_cache->get_capacity())
+    {
+        std::cout << "cache over capacity" << std::endl;
+        exit(1);
+    }
+
+    std::cout << "test_node_cache done" << std::endl;
+}
+
+void test_explicit_reads()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(10000, keys);
+    generate_values_sequence(10000, values);
+    for (uint64_t i = 0; i < values.size(); i += 7)
+    {
+        // Values that make some leaf nodes larger than a read block
+        values[i].append(1000, 'a' + i % 26);
+    }
+
+    for (uint64_t mode = 0; mode < 3; mode++)
+    {
+        Config config = get_test_config();
+        config.enable_mmap_reads = false;
+        config.writer.enable_lz4_compression = mode == 2;
+        config.writer.enable_prefix_compression = mode == 2;
+        if (mode >= 1)
+        {
+            config.internal_node_cache_size = 1 << 16;
+            config.leaf_node_cache_size = 1 << 14;
+        }
+
+        KvDb db = KvDb::open("test_explicit_reads", config);
+        for (uint64_t i = 0; i < keys.size(); i++)
+        {
+            db.add(keys[i], values[i]);
+        }
+        db.flush();
+        // Merges read the files being merged with explicit reads as well
+        db.compact();
+
+        pbt::PinnedView key;
+        pbt::PinnedView value;
+        for (uint64_t i = 0; i < keys.size(); i++)
+        {
+            if (!db.get(keys[i], value) || value != values[i])
+            {
+                std::cout << "get mismatch" << std::endl;
+                exit(1);
+            }
+            if (!db.at(i, key, value) || key != keys[i] || value != values[i])
+            {
+                std::cout << "at mismatch" << std::endl;
+                exit(1);
+            }
+        }
+
+        uint64_t i = 0;
+        for (auto it = db.begin(); !it.is_end(); it.next())
+        {
+            if (it.get_key() != keys[i] || it.get_value() != values[i])
+            {
+                std::cout << "iterator mismatch" << std::endl;
+                exit(1);
+            }
+            i++;
+        }
+        if (i != keys.size())
+        {
+            std::cout << "iterator count mismatch" << std::endl;
+            exit(1);
+        }
+
+        std::vector<std::string_view> accumulator;
+        db.traverse([](std::string_view)
+                    { return true; },
+                    accumulator);
+        std::vector<std::string> sorted_values(values);
+        std::sort(sorted_values.begin(), sorted_values.end());
+        std::vector<std::string> accumulated_values(accumulator.begin(), accumulator.end());
+        std::sort(accumulated_values.begin(), accumulated_values.end());
+        if (accumulated_values != sorted_values)
+        {
+            std::cout << "traverse mismatch" << std::endl;
+            exit(1);
+        }
+
+        auto io_stats = db.get_io_stats();
+        if (io_stats == nullptr || io_stats->get_num_reads() == 0 || io_stats->get_num_bytes_read() < io_stats->get_num_reads())
+        {
+            std::cout << "reads not counted" << std::endl;
+            exit(1);
+        }
+    }
+
+    std::cout << "test_explicit_reads done" << std::endl;
+}
+
+void test_pin_internal_nodes()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(10000, keys);
+    generate_values_sequence(10000, values);
+
+    Config config = get_test_config();
+    config.pin_internal_nodes = true;
+
+    KvDb db = KvDb::open("test_pin_internal_nodes", config);
+    if (db.get_pinned_size() != 0)
+    {
+        std::cout << "pinned size of empty db" << std::endl;
+        exit(1);
+    }
     for (uint64_t i = 0; i < keys.size(); i++)
     {
         db.add(keys[i], values[i]);
     }
+    db.flush();
+    uint64_t flushed_pinned_size = db.get_pinned_size();
     db.compact();
+    if (flushed_pinned_size == 0 || db.get_pinned_size() == 0)
+    {
+        std::cout << "internal nodes not pinned" << std::endl;
+        exit(1);
+    }
 
-    auto t1 = std::chrono::high_resolution_clock::now();
-    std::string_view key;
-    std::string_view value;
+    pbt::PinnedView value;
     for (uint64_t i = 0; i < keys.size(); i++)
     {
-        bool found = db.at(i, key, value);
-        if (!found)
+        if (!db.get(keys[i], value) || value != values[i])
         {
-            std::cout << "not found" << std::endl;
+            std::cout << "get mismatch" << std::endl;
+            exit(1);
+        }
+    }
+
+    std::cout << "test_pin_internal_nodes done" << std::endl;
+}
+
+void test_read_your_writes()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(1000, keys);
+    generate_values_sequence(1000, values);
+
+    Config config = get_test_config();
+    config.max_buffer_size = 1 << 24;
+    KvDb db = KvDb::open("test_read_your_writes", config);
+    for (uint64_t i = 0; i < keys.size() / 2; i++)
+    {
+        db.add(keys[i], values[i]);
+    }
+    db.flush();
+    for (uint64_t i = keys.size() / 2; i < keys.size(); i++)
+    {
+        db.add(keys[i], values[i]);
+    }
+
+    pbt::PinnedView key;
+    pbt::PinnedView value;
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        if (!db.get(keys[i], value) || value != values[i])
+        {
+            std::cout << "get mismatch" << std::endl;
+            exit(1);
+        }
+        if (!db.at(i, key, value) || key != keys[i] || value != values[i])
+        {
+            std::cout << "at mismatch" << std::endl;
+            exit(1);
+        }
+    }
+
+    Iterator it = db.seek(keys[keys.size() / 4]);
+    uint64_t count = keys.size() / 4;
+    while (!it.is_end())
+    {
+        if (it.get_key() != keys[count] || it.get_value() != values[count])
+        {
+            std::cout << "iterator mismatch" << std::endl;
+            exit(1);
+        }
+        it.next();
+        count++;
+    }
+
+    if (count != keys.size())
+    {
+        std::cout << "count mismatch" << std::endl;
+        exit(1);
+    }
+
+    std::cout << "test_read_your_writes done" << std::endl;
+}
+
+void test_buffer_index()
+{
+    std::vector<std::string> keys;
+    generate_keys_sequence(10000, keys);
+
+    // Each key is added twice in scattered order, so the links of the skip list are spliced all over
+    uint64_t num_entries = keys.size() * 2;
+    detail::Buffer buffer;
+    std::vector<std::pair<std::string, std::string>> entries;
+    for (uint64_t i = 0; i < num_entries; i++)
+    {
+        uint64_t j = i * 7919 % num_entries;
+        buffer.insert(keys[j / 2], std::to_string(j));
+        entries.push_back({keys[j / 2], std::to_string(j)});
+    }
+    std::vector<std::pair<std::string, std::string>> half_entries(entries.begin(), entries.begin() + num_entries / 2);
+    // Entries with equal keys stay in the order they were added
+    std::stable_sort(entries.begin(), entries.end(), [](const auto &a, const auto &b)
+                     { return a.first < b.first; });
+    std::stable_sort(half_entries.begin(), half_entries.end(), [](const auto &a, const auto &b)
+                     { return a.first < b.first; });
+
+    std::string_view key;
+    std::string_view value;
+    for (uint64_t i = 0; i < entries.size(); i++)
+    {
+        if (!buffer.at(i, key, value) || key != entries[i].first || value != entries[i].second)
+        {
+            std::cout << "at mismatch" << std::endl;
+            exit(1);
+        }
+    }
+    if (buffer.at(entries.size(), key, value))
+    {
+        std::cout << "at out of bounds" << std::endl;
+        exit(1);
+    }
+
+    uint64_t count = entries.size() / 3;
+    for (detail::BufferIterator it = buffer.seek(count); !it.is_end(); it.next())
+    {
+        if (it.get_key() != entries[count].first || it.get_value() != entries[count].second)
+        {
+            std::cout << "iterator mismatch" << std::endl;
+            exit(1);
+        }
+        count++;
+    }
+    if (count != entries.size())
+    {
+        std::cout << "count mismatch" << std::endl;
+        exit(1);
+    }
+
+    // Entries that were added later are skipped when reading the buffer as it was
+    for (uint64_t i = 0; i < half_entries.size(); i += 7)
+    {
+        if (!buffer.at(i, key, value, num_entries / 2) || key != half_entries[i].first || value != half_entries[i].second)
+        {
+            std::cout << "at mismatch with limit" << std::endl;
+            exit(1);
+        }
+    }
+
+    std::cout << "test_buffer_index done" << std::endl;
+}
+
+void test_background_flush()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(10000, keys);
+    generate_values_sequence(10000, values);
+
+    Config config = get_test_config();
+    config.max_buffer_size = 1 << 12;
+    KvDb db = KvDb::open("test_background_flush", config);
+
+    pbt::PinnedView key;
+    pbt::PinnedView value;
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        db.add(keys[i], values[i]);
+
+        if (!db.get(keys[i], value) || value != values[i])
+        {
+            std::cout << "get mismatch" << std::endl;
+            exit(1);
+        }
+        if (!db.at(i, key, value) || key != keys[i])
+        {
+            std::cout << "at mismatch" << std::endl;
+            exit(1);
+        }
+    }
+    db.flush();
+
+    uint64_t count = 0;
+    for (Iterator it = db.begin(); !it.is_end(); it.next())
+    {
+        if (it.get_key() != keys[count] || it.get_value() != values[count])
+        {
+            std::cout << "iterator mismatch" << std::endl;
+            exit(1);
+        }
+        count++;
+    }
+
+    if (count != keys.size())
+    {
+        std::cout << "count mismatch" << std::endl;
+        exit(1);
+    }
+
+    std::cout << "test_background_flush done" << std::endl;
+}
+
+void test_compaction_threads()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(20000, keys);
+    generate_values_sequence(20000, values);
+
+    Config config = get_test_config();
+    config.max_buffer_size = 1 << 12;
+    config.num_compaction_threads = 4;
+
+    {
+        KvDb db = KvDb::open("test_compaction_threads", config);
+
+        pbt::PinnedView key;
+        pbt::PinnedView value;
+        for (uint64_t i = 0; i < keys.size(); i++)
+        {
+            db.add(keys[i], values[i]);
+
+            uint64_t j = (i * 7919) % (i + 1);
+            if (!db.at(j, key, value) || key != keys[j] || value != values[j])
+            {
+                std::cout << "at mismatch" << std::endl;
+                exit(1);
+            }
+        }
+        db.wait_for_compactions();
+        db.flush();
+    }
+
+    KvDb db = KvDb::open("test_compaction_threads", get_test_config(false));
+    pbt::PinnedView value;
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        if (!db.get(keys[i], value) || value != values[i])
+        {
+            std::cout << "get mismatch" << std::endl;
+            exit(1);
+        }
+    }
+
+    std::cout << "test_compaction_threads done" << std::endl;
+}
+
+void test_sub_compactions()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(20000, keys);
+    generate_values_sequence(20000, values);
+
+    // Shuffled keys make the files of each merge overlap, so the merges are split into key ranges
+    std::vector<uint64_t> order(keys.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), std::mt19937_64(0));
+
+    Config config = get_test_config();
+    config.max_buffer_size = 1 << 12;
+    config.num_sub_compactions = 4;
+
+    KvDb db = KvDb::open("test_sub_compactions", config);
+    for (uint64_t i : order)
+    {
+        db.add(keys[i], values[i]);
+    }
+    db.compact();
+
+    pbt::PinnedView key;
+    pbt::PinnedView value;
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        if (!db.at(i, key, value) || key != keys[i] || value != values[i])
+        {
+            std::cout << "at mismatch" << std::endl;
+            exit(1);
+        }
+        if (!db.get(keys[i], value) || value != values[i])
+        {
+            std::cout << "get mismatch" << std::endl;
+            exit(1);
+        }
+    }
+
+    for (const auto &entry : std::filesystem::directory_iterator("test_sub_compactions"))
+    {
+        if (entry.path().string().find(".part") != std::string::npos)
+        {
+            std::cout << "temporary file left: " << entry.path() << std::endl;
+            exit(1);
+        }
+    }
+
+    std::cout << "test_sub_compactions done" << std::endl;
+}
+
+void test_reopen_after_interrupted_merge()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(10000, keys);
+    generate_values_sequence(10000, values);
+
+    {
+        KvDb db = KvDb::open("test_reopen_after_interrupted_merge", get_test_config());
+        for (uint64_t i = 0; i < keys.size(); i++)
+        {
+            db.add(keys[i], values[i]);
+        }
+        db.flush();
+    }
+
+    // Leave behind the temporary files of a merge split into key ranges, one finished and one cut short
+    std::filesystem::path file_path = std::filesystem::directory_iterator("test_reopen_after_interrupted_merge")->path();
+    std::filesystem::copy_file(file_path, file_path.string() + ".part0");
+    std::filesystem::copy_file(file_path, file_path.string() + ".part1");
+    std::filesystem::resize_file(file_path.string() + ".part1", 10);
+
+    KvDb db = KvDb::open("test_reopen_after_interrupted_merge", get_test_config(false));
+    pbt::PinnedView value;
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        if (!db.get(keys[i], value) || value != values[i])
+        {
+            std::cout << "get mismatch" << std::endl;
+            exit(1);
+        }
+    }
+
+    for (const auto &entry : std::filesystem::directory_iterator("test_reopen_after_interrupted_merge"))
+    {
+        if (entry.path().string().find(".part") != std::string::npos)
+        {
+            std::cout << "temporary file left: " << entry.path() << std::endl;
+            exit(1);
+        }
+    }
+
+    std::cout << "test_reopen_after_interrupted_merge done" << std::endl;
+}
+
+void test_concurrent_readers()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(20000, keys);
+    generate_values_sequence(20000, values);
+
+    Config config = get_test_config();
+    config.max_buffer_size = 1 << 12;
+    config.num_compaction_threads = 2;
+    config.internal_node_cache_size = 1 << 14;
+    config.leaf_node_cache_size = 1 << 14;
+    KvDb db = KvDb::open("test_concurrent_readers", config);
+
+    std::atomic<uint64_t> num_added = 0;
+    std::atomic<bool> failed = false;
+    std::vector<std::thread> threads;
+    for (uint64_t t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&, t]()
+                             {
+                                 std::string key;
+                                 std::string value;
+                                 uint64_t i = t;
+                                 while (num_added.load() < keys.size() && !failed.load())
+                                 {
+                                     uint64_t n = num_added.load();
+                                     if (n == 0)
+                                     {
+                                         continue;
+                                     }
+                                     i = (i * 7919 + 1) % n;
+                                     if (!db.get(keys[i], value) || value != values[i])
+                                     {
+                                         failed = true;
+                                     }
+                                     if (!db.at(i, key, value) || key != keys[i])
+                                     {
+                                         failed = true;
+                                     }
+                                 } });
+    }
+
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        db.add(keys[i], values[i]);
+        num_added++;
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    if (failed)
+    {
+        std::cout << "concurrent read mismatch" << std::endl;
+        exit(1);
+    }
+
+    std::cout << "test_concurrent_readers done" << std::endl;
+}
+
+void test_snapshot()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(2000, keys);
+    generate_values_sequence(2000, values);
+
+    Config config = get_test_config();
+    config.max_buffer_size = 1 << 10;
+
+    KvDb db = KvDb::open("test_snapshot", config);
+    for (uint64_t i = 0; i < keys.size() / 2; i++)
+    {
+        db.add(keys[i], values[i]);
+    }
+
+    // Includes entries still in the write buffer
+    Snapshot snapshot = db.snapshot();
+    Iterator it = db.begin();
+
+    for (uint64_t i = keys.size() / 2; i < keys.size(); i++)
+    {
+        db.add(keys[i], values[i]);
+    }
+    db.compact();
+
+    if (snapshot.count() != keys.size() / 2)
+    {
+        std::cout << "count mismatch" << std::endl;
+        exit(1);
+    }
+    pbt::PinnedView key;
+    pbt::PinnedView value;
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        bool expected = i < keys.size() / 2;
+        if (snapshot.get(keys[i], value) != expected || (expected && value != values[i]))
+        {
+            std::cout << "get mismatch" << std::endl;
+            exit(1);
+        }
+        if (snapshot.at(i, key, value) != expected || (expected && (key != keys[i] || value != values[i])))
+        {
+            std::cout << "at mismatch" << std::endl;
+            exit(1);
+        }
+    }
+    for (uint64_t i = 0; i < keys.size() / 2; i++)
+    {
+        if (it.is_end() || it.get_key() != keys[i] || it.get_value() != values[i])
+        {
+            std::cout << "iterator mismatch" << std::endl;
+            exit(1);
+        }
+        it.next();
+    }
+    if (!it.is_end())
+    {
+        std::cout << "iterator not at end" << std::endl;
+        exit(1);
+    }
+
+    // Merged files are removed once the last snapshot referencing them is gone
+    snapshot = db.snapshot();
+    it = db.begin();
+    db.flush();
+    uint64_t num_files = std::distance(std::filesystem::directory_iterator("test_snapshot"), std::filesystem::directory_iterator());
+    if (num_files != 1)
+    {
+        std::cout << "merged files not removed" << std::endl;
+        exit(1);
+    }
+
+    std::cout << "test_snapshot done" << std::endl;
+}
+
+void benchmark_add()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(100000, keys);
+    generate_values_sequence(100000, values);
+
+    KvDb db = KvDb::open("benchmark_add", get_benchmark_config());
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        db.add(keys[i], values[i]);
+    }
+    db.compact();
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
+    std::cout << "benchmark_add: " << duration.count() << " μs" << std::endl;
+}
+
+void benchmark_add_latency()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(1000000, keys);
+    generate_values_sequence(1000000, values);
+
+    Config config = get_benchmark_config();
+    config.max_buffer_size = 1 << 20;
+    KvDb db = KvDb::open("benchmark_add_latency", config);
+
+    std::vector<uint64_t> latencies;
+    latencies.reserve(keys.size());
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        auto t1 = std::chrono::high_resolution_clock::now();
+        db.add(keys[i], values[i]);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count());
+    }
+    db.flush();
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "benchmark_add_latency: p50 " << latencies[latencies.size() / 2] << " ns, p99 " << latencies[latencies.size() * 99 / 100] << " ns, max " << latencies.back() << " ns" << std::endl;
+}
+
+void benchmark_get()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(100000, keys);
+    generate_values_sequence(100000, values);
+
+    KvDb db = KvDb::open("benchmark_get", get_benchmark_config());
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        db.add(keys[i], values[i]);
+    }
+    db.compact();
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    pbt::PinnedView value;
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        bool found = db.get(keys[i], value);
+        if (!found)
+        {
+            std::cout << "not found" << std::endl;
+        }
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
+    std::cout << "benchmark_get: " << duration.count() << " μs" << std::endl;
+}
+
+void benchmark_get_missing(uint64_t bloom_filter_bits_per_key)
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(100000, keys);
+    generate_values_sequence(100000, values);
+
+    Config config = get_benchmark_config();
+    config.max_buffer_size = 1 << 18;
+    config.writer.bloom_filter_bits_per_key = bloom_filter_bits_per_key;
+    KvDb db = KvDb::open("benchmark_get_missing", config);
+    // Random order, so that the key ranges of the files overlap
+    std::vector<uint64_t> order(keys.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), std::mt19937(0));
+    for (uint64_t i : order)
+    {
+        db.add(keys[i], values[i]);
+    }
+    db.flush();
+
+    std::vector<std::string> missing_keys;
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        missing_keys.push_back(keys[i] + "_");
+    }
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    pbt::PinnedView value;
+    for (uint64_t i = 0; i < missing_keys.size(); i++)
+    {
+        bool found = db.get(missing_keys[i], value);
+        if (found)
+        {
+            std::cout << "found" << std::endl;
+        }
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
+    std::cout << "benchmark_get_missing (" << bloom_filter_bits_per_key << " bits per key): " << duration.count() << " μs" << std::endl;
+}
+
+void benchmark_get_concurrent()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(100000, keys);
+    generate_values_sequence(100000, values);
+
+    KvDb db = KvDb::open("benchmark_get_concurrent", get_benchmark_config());
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        db.add(keys[i], values[i]);
+    }
+    db.compact();
+
+    uint64_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+    auto t1 = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    for (uint64_t t = 0; t < num_threads; t++)
+    {
+        threads.emplace_back([&]()
+                             {
+                                 pbt::PinnedView value;
+                                 for (uint64_t i = 0; i < keys.size(); i++)
+                                 {
+                                     if (!db.get(keys[i], value))
+                                     {
+                                         std::cout << "not found" << std::endl;
+                                     }
+                                 } });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
+    std::cout << "benchmark_get_concurrent (" << num_threads << " threads): " << duration.count() << " μs" << std::endl;
+}
+
+void benchmark_at()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(100000, keys);
+    generate_values_sequence(100000, values);
+
+    KvDb db = KvDb::open("benchmark_at", get_benchmark_config());
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        db.add(keys[i], values[i]);
+    }
+    db.compact();
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    pbt::PinnedView key;
+    pbt::PinnedView value;
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        bool found = db.at(i, key, value);
+        if (!found)
+        {
+            std::cout << "not found" << std::endl;
         }
     }
     auto t2 = std::chrono::high_resolution_clock::now();
@@ -448,6 +1574,95 @@ void benchmark_at()
     std::cout << "benchmark_at: " << duration.count() << " μs" << std::endl;
 }
 
+void benchmark_at_many_files()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(200000, keys);
+    generate_values_sequence(200000, values);
+
+    // Small buffers and no merges leave the entries spread over hundreds of files
+    Config config = get_benchmark_config();
+    config.max_buffer_size = 1 << 14;
+    config.max_level_count = 1000;
+    KvDb db = KvDb::open("benchmark_at_many_files", config);
+    for (uint64_t i = 0; i < keys.size(); i++)
+    {
+        db.add(keys[i], values[i]);
+    }
+    db.flush();
+
+    std::vector<uint64_t> indices(keys.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    std::shuffle(indices.begin(), indices.end(), std::mt19937_64(0));
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    pbt::PinnedView key;
+    pbt::PinnedView value;
+    for (uint64_t i : indices)
+    {
+        if (!db.at(i, key, value) || key != keys[i])
+        {
+            std::cout << "at mismatch" << std::endl;
+            exit(1);
+        }
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    for (uint64_t i = 0; i < keys.size(); i += 1000)
+    {
+        Iterator it = db.seek(i);
+        if (it.is_end() || it.get_key() != keys[i])
+        {
+            std::cout << "seek mismatch" << std::endl;
+            exit(1);
+        }
+    }
+    auto t3 = std::chrono::high_resolution_clock::now();
+
+    auto at_duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
+    auto seek_duration = std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2);
+    std::cout << "benchmark_at_many_files: at " << at_duration.count() << " μs, seek " << seek_duration.count() << " μs" << std::endl;
+}
+
+void benchmark_iterator_merge(uint64_t num_files)
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(1000000, keys);
+    generate_values_sequence(1000000, values);
+
+    // Interleave the keys over the files, so the merge switches files at every step
+    std::vector<std::shared_ptr<pbt::Reader>> readers;
+    for (uint64_t f = 0; f < num_files; f++)
+    {
+        std::string file_path = "benchmark_iterator_merge_" + std::to_string(f) + ".pbt";
+        pbt::Writer writer(0, file_path, pbt::WriterConfig());
+        for (uint64_t i = f; i < keys.size(); i += num_files)
+        {
+            writer.add(keys[i], values[i]);
+        }
+        writer.finish();
+        readers.push_back(std::make_shared<pbt::Reader>(writer.to_reader()));
+    }
+
+    std::vector<pbt::Iterator> itrs;
+    for (auto &reader : readers)
+    {
+        itrs.push_back(reader->begin());
+    }
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    uint64_t count = 0;
+    for (Iterator it(std::move(itrs)); !it.is_end(); it.next())
+    {
+        count += it.get_key().size() + it.get_value().size();
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
+    std::cout << "benchmark_iterator_merge (" << num_files << " files): " << duration.count() << " μs" << (count == 0 ? " " : "") << std::endl;
+}
+
 void benchmark_iterator()
 {
     std::vector<std::string> keys;
@@ -492,13 +1707,37 @@ int main()
     test_iterator_begin();
     test_iterator_seek_key();
     test_iterator_seek_index();
+    test_iterator_merge_order();
     test_iterator_end();
     test_reopen();
+    test_compact_nodes();
+    test_prefix_compression();
+    test_lz4_compression();
+    test_key_range_pruning();
+    test_node_cache();
+    test_explicit_reads();
+    test_pin_internal_nodes();
+    test_read_your_writes();
+    test_buffer_index();
+    test_background_flush();
+    test_compaction_threads();
+    test_sub_compactions();
+    test_reopen_after_interrupted_merge();
+    test_concurrent_readers();
+    test_snapshot();
 
     benchmark_add();
+    benchmark_add_latency();
     benchmark_get();
+    benchmark_get_missing(0);
+    benchmark_get_missing(10);
+    benchmark_get_concurrent();
     benchmark_at();
+    benchmark_at_many_files();
     benchmark_iterator();
+    benchmark_iterator_merge(2);
+    benchmark_iterator_merge(10);
+    benchmark_iterator_merge(50);
 
     return 0;
 }
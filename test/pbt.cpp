@@ -1,9 +1,12 @@
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
 #include <functional>
+#include <iterator>
 #include <memory>
+#include <numeric>
 #include <random>
 #include <string>
 #include <vector>
@@ -95,9 +98,9 @@ void test_merge()
     std::string file_path_1 = "test_merge_1.pbt";
     std::string file_path_2 = "test_merge_2.pbt";
     std::string file_path_3 = "test_merge_3.pbt";
-    pbt::Writer writer_1(file_path_1, get_writer_config());
-    pbt::Writer writer_2(file_path_2, get_writer_config());
-    pbt::Writer writer_3(file_path_3, get_writer_config());
+    pbt::Writer writer_1(0, file_path_1, get_writer_config());
+    pbt::Writer writer_2(0, file_path_2, get_writer_config());
+    pbt::Writer writer_3(0, file_path_3, get_writer_config());
 
     write_key_value_pairs(writer_1, keys_0, values);
     write_key_value_pairs(writer_2, keys_1, values);
@@ -112,42 +115,42 @@ void test_merge()
 
     for (int i = 0; i < keys_0.size(); i++)
     {
-        std::string_view value_0;
-        std::string_view value_1;
+        pbt::PinnedView value_0;
+        pbt::PinnedView value_1;
 
         reader_3.get(keys_0[i], value_0);
         reader_3.get(keys_1[i], value_1);
 
         if (value_0 != values[i])
         {
-            std::cout << "value mismatch: " << keys_0[i] << " " << value_0 << " " << values[i] << std::endl;
+            std::cout << "value mismatch: " << keys_0[i] << " " << value_0.get() << " " << values[i] << std::endl;
             exit(1);
         }
         if (value_1 != values[i])
         {
-            std::cout << "value mismatch: " << keys_1[i] << " " << value_1 << " " << values[i] << std::endl;
+            std::cout << "value mismatch: " << keys_1[i] << " " << value_1.get() << " " << values[i] << std::endl;
             exit(1);
         }
     }
 
     for (int i = 0; i < keys_0.size(); i++)
     {
-        std::string key_0;
-        std::string key_1;
-        std::string_view value_0;
-        std::string_view value_1;
+        pbt::PinnedView key_0;
+        pbt::PinnedView key_1;
+        pbt::PinnedView value_0;
+        pbt::PinnedView value_1;
 
         reader_3.at(2 * i, key_0, value_0);
         reader_3.at(2 * i + 1, key_1, value_1);
 
         if (key_0 != keys_0[i])
         {
-            std::cout << "key mismatch: " << key_0 << " " << keys_0[i] << std::endl;
+            std::cout << "key mismatch: " << key_0.get() << " " << keys_0[i] << std::endl;
             exit(1);
         }
         if (key_1 != keys_1[i])
         {
-            std::cout << "key mismatch: " << key_1 << " " << keys_1[i] << std::endl;
+            std::cout << "key mismatch: " << key_1.get() << " " << keys_1[i] << std::endl;
             exit(1);
         }
     }
@@ -155,6 +158,671 @@ void test_merge()
     std::cout << "test_merge done" << std::endl;
 }
 
+void test_merge_leaf_runs()
+{
+    // Inputs with runs of keys that do not overlap with the other inputs, so their leaf nodes are taken over as a whole
+    auto make_key = [](int i)
+    {
+        std::string digits = std::to_string(i);
+        return "key_" + std::string(6 - digits.size(), '0') + digits;
+    };
+    std::vector<std::vector<int>> inputs = {{}, {}, {}, {}};
+    for (int i = 0; i < 1000; i++)
+    {
+        inputs[0].push_back(i);
+    }
+    for (int i = 1000; i < 2037; i++)
+    {
+        inputs[1].push_back(i);
+    }
+    for (int i = 501; i < 1500; i += 2)
+    {
+        inputs[2].push_back(i);
+    }
+    for (int i = 3000; i < 3100; i++)
+    {
+        inputs[2].push_back(i);
+        inputs[2].push_back(i);
+    }
+
+    for (int variant = 0; variant < 5; variant++)
+    {
+        pbt::WriterConfig config = get_writer_config();
+        config.enable_compact_nodes = variant != 1;
+        config.enable_prefix_compression = variant == 2;
+        config.enable_lz4_compression = variant == 3;
+
+        std::vector<std::pair<std::string, std::string>> entries;
+        std::vector<std::shared_ptr<pbt::Reader>> readers;
+        for (int f = 0; f < inputs.size(); f++)
+        {
+            // In the last variant, the inputs have smaller nodes than the output, so their leaf nodes do not line up
+            pbt::WriterConfig input_config = config;
+            input_config.max_node_children = variant == 4 ? 8 : config.max_node_children;
+
+            pbt::Writer writer(0, "test_merge_leaf_runs_" + std::to_string(f) + ".pbt", input_config);
+            for (int j = 0; j < inputs[f].size(); j++)
+            {
+                std::string value = std::to_string(f) + "_" + std::to_string(j);
+                writer.add(make_key(inputs[f][j]), value);
+                entries.push_back(std::make_pair(make_key(inputs[f][j]), value));
+            }
+            writer.finish();
+            readers.push_back(std::make_shared<pbt::Reader>(writer.to_reader(get_reader_config())));
+        }
+        std::stable_sort(entries.begin(), entries.end(), [](const auto &a, const auto &b)
+                         { return a.first < b.first; });
+
+        pbt::Writer writer(0, "test_merge_leaf_runs.pbt", config);
+        writer.merge(readers);
+        writer.finish();
+        pbt::Reader reader = writer.to_reader(get_reader_config());
+
+        if (reader.count() != entries.size())
+        {
+            std::cout << "count mismatch: " << variant << " " << reader.count() << " " << entries.size() << std::endl;
+            exit(1);
+        }
+
+        uint64_t i = 0;
+        for (auto itr = reader.begin(); !itr.is_end(); itr.next())
+        {
+            if (itr.get_key() != entries[i].first || itr.get_value() != entries[i].second)
+            {
+                std::cout << "iterator mismatch: " << variant << " " << itr.get_key() << " " << entries[i].first << std::endl;
+                exit(1);
+            }
+            i++;
+        }
+
+        pbt::PinnedView key;
+        pbt::PinnedView value;
+        for (i = 0; i < entries.size(); i++)
+        {
+            if (!reader.at(i, key, value) || key != entries[i].first || value != entries[i].second)
+            {
+                std::cout << "at mismatch: " << variant << " " << i << std::endl;
+                exit(1);
+            }
+            if (i == 0 || entries[i - 1].first != entries[i].first)
+            {
+                if (!reader.get(entries[i].first, value) || value != entries[i].second)
+                {
+                    std::cout << "get mismatch: " << variant << " " << entries[i].first << std::endl;
+                    exit(1);
+                }
+            }
+        }
+        if (reader.get(make_key(2500), value))
+        {
+            std::cout << "get found missing key: " << variant << std::endl;
+            exit(1);
+        }
+    }
+
+    std::cout << "test_merge_leaf_runs done" << std::endl;
+}
+
+void test_concatenate()
+{
+    // Inputs with key ranges that do not overlap, whose sizes are not multiples of the number of node children
+    auto make_key = [](int i)
+    {
+        std::string digits = std::to_string(i);
+        return "key_" + std::string(6 - digits.size(), '0') + digits;
+    };
+    std::vector<std::pair<int, int>> ranges = {{0, 1000}, {1000, 1037}, {2000, 2001}, {2001, 2001}, {3000, 3500}, {4000, 6000}};
+
+    for (int variant = 0; variant < 7; variant++)
+    {
+        pbt::WriterConfig config = get_writer_config();
+        config.enable_compact_nodes = variant != 1;
+        config.enable_prefix_compression = variant == 2;
+        config.enable_lz4_compression = variant == 3;
+
+        std::vector<std::pair<std::string, std::string>> entries;
+        std::vector<std::shared_ptr<pbt::Reader>> readers;
+        for (int f = 0; f < ranges.size(); f++)
+        {
+            // Inputs with smaller or larger nodes than the output, and an input with a node layout whose leaf nodes cannot be copied
+            pbt::WriterConfig input_config = config;
+            input_config.max_node_children = variant == 4 ? 8 : variant == 5 ? 256 : config.max_node_children;
+            input_config.enable_lz4_compression = variant == 6 && f == 4 ? true : config.enable_lz4_compression;
+
+            pbt::Writer writer(0, "test_concatenate_" + std::to_string(f) + ".pbt", input_config);
+            for (int i = ranges[f].first; i < ranges[f].second; i++)
+            {
+                std::string value = "value_" + std::to_string(i);
+                writer.add(make_key(i), value);
+                entries.push_back(std::make_pair(make_key(i), value));
+            }
+            writer.finish();
+            readers.push_back(std::make_shared<pbt::Reader>(writer.to_reader(get_reader_config())));
+        }
+
+        pbt::Writer writer(0, "test_concatenate.pbt", config);
+        writer.concatenate(readers);
+        writer.finish();
+        pbt::Reader reader = writer.to_reader(get_reader_config());
+
+        if (reader.count() != entries.size())
+        {
+            std::cout << "count mismatch: " << variant << " " << reader.count() << " " << entries.size() << std::endl;
+            exit(1);
+        }
+
+        uint64_t i = 0;
+        for (auto itr = reader.begin(); !itr.is_end(); itr.next())
+        {
+            if (itr.get_key() != entries[i].first || itr.get_value() != entries[i].second)
+            {
+                std::cout << "iterator mismatch: " << variant << " " << itr.get_key() << " " << entries[i].first << std::endl;
+                exit(1);
+            }
+            i++;
+        }
+
+        pbt::PinnedView key;
+        pbt::PinnedView value;
+        for (i = 0; i < entries.size(); i++)
+        {
+            if (!reader.at(i, key, value) || key != entries[i].first || value != entries[i].second)
+            {
+                std::cout << "at mismatch: " << variant << " " << i << std::endl;
+                exit(1);
+            }
+            if (!reader.get(entries[i].first, value) || value != entries[i].second)
+            {
+                std::cout << "get mismatch: " << variant << " " << entries[i].first << std::endl;
+                exit(1);
+            }
+            if (i % 97 == 0)
+            {
+                auto itr_index = reader.seek(i);
+                auto itr_key = reader.seek_first(entries[i].first);
+                if (itr_index.is_end() || itr_index.get_key() != entries[i].first || itr_key.is_end() || itr_key.get_key() != entries[i].first)
+                {
+                    std::cout << "seek mismatch: " << variant << " " << i << std::endl;
+                    exit(1);
+                }
+            }
+        }
+        if (reader.get(make_key(2500), value))
+        {
+            std::cout << "get found missing key: " << variant << std::endl;
+            exit(1);
+        }
+    }
+
+    // Inputs whose key ranges overlap cannot be concatenated
+    pbt::Writer writer_1(0, "test_concatenate_1.pbt", get_writer_config());
+    pbt::Writer writer_2(0, "test_concatenate_2.pbt", get_writer_config());
+    writer_1.add(make_key(0), "value");
+    writer_1.add(make_key(2), "value");
+    writer_2.add(make_key(2), "value");
+    writer_1.finish();
+    writer_2.finish();
+    std::vector<std::shared_ptr<pbt::Reader>> readers{
+        std::make_shared<pbt::Reader>(writer_1.to_reader(get_reader_config())),
+        std::make_shared<pbt::Reader>(writer_2.to_reader(get_reader_config()))};
+    pbt::Writer writer(0, "test_concatenate.pbt", get_writer_config());
+    bool has_thrown = false;
+    try
+    {
+        writer.concatenate(readers);
+    }
+    catch (const std::runtime_error &)
+    {
+        has_thrown = true;
+    }
+    if (!has_thrown)
+    {
+        std::cout << "concatenate accepted overlapping key ranges" << std::endl;
+        exit(1);
+    }
+
+    std::cout << "test_concatenate done" << std::endl;
+}
+
+void test_merge_parallel()
+{
+    // Overlapping inputs with duplicate keys, which must stay in the order of the inputs across the key ranges
+    auto make_key = [](int i)
+    {
+        std::string digits = std::to_string(i);
+        return "key_" + std::string(6 - digits.size(), '0') + digits;
+    };
+
+    for (uint64_t num_parts : {1, 2, 3, 8, 64})
+    {
+        std::vector<std::pair<std::string, std::string>> entries;
+        std::vector<std::shared_ptr<pbt::Reader>> readers;
+        for (int f = 0; f < 5; f++)
+        {
+            pbt::Writer writer(0, "test_merge_parallel_" + std::to_string(f) + ".pbt", get_writer_config());
+            for (int i = f * 1000; i < 20000; i += f + 1)
+            {
+                std::string value = std::to_string(f) + "_" + std::to_string(i);
+                writer.add(make_key(i / 3), value);
+                entries.push_back(std::make_pair(make_key(i / 3), value));
+            }
+            writer.finish();
+            readers.push_back(std::make_shared<pbt::Reader>(writer.to_reader(get_reader_config())));
+        }
+        std::stable_sort(entries.begin(), entries.end(), [](const auto &a, const auto &b)
+                         { return a.first < b.first; });
+
+        pbt::Writer writer(0, "test_merge_parallel.pbt", get_writer_config());
+        writer.merge(readers, num_parts);
+        writer.finish();
+        pbt::Reader reader = writer.to_reader(get_reader_config());
+
+        if (reader.count() != entries.size())
+        {
+            std::cout << "count mismatch: " << num_parts << " " << reader.count() << " " << entries.size() << std::endl;
+            exit(1);
+        }
+
+        uint64_t i = 0;
+        for (auto itr = reader.begin(); !itr.is_end(); itr.next())
+        {
+            if (itr.get_key() != entries[i].first || itr.get_value() != entries[i].second)
+            {
+                std::cout << "iterator mismatch: " << num_parts << " " << itr.get_key() << " " << entries[i].first << std::endl;
+                exit(1);
+            }
+            i++;
+        }
+
+        pbt::PinnedView key;
+        pbt::PinnedView value;
+        for (i = 0; i < entries.size(); i++)
+        {
+            if (!reader.at(i, key, value) || key != entries[i].first || value != entries[i].second)
+            {
+                std::cout << "at mismatch: " << num_parts << " " << i << std::endl;
+                exit(1);
+            }
+            if (!reader.get(entries[i].first, value))
+            {
+                std::cout << "get mismatch: " << num_parts << " " << entries[i].first << std::endl;
+                exit(1);
+            }
+        }
+
+        if (std::filesystem::exists("test_merge_parallel.pbt.part0"))
+        {
+            std::cout << "temporary file left: " << num_parts << std::endl;
+            exit(1);
+        }
+    }
+
+    std::cout << "test_merge_parallel done" << std::endl;
+}
+
+void test_explicit_reads()
+{
+    auto read_file = [](const std::string &path)
+    {
+        std::ifstream ifs(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    };
+
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(keys, 10000);
+    generate_values_sequence(values, 10000);
+    for (int i = 0; i < values.size(); i += 7)
+    {
+        // Values that make some leaf nodes larger than a read block
+        values[i].append(1000, 'a' + i % 26);
+    }
+
+    for (int variant = 0; variant < 4; variant++)
+    {
+        pbt::WriterConfig config = get_writer_config();
+        config.enable_compact_nodes = variant != 1;
+        config.enable_prefix_compression = variant == 2;
+        config.enable_lz4_compression = variant == 3;
+
+        pbt::ReaderConfig reader_config = get_reader_config();
+        reader_config.enable_mmap = false;
+        reader_config.io_stats = std::make_shared<pbt::IoStats>();
+
+        std::vector<std::shared_ptr<pbt::Reader>> mmap_readers;
+        std::vector<std::shared_ptr<pbt::Reader>> explicit_readers;
+        for (int f = 0; f < 2; f++)
+        {
+            pbt::Writer writer(0, "test_explicit_reads_" + std::to_string(f) + ".pbt", config);
+            for (int i = f; i < keys.size(); i += 2)
+            {
+                writer.add(keys[i], values[i]);
+            }
+            writer.finish();
+            mmap_readers.push_back(std::make_shared<pbt::Reader>(writer.to_reader(get_reader_config())));
+            explicit_readers.push_back(std::make_shared<pbt::Reader>(writer.to_reader(reader_config)));
+        }
+
+        for (int f = 0; f < 2; f++)
+        {
+            pbt::Reader &reader = *explicit_readers[f];
+            pbt::PinnedView key;
+            pbt::PinnedView value;
+            for (int i = f, j = 0; i < keys.size(); i += 2, j++)
+            {
+                if (!reader.get(keys[i], value) || value != values[i])
+                {
+                    std::cout << "get mismatch: " << variant << " " << keys[i] << std::endl;
+                    exit(1);
+                }
+                if (!reader.at(j, key, value) || key != keys[i] || value != values[i])
+                {
+                    std::cout << "at mismatch: " << variant << " " << j << std::endl;
+                    exit(1);
+                }
+            }
+            int i = f;
+            for (auto itr = reader.begin(); !itr.is_end(); itr.next())
+            {
+                if (itr.get_key() != keys[i] || itr.get_value() != values[i])
+                {
+                    std::cout << "iterator mismatch: " << variant << " " << itr.get_key() << " " << keys[i] << std::endl;
+                    exit(1);
+                }
+                i += 2;
+            }
+        }
+
+        // Merges copy leaf nodes as they are stored, which reads them again from the file
+        pbt::Writer mmap_writer(0, "test_explicit_reads_mmap.pbt", config);
+        mmap_writer.merge(mmap_readers);
+        mmap_writer.finish();
+        pbt::Writer explicit_writer(0, "test_explicit_reads.pbt", config);
+        explicit_writer.merge(explicit_readers);
+        explicit_writer.finish();
+        if (read_file("test_explicit_reads.pbt") != read_file("test_explicit_reads_mmap.pbt"))
+        {
+            std::cout << "merge mismatch: " << variant << std::endl;
+            exit(1);
+        }
+
+        if (reader_config.io_stats->get_num_reads() == 0 || reader_config.io_stats->get_num_bytes_read() < std::filesystem::file_size("test_explicit_reads_0.pbt"))
+        {
+            std::cout << "reads not counted: " << variant << std::endl;
+            exit(1);
+        }
+    }
+
+    std::cout << "test_explicit_reads done" << std::endl;
+}
+
+void test_get_batch()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(keys, 20000);
+    generate_values_sequence(values, 20000);
+    for (int i = 0; i < values.size(); i += 7)
+    {
+        values[i].append(1000, 'a' + i % 26);
+    }
+
+    for (int variant = 0; variant < 5; variant++)
+    {
+        pbt::WriterConfig config = get_writer_config();
+        config.enable_lz4_compression = variant == 4;
+
+        // Every other key is written, so the batches also look up keys that are not in the PBT
+        pbt::Writer writer(0, "test_get_batch.pbt", config);
+        for (int i = 0; i < keys.size(); i += 2)
+        {
+            writer.add(keys[i], values[i]);
+        }
+        writer.finish();
+
+        pbt::ReaderConfig reader_config = get_reader_config();
+        reader_config.enable_mmap = variant == 0;
+        reader_config.enable_io_uring = variant != 2;
+        reader_config.io_stats = std::make_shared<pbt::IoStats>();
+        if (variant >= 3)
+        {
+            reader_config.internal_node_cache = std::make_shared<pbt::NodeCache>(1 << 16);
+            reader_config.leaf_node_cache = std::make_shared<pbt::NodeCache>(1 << 14, variant == 4 ? 4 : 1);
+        }
+        pbt::Reader reader = writer.to_reader(reader_config);
+
+        std::vector<std::string> shuffled_keys(keys);
+        std::shuffle(shuffled_keys.begin(), shuffled_keys.end(), std::mt19937_64(variant));
+        shuffled_keys.push_back(keys[10]);
+        shuffled_keys.push_back("");
+        shuffled_keys.push_back("~");
+        for (uint64_t batch_size : {1, 7, 100, 1000})
+        {
+            for (uint64_t start = 0; start < shuffled_keys.size(); start += batch_size)
+            {
+                std::vector<std::string_view> batch(shuffled_keys.begin() + start, shuffled_keys.begin() + std::min<uint64_t>(start + batch_size, shuffled_keys.size()));
+                std::vector<std::optional<pbt::PinnedView>> batch_values;
+                reader.get_batch(batch, batch_values);
+                for (uint64_t j = 0; j < batch.size(); j++)
+                {
+                    auto it = std::lower_bound(keys.begin(), keys.end(), batch[j]);
+                    bool expected = it != keys.end() && *it == batch[j] && (it - keys.begin()) % 2 == 0;
+                    if (batch_values[j].has_value() != expected || (expected && batch_values[j].value() != values[it - keys.begin()]))
+                    {
+                        std::cout << "get_batch mismatch: " << variant << " " << batch[j] << std::endl;
+                        exit(1);
+                    }
+                }
+            }
+        }
+        if (variant != 0 && reader_config.io_stats->get_num_reads() == 0)
+        {
+            std::cout << "reads not counted: " << variant << std::endl;
+            exit(1);
+        }
+    }
+
+    std::cout << "test_get_batch done" << std::endl;
+}
+
+void test_pinned_views()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(keys, 10000);
+    generate_values_sequence(values, 10000);
+
+    pbt::WriterConfig config = get_writer_config();
+    config.enable_prefix_compression = true;
+    config.enable_lz4_compression = true;
+    pbt::Writer writer(0, "test_pinned_views.pbt", config);
+    write_key_value_pairs(writer, keys, values);
+
+    // A cache that holds only a few leaf nodes, so later reads evict the nodes of earlier ones
+    std::shared_ptr<pbt::NodeCache> leaf_node_cache = std::make_shared<pbt::NodeCache>(1 << 12);
+    pbt::ReaderConfig reader_config = get_reader_config();
+    reader_config.enable_mmap = false;
+    reader_config.leaf_node_cache = leaf_node_cache;
+    pbt::Reader reader = writer.to_reader(reader_config);
+
+    auto a = reader.get(keys[1]);
+    auto b = reader.get(keys[keys.size() - 1]);
+    if (!a.has_value() || !b.has_value() || *a != values[1] || *b != values[keys.size() - 1])
+    {
+        std::cout << "get mismatch after another get" << std::endl;
+        exit(1);
+    }
+
+    std::vector<pbt::PinnedView> held_keys;
+    std::vector<pbt::PinnedView> held_values;
+    for (int i = 0; i < keys.size(); i += 10)
+    {
+        pbt::PinnedView key;
+        pbt::PinnedView value;
+        if (!reader.at(i, key, value))
+        {
+            std::cout << "at failed: " << i << std::endl;
+            exit(1);
+        }
+        held_keys.push_back(key);
+        held_values.push_back(value);
+    }
+    for (int i = 0, j = 0; i < keys.size(); i += 10, j++)
+    {
+        if (held_keys[j] != keys[i] || held_values[j] != values[i])
+        {
+            std::cout << "at mismatch after other reads: " << i << std::endl;
+            exit(1);
+        }
+    }
+
+    // The nodes that views point into stay pinned, and are evicted once the views are released
+    if (leaf_node_cache->get_size() <= leaf_node_cache->get_capacity())
+    {
+        std::cout << "nodes not pinned" << std::endl;
+        exit(1);
+    }
+    a.reset();
+    b.reset();
+    held_keys.clear();
+    held_values.clear();
+    if (leaf_node_cache->get_size() > leaf_node_cache->get_capacity())
+    {
+        std::cout << "nodes not unpinned" << std::endl;
+        exit(1);
+    }
+
+    std::cout << "test_pinned_views done" << std::endl;
+}
+
+void test_pin_internal_nodes()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(keys, 100000);
+    generate_values_sequence(values, 100000);
+
+    for (int variant = 0; variant < 2; variant++)
+    {
+        pbt::WriterConfig config = get_writer_config();
+        config.enable_compact_nodes = variant == 0;
+
+        pbt::Writer writer(0, "test_pin_internal_nodes.pbt", config);
+        write_key_value_pairs(writer, keys, values);
+
+        pbt::ReaderConfig reader_config = get_reader_config();
+        reader_config.enable_mmap = false;
+        reader_config.io_stats = std::make_shared<pbt::IoStats>();
+        reader_config.pin_internal_nodes = true;
+        pbt::Reader reader = writer.to_reader(reader_config);
+
+        if (reader.get_pinned_size() == 0 || reader.get_pinned_size() >= std::filesystem::file_size("test_pin_internal_nodes.pbt"))
+        {
+            std::cout << "pinned size mismatch: " << variant << " " << reader.get_pinned_size() << std::endl;
+            exit(1);
+        }
+
+        // Every lookup reads the leaf node from the file, and nothing else
+        pbt::PinnedView key;
+        pbt::PinnedView value;
+        for (int i = 0; i < keys.size(); i += 13)
+        {
+            uint64_t num_reads = reader_config.io_stats->get_num_reads();
+            if (!reader.get(keys[i], value) || value != values[i])
+            {
+                std::cout << "get mismatch: " << variant << " " << keys[i] << std::endl;
+                exit(1);
+            }
+            if (reader_config.io_stats->get_num_reads() != num_reads + 1)
+            {
+                std::cout << "get read more than the leaf node: " << variant << " " << keys[i] << std::endl;
+                exit(1);
+            }
+            if (!reader.at(i, key, value) || key != keys[i] || value != values[i])
+            {
+                std::cout << "at mismatch: " << variant << " " << i << std::endl;
+                exit(1);
+            }
+        }
+    }
+
+    std::cout << "test_pin_internal_nodes done" << std::endl;
+}
+
+void test_bloom_filter()
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_even_keys(keys, 100000);
+    generate_values_sequence(values, 100000);
+    std::vector<std::string> absent_keys;
+    generate_odd_keys(absent_keys, 100000);
+
+    pbt::detail::BloomFilterBuilder builder;
+    for (auto &key : keys)
+    {
+        builder.add_key(key);
+    }
+    std::string filter(pbt::detail::BloomFilter::size_of(builder, 10), '\0');
+    pbt::detail::BloomFilter::write(filter.data(), builder, 10);
+
+    for (auto &key : keys)
+    {
+        if (!pbt::detail::BloomFilter::may_contain(filter.data(), key))
+        {
+            std::cout << "false negative: " << key << std::endl;
+            exit(1);
+        }
+    }
+    uint64_t num_false_positives = 0;
+    for (auto &key : absent_keys)
+    {
+        num_false_positives += pbt::detail::BloomFilter::may_contain(filter.data(), key) ? 1 : 0;
+    }
+    // About 1% at 10 bits per key, with some slack for the blocked layout
+    double false_positive_rate = static_cast<double>(num_false_positives) / absent_keys.size();
+    if (false_positive_rate > 0.02)
+    {
+        std::cout << "false positive rate too high: " << false_positive_rate << std::endl;
+        exit(1);
+    }
+
+    for (uint64_t bits_per_key : {0, 10})
+    {
+        pbt::WriterConfig config = get_writer_config();
+        config.bloom_filter_bits_per_key = bits_per_key;
+
+        pbt::Writer writer(0, "test_bloom_filter.pbt", config);
+        write_key_value_pairs(writer, keys, values);
+        pbt::Reader reader = writer.to_reader(get_reader_config());
+
+        if ((reader.get_footer_extension().filter_size > 0) != (bits_per_key > 0))
+        {
+            std::cout << "filter size mismatch: " << bits_per_key << std::endl;
+            exit(1);
+        }
+        pbt::PinnedView value;
+        for (int i = 0; i < keys.size(); i++)
+        {
+            if (!reader.get(keys[i], value) || value != values[i])
+            {
+                std::cout << "get mismatch: " << bits_per_key << " " << keys[i] << std::endl;
+                exit(1);
+            }
+        }
+        for (auto &key : absent_keys)
+        {
+            if (reader.get(key, value))
+            {
+                std::cout << "found absent key: " << bits_per_key << " " << key << std::endl;
+                exit(1);
+            }
+        }
+    }
+
+    std::cout << "test_bloom_filter done" << std::endl;
+}
+
 void test_reduce()
 {
     std::vector<std::string> keys;
@@ -164,7 +832,7 @@ void test_reduce()
 
     pbt::WriterConfig config;
     config.max_node_children = 4;
-    config.reduce = [](const std::vector<std::string> &values, std::string &reduced_value)
+    config.reduce = [](const std::vector<std::string_view> &values, std::string &reduced_value)
     {
         std::string_view result;
         for (auto &value : values)
@@ -176,7 +844,7 @@ void test_reduce()
 
     std::string file_path = "test_reduce.pbt";
 
-    pbt::Writer writer(file_path, config);
+    pbt::Writer writer(0, file_path, config);
     write_key_value_pairs(writer, keys, values);
     pbt::Reader reader = writer.to_reader(get_reader_config());
 
@@ -190,7 +858,7 @@ void test_reduce()
     std::cout << "test_reduce done" << std::endl;
 }
 
-void test_duplicate_keys()
+void test_duplicate_keys(uint64_t max_node_children)
 {
     std::vector<std::string> keys;
     std::vector<std::string> values;
@@ -206,8 +874,11 @@ void test_duplicate_keys()
         }
     }
 
+    pbt::WriterConfig config = get_writer_config();
+    config.max_node_children = max_node_children;
+
     std::string file_path = "test_duplicate_keys.pbt";
-    pbt::Writer writer(file_path, get_writer_config());
+    pbt::Writer writer(0, file_path, config);
 
     for (auto entry : entries)
     {
@@ -219,35 +890,35 @@ void test_duplicate_keys()
 
     for (auto entry : entries)
     {
-        std::string_view value;
+        pbt::PinnedView value;
         reader.get(entry.first, value);
 
         if (value != values[0])
         {
-            std::cout << "value mismatch: " << entry.first << " " << value << " " << entry.second << std::endl;
+            std::cout << "value mismatch: " << entry.first << " " << value.get() << " " << entry.second << std::endl;
             exit(1);
         }
     }
 
     for (int i = 0; i < entries.size(); i++)
     {
-        std::string key;
-        std::string_view value;
+        pbt::PinnedView key;
+        pbt::PinnedView value;
         reader.at(i, key, value);
 
         if (key != entries[i].first)
         {
-            std::cout << "key mismatch: " << key << " " << entries[i].first << std::endl;
+            std::cout << "key mismatch: " << key.get() << " " << entries[i].first << std::endl;
             exit(1);
         }
         if (value != entries[i].second)
         {
-            std::cout << "value mismatch: " << key << " " << value << " " << entries[i].second << std::endl;
+            std::cout << "value mismatch: " << key.get() << " " << value.get() << " " << entries[i].second << std::endl;
             exit(1);
         }
     }
 
-    std::cout << "test_duplicate_keys done" << std::endl;
+    std::cout << "test_duplicate_keys (" << max_node_children << ") done" << std::endl;
 }
 
 void benchmark_add()
@@ -258,7 +929,7 @@ void benchmark_add()
     generate_values_sequence(values, 100000);
 
     std::string file_path = "benchmark_add.pbt";
-    pbt::Writer writer(file_path, get_writer_config());
+    pbt::Writer writer(0, file_path, get_writer_config());
     auto t1 = std::chrono::high_resolution_clock::now();
     write_key_value_pairs(writer, keys, values);
     auto t2 = std::chrono::high_resolution_clock::now();
@@ -274,12 +945,12 @@ void test_get_by_key()
     generate_values_sequence(values, 10000);
 
     std::string file_path = "test_get_by_key.pbt";
-    pbt::Writer writer(file_path, get_writer_config());
+    pbt::Writer writer(0, file_path, get_writer_config());
     write_key_value_pairs(writer, keys, values);
 
     pbt::Reader reader = writer.to_reader(get_reader_config());
 
-    std::string_view value;
+    pbt::PinnedView value;
     for (int i = 0; i < keys.size(); i++)
     {
         bool found = reader.get(std::string_view(keys[i]), value);
@@ -290,7 +961,7 @@ void test_get_by_key()
         }
         if (value != values[i])
         {
-            std::cout << "value mismatch: " << keys[i] << " " << value << " " << values[i] << std::endl;
+            std::cout << "value mismatch: " << keys[i] << " " << value.get() << " " << values[i] << std::endl;
             exit(1);
         }
     }
@@ -318,13 +989,13 @@ void test_get_by_index()
     generate_values_sequence(values, 10000);
 
     std::string file_path = "test_get_by_index.pbt";
-    pbt::Writer writer(file_path, get_writer_config());
+    pbt::Writer writer(0, file_path, get_writer_config());
     write_key_value_pairs(writer, keys, values);
 
     pbt::Reader reader = writer.to_reader(get_reader_config());
 
-    std::string key;
-    std::string_view value;
+    pbt::PinnedView key;
+    pbt::PinnedView value;
     for (int i = 0; i < keys.size(); i++)
     {
         bool found = reader.at(i, key, value);
@@ -335,12 +1006,12 @@ void test_get_by_index()
         }
         if (key != keys[i])
         {
-            std::cout << "key mismatch: " << key << " " << keys[i] << std::endl;
+            std::cout << "key mismatch: " << key.get() << " " << keys[i] << std::endl;
             exit(1);
         }
         if (value != values[i])
         {
-            std::cout << "value mismatch: " << keys[i] << " " << value << " " << values[i] << std::endl;
+            std::cout << "value mismatch: " << keys[i] << " " << value.get() << " " << values[i] << std::endl;
             exit(1);
         }
     }
@@ -367,12 +1038,12 @@ void benchmark_get_by_key()
     generate_values_sequence(values, 100000);
 
     std::string file_path = "benchmark_get_by_key.pbt";
-    pbt::Writer writer(file_path, get_writer_config());
+    pbt::Writer writer(0, file_path, get_writer_config());
     write_key_value_pairs(writer, keys, values);
 
     pbt::Reader reader = writer.to_reader(get_reader_config());
 
-    std::string_view value;
+    pbt::PinnedView value;
     auto t1 = std::chrono::high_resolution_clock::now();
     for (int i = 0; i < keys.size(); i++)
     {
@@ -395,13 +1066,13 @@ void benchmark_get_by_index()
     generate_values_sequence(values, 100000);
 
     std::string file_path = "benchmark_get_by_index.pbt";
-    pbt::Writer writer(file_path, get_writer_config());
+    pbt::Writer writer(0, file_path, get_writer_config());
     write_key_value_pairs(writer, keys, values);
 
     pbt::Reader reader = writer.to_reader(get_reader_config());
 
-    std::string key;
-    std::string_view value;
+    pbt::PinnedView key;
+    pbt::PinnedView value;
     auto t1 = std::chrono::high_resolution_clock::now();
     for (int i = 0; i < keys.size(); i++)
     {
@@ -424,19 +1095,19 @@ void benchmark_iterator()
     generate_values_sequence(values, 100000);
 
     std::string file_path = "benchmark_iterator.pbt";
-    pbt::Writer writer(file_path, get_writer_config());
+    pbt::Writer writer(0, file_path, get_writer_config());
     write_key_value_pairs(writer, keys, values);
 
     pbt::Reader reader = writer.to_reader(get_reader_config());
 
-    std::string key;
+    std::string_view key;
     std::string_view value;
     auto t1 = std::chrono::high_resolution_clock::now();
     auto itr = reader.begin();
     while (!itr.is_end())
     {
-        itr.get_key(key);
-        itr.get_value(value);
+        key = itr.get_key();
+        value = itr.get_value();
         itr.next();
 
         // prevent optimization
@@ -458,19 +1129,19 @@ void test_iterator_begin()
     generate_values_sequence(values, 10000);
 
     std::string file_path = "test_iterator_begin.pbt";
-    pbt::Writer writer(file_path, get_writer_config());
+    pbt::Writer writer(0, file_path, get_writer_config());
     write_key_value_pairs(writer, keys, values);
 
     pbt::Reader reader = writer.to_reader(get_reader_config());
 
-    std::string key;
+    std::string_view key;
     std::string_view value;
     auto itr = reader.begin();
     uint64_t count = 0;
     while (!itr.is_end())
     {
-        itr.get_key(key);
-        itr.get_value(value);
+        key = itr.get_key();
+        value = itr.get_value();
 
         if (key != keys[count])
         {
@@ -504,19 +1175,19 @@ void test_iterator_seek_key()
     generate_values_sequence(values, 10000);
 
     std::string file_path = "test_iterator_seek_key.pbt";
-    pbt::Writer writer(file_path, get_writer_config());
+    pbt::Writer writer(0, file_path, get_writer_config());
     write_key_value_pairs(writer, keys, values);
 
     pbt::Reader reader = writer.to_reader(get_reader_config());
 
-    std::string key;
+    std::string_view key;
     std::string_view value;
     auto itr = reader.seek_first(keys[5000]);
     uint64_t count = 5000;
     while (!itr.is_end())
     {
-        itr.get_key(key);
-        itr.get_value(value);
+        key = itr.get_key();
+        value = itr.get_value();
 
         if (key != keys[count])
         {
@@ -550,19 +1221,19 @@ void test_iterator_seek_index()
     generate_values_sequence(values, 10000);
 
     std::string file_path = "test_iterator_seek_index.pbt";
-    pbt::Writer writer(file_path, get_writer_config());
+    pbt::Writer writer(0, file_path, get_writer_config());
     write_key_value_pairs(writer, keys, values);
 
     pbt::Reader reader = writer.to_reader(get_reader_config());
 
-    std::string key;
+    std::string_view key;
     std::string_view value;
     auto itr = reader.seek(5000);
     uint64_t count = 5000;
     while (!itr.is_end())
     {
-        itr.get_key(key);
-        itr.get_value(value);
+        key = itr.get_key();
+        value = itr.get_value();
 
         if (key != keys[count])
         {
@@ -588,22 +1259,642 @@ void test_iterator_seek_index()
     std::cout << "test_iterator_seek_index done" << std::endl;
 }
 
+void test_index_navigation()
+{
+    // Files without the maximum number of children navigate by the entry starts in the internal nodes instead
+    enum Layout
+    {
+        COMPACT,
+        FIXED_WIDTH,
+        ENTRY_STARTS,
+    };
+
+    for (uint64_t max_node_children : {2, 3, 16})
+    {
+        for (int num_entries : {1, 7, 1000, 4097})
+        {
+            for (Layout layout : {COMPACT, FIXED_WIDTH, ENTRY_STARTS})
+            {
+                std::vector<std::string> keys;
+                std::vector<std::string> values;
+                generate_keys_sequence(keys, num_entries);
+                generate_values_sequence(values, num_entries);
+
+                pbt::WriterConfig config = get_writer_config();
+                config.max_node_children = max_node_children;
+                config.enable_compact_nodes = layout == COMPACT;
+
+                std::string file_path = "test_index_navigation.pbt";
+                {
+                    pbt::Writer writer(0, file_path, config);
+                    write_key_value_pairs(writer, keys, values);
+                }
+                if (layout == ENTRY_STARTS)
+                {
+                    // Clear the maximum number of children, the last field of the footer extension before its size
+                    uint64_t zero = 0;
+                    std::fstream file(file_path, std::ios::in | std::ios::out | std::ios::binary);
+                    file.seekp(std::filesystem::file_size(file_path) - pbt::detail::Footer::size_of() - 2 * sizeof(uint64_t));
+                    file.write(reinterpret_cast<const char *>(&zero), sizeof(zero));
+                }
+
+                pbt::Reader reader(file_path, get_reader_config());
+
+                pbt::PinnedView key;
+                pbt::PinnedView value;
+                for (int i = 0; i < num_entries; i++)
+                {
+                    if (!reader.at(i, key, value) || key != keys[i] || value != values[i])
+                    {
+                        std::cout << "at mismatch: " << max_node_children << " " << num_entries << " " << layout << " " << i << std::endl;
+                        exit(1);
+                    }
+                }
+                if (reader.at(num_entries, key, value))
+                {
+                    std::cout << "at out of range: " << max_node_children << " " << num_entries << " " << layout << std::endl;
+                    exit(1);
+                }
+
+                for (int i = 0; i < num_entries; i += 97)
+                {
+                    uint64_t key_count = 0;
+                    for (auto itr = reader.seek_first(keys[i]); !itr.is_end(); itr.next())
+                    {
+                        key_count++;
+                    }
+                    uint64_t index_count = 0;
+                    for (auto itr = reader.seek(i); !itr.is_end(); itr.next())
+                    {
+                        index_count++;
+                    }
+                    if (key_count != num_entries - i || index_count != num_entries - i)
+                    {
+                        std::cout << "seek count mismatch: " << max_node_children << " " << num_entries << " " << layout << " " << i << std::endl;
+                        exit(1);
+                    }
+                }
+            }
+        }
+    }
+
+    std::cout << "test_index_navigation done" << std::endl;
+}
+
+void generate_keys_hierarchical(std::vector<std::string> &keys, int num_entries)
+{
+    for (int i = 0; i < num_entries; i++)
+    {
+        std::string digits = std::to_string(i);
+        digits.insert(digits.begin(), 8 - digits.size(), '0');
+        std::string key = "tenant_" + std::to_string(i / 100000) + "/region_" + std::to_string(i / 1000 % 100) + "/entity_" + digits;
+        keys.push_back(key);
+    }
+    std::sort(keys.begin(), keys.end());
+}
+
+void test_prefix_compression()
+{
+    std::vector<std::string> keys;
+    generate_keys_hierarchical(keys, 1000);
+
+    // Duplicates that span restart points, keys that are prefixes of other keys, and an empty key
+    std::vector<std::pair<std::string, std::string>> entries;
+    entries.push_back(std::make_pair("", "empty"));
+    for (int i = 0; i < keys.size(); i++)
+    {
+        for (int j = 0; j < (i % 10 == 0 ? 7 : 1); j++)
+        {
+            entries.push_back(std::make_pair(keys[i], std::to_string(i) + "_" + std::to_string(j)));
+        }
+        if (i % 100 == 0)
+        {
+            entries.push_back(std::make_pair(keys[i] + "0", std::to_string(i) + "_prefix"));
+        }
+    }
+
+    pbt::WriterConfig config = get_writer_config();
+    config.enable_prefix_compression = true;
+    config.prefix_restart_interval = 3;
+
+    std::string file_path = "test_prefix_compression.pbt";
+    pbt::Writer writer(0, file_path, config);
+    for (auto &entry : entries)
+    {
+        writer.add(entry.first, entry.second);
+    }
+    writer.finish();
+
+    pbt::Reader reader = writer.to_reader(get_reader_config());
+
+    for (int i = 0; i < entries.size(); i++)
+    {
+        // Lookups find the first of duplicate keys
+        pbt::PinnedView value;
+        if (!reader.get(entries[i].first, value) || ((i == 0 || entries[i - 1].first != entries[i].first) && value != entries[i].second))
+        {
+            std::cout << "value mismatch: " << entries[i].first << " " << value.get() << " " << entries[i].second << std::endl;
+            exit(1);
+        }
+
+        pbt::PinnedView key;
+        if (!reader.at(i, key, value) || key != entries[i].first || value != entries[i].second)
+        {
+            std::cout << "at mismatch: " << entries[i].first << " " << key.get() << std::endl;
+            exit(1);
+        }
+    }
+
+    for (int i = 0; i < entries.size(); i += 7)
+    {
+        auto itr = reader.seek_first(entries[i].first);
+        uint64_t count = i;
+        while (count > 0 && entries[count - 1].first == entries[i].first)
+        {
+            count--;
+        }
+        for (; !itr.is_end(); itr.next())
+        {
+            if (itr.get_key() != entries[count].first || itr.get_value() != entries[count].second)
+            {
+                std::cout << "iterator mismatch: " << itr.get_key() << " " << entries[count].first << std::endl;
+                exit(1);
+            }
+            count++;
+        }
+        if (count != entries.size())
+        {
+            std::cout << "count mismatch: " << count << " " << entries.size() << std::endl;
+            exit(1);
+        }
+    }
+
+    // Seeking keys that are not in the PBT, but share a prefix with keys that are
+    for (int i = 0; i < entries.size(); i += 3)
+    {
+        std::string key = entries[i].first;
+        std::vector<std::string> probes{key + '\0', key + "~", key.substr(0, key.size() / 2)};
+        if (!key.empty())
+        {
+            probes.push_back(key.substr(0, key.size() - 1));
+            probes.push_back(key.substr(0, key.size() - 1) + static_cast<char>(key.back() + 1));
+            probes.push_back(key.substr(0, key.size() - 1) + static_cast<char>(key.back() - 1));
+        }
+        for (auto &probe : probes)
+        {
+            uint64_t expected = std::lower_bound(entries.begin(), entries.end(), probe, [](const std::pair<std::string, std::string> &entry, const std::string &probe)
+                                                 { return entry.first < probe; }) -
+                                entries.begin();
+            auto itr = reader.seek_first(probe);
+            if (expected == entries.size() ? !itr.is_end() : itr.is_end() || itr.get_key() != entries[expected].first || itr.get_value() != entries[expected].second)
+            {
+                std::cout << "seek mismatch: " << probe << std::endl;
+                exit(1);
+            }
+        }
+    }
+
+    pbt::PinnedView value;
+    if (reader.get(keys[0] + "/", value) || reader.get("tenant_", value) || reader.get("zzz", value))
+    {
+        std::cout << "found missing key" << std::endl;
+        exit(1);
+    }
+
+    std::cout << "test_prefix_compression done" << std::endl;
+}
+
+void benchmark_prefix_compression(bool enable_prefix_compression)
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_hierarchical(keys, 1000000);
+    generate_values_sequence(values, 1000000);
+
+    pbt::WriterConfig config = get_writer_config();
+    config.enable_prefix_compression = enable_prefix_compression;
+
+    std::string file_path = "benchmark_prefix_compression.pbt";
+    pbt::Writer writer(0, file_path, config);
+    write_key_value_pairs(writer, keys, values);
+
+    pbt::Reader reader = writer.to_reader(get_reader_config());
+    uint64_t file_size = std::filesystem::file_size(file_path);
+
+    uint64_t checksum = 0;
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (auto itr = reader.begin(); !itr.is_end(); itr.next())
+    {
+        checksum += itr.get_key().size() + itr.get_value().size();
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    pbt::PinnedView value;
+    for (int i = 0; i < keys.size(); i += 7)
+    {
+        reader.get(keys[i], value);
+        checksum += value.get().size();
+    }
+    auto t3 = std::chrono::high_resolution_clock::now();
+
+    auto scan_duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
+    auto get_duration = std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2);
+    std::cout << "benchmark_prefix_compression (" << (enable_prefix_compression ? "enabled" : "disabled") << "): "
+              << file_size << " bytes, scan " << scan_duration.count() << "μs, get " << get_duration.count() << "μs"
+              << (checksum == 0 ? " " : "") << std::endl;
+}
+
+void benchmark_lz4_compression(bool enable_lz4_compression, uint64_t leaf_node_cache_size)
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_hierarchical(keys, 1000000);
+    for (int i = 0; i < keys.size(); i++)
+    {
+        values.push_back("{\"id\":" + std::to_string(i) + ",\"status\":\"" + (i % 3 == 0 ? "active" : "inactive") + "\",\"score\":" + std::to_string(i % 1000) + "}");
+    }
+
+    pbt::WriterConfig config = get_writer_config();
+    config.enable_lz4_compression = enable_lz4_compression;
+
+    std::string file_path = "benchmark_lz4_compression.pbt";
+    pbt::Writer writer(0, file_path, config);
+    write_key_value_pairs(writer, keys, values);
+
+    pbt::ReaderConfig reader_config = get_reader_config();
+    if (leaf_node_cache_size > 0)
+    {
+        reader_config.leaf_node_cache = std::make_shared<pbt::NodeCache>(leaf_node_cache_size);
+    }
+    pbt::Reader reader = writer.to_reader(reader_config);
+    uint64_t file_size = std::filesystem::file_size(file_path);
+
+    // Repeated lookups of a hot set of keys
+    std::vector<std::string> hot_keys(keys.begin(), keys.begin() + 100000);
+    std::shuffle(hot_keys.begin(), hot_keys.end(), std::mt19937_64(0));
+
+    uint64_t checksum = 0;
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (auto itr = reader.begin(); !itr.is_end(); itr.next())
+    {
+        checksum += itr.get_key().size() + itr.get_value().size();
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    pbt::PinnedView value;
+    for (int n = 0; n < 5; n++)
+    {
+        for (auto &key : hot_keys)
+        {
+            reader.get(key, value);
+            checksum += value.get().size();
+        }
+    }
+    auto t3 = std::chrono::high_resolution_clock::now();
+
+    auto scan_duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
+    auto get_duration = std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2);
+    std::cout << "benchmark_lz4_compression (" << (enable_lz4_compression ? "enabled" : "disabled") << ", cache " << leaf_node_cache_size << "): "
+              << file_size << " bytes, scan " << scan_duration.count() << "μs, get " << get_duration.count() << "μs"
+              << (checksum == 0 ? " " : "") << std::endl;
+}
+
+void benchmark_max_node_children(uint64_t max_node_children)
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(keys, 1000000);
+    generate_values_sequence(values, 1000000);
+
+    pbt::WriterConfig config = get_writer_config();
+    config.max_node_children = max_node_children;
+
+    std::string file_path = "benchmark_max_node_children.pbt";
+    pbt::Writer writer(0, file_path, config);
+    write_key_value_pairs(writer, keys, values);
+
+    pbt::Reader reader = writer.to_reader(get_reader_config());
+    uint64_t file_size = std::filesystem::file_size(file_path);
+
+    std::vector<uint64_t> indices(keys.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    std::shuffle(indices.begin(), indices.end(), std::mt19937_64(0));
+
+    uint64_t checksum = 0;
+    pbt::PinnedView key;
+    pbt::PinnedView value;
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (uint64_t index : indices)
+    {
+        reader.get(keys[index], value);
+        checksum += value.get().size();
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    for (uint64_t index : indices)
+    {
+        reader.at(index, key, value);
+        checksum += value.get().size();
+    }
+    auto t3 = std::chrono::high_resolution_clock::now();
+    for (auto itr = reader.begin(); !itr.is_end(); itr.next())
+    {
+        checksum += itr.get_key().size() + itr.get_value().size();
+    }
+    auto t4 = std::chrono::high_resolution_clock::now();
+
+    auto get_duration = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1);
+    auto at_duration = std::chrono::duration_cast<std::chrono::milliseconds>(t3 - t2);
+    auto scan_duration = std::chrono::duration_cast<std::chrono::milliseconds>(t4 - t3);
+    std::cout << "benchmark_max_node_children (" << max_node_children << "): "
+              << file_size << " bytes, get " << get_duration.count() << "ms, at " << at_duration.count() << "ms, scan " << scan_duration.count() << "ms"
+              << (checksum == 0 ? " " : "") << std::endl;
+}
+
+void benchmark_merge(uint64_t num_files, bool interleaved)
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(keys, 1000000);
+    generate_values_sequence(values, 1000000);
+
+    // Interleaved inputs overlap everywhere, the others each hold a contiguous range of keys
+    std::vector<std::shared_ptr<pbt::Reader>> readers;
+    uint64_t range_size = (keys.size() + num_files - 1) / num_files;
+    for (uint64_t f = 0; f < num_files; f++)
+    {
+        pbt::Writer writer(0, "benchmark_merge_" + std::to_string(f) + ".pbt", get_writer_config());
+        for (uint64_t j = 0; j < range_size; j++)
+        {
+            uint64_t i = interleaved ? j * num_files + f : f * range_size + j;
+            if (i < keys.size())
+            {
+                writer.add(keys[i], values[i]);
+            }
+        }
+        writer.finish();
+        readers.push_back(std::make_shared<pbt::Reader>(writer.to_reader(get_reader_config())));
+    }
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    pbt::Writer writer(0, "benchmark_merge.pbt", get_writer_config());
+    writer.merge(readers);
+    writer.finish();
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1);
+    std::cout << "benchmark_merge (" << num_files << " files, " << (interleaved ? "interleaved" : "contiguous") << "): " << duration.count() << "ms" << std::endl;
+}
+
+void benchmark_write(bool enable_streaming_writes, uint64_t num_files, uint64_t num_entries)
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(keys, num_entries);
+    generate_values_sequence(values, num_entries);
+
+    pbt::WriterConfig config = get_writer_config();
+    config.enable_streaming_writes = enable_streaming_writes;
+
+    uint64_t num_bytes = 0;
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (uint64_t f = 0; f < num_files; f++)
+    {
+        std::string file_path = "benchmark_write_" + std::to_string(f) + ".pbt";
+        pbt::Writer writer(0, file_path, config);
+        write_key_value_pairs(writer, keys, values);
+        num_bytes += std::filesystem::file_size(file_path);
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    // Overwriting the files in the next run would first wait for them to be truncated
+    for (uint64_t f = 0; f < num_files; f++)
+    {
+        std::filesystem::remove("benchmark_write_" + std::to_string(f) + ".pbt");
+    }
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
+    std::cout << "benchmark_write (" << (enable_streaming_writes ? "streaming" : "mmap") << ", " << num_files << " files of " << num_entries << " entries): "
+              << duration.count() << "μs, " << num_bytes / std::max<uint64_t>(1, duration.count()) << " MB/s" << std::endl;
+}
+
+void benchmark_merge_parallel(uint64_t num_parts)
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(keys, 1000000);
+    generate_values_sequence(values, 1000000);
+
+    const uint64_t num_files = 10;
+    std::vector<std::shared_ptr<pbt::Reader>> readers;
+    for (uint64_t f = 0; f < num_files; f++)
+    {
+        pbt::Writer writer(0, "benchmark_merge_parallel_" + std::to_string(f) + ".pbt", get_writer_config());
+        for (uint64_t i = f; i < keys.size(); i += num_files)
+        {
+            writer.add(keys[i], values[i]);
+        }
+        writer.finish();
+        readers.push_back(std::make_shared<pbt::Reader>(writer.to_reader(get_reader_config())));
+    }
+
+    auto t1 = std::chrono::high_resolution_clock::now();
+    pbt::Writer writer(0, "benchmark_merge_parallel.pbt", get_writer_config());
+    writer.merge(readers, num_parts);
+    writer.finish();
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1);
+    std::cout << "benchmark_merge_parallel (" << num_parts << " parts): " << duration.count() << "ms" << std::endl;
+}
+
+void benchmark_explicit_reads(bool enable_mmap, uint64_t leaf_node_cache_size)
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(keys, 1000000);
+    generate_values_sequence(values, 1000000);
+
+    std::string file_path = "benchmark_explicit_reads.pbt";
+    pbt::Writer writer(0, file_path, get_writer_config());
+    write_key_value_pairs(writer, keys, values);
+
+    pbt::ReaderConfig reader_config = get_reader_config();
+    reader_config.enable_mmap = enable_mmap;
+    reader_config.io_stats = std::make_shared<pbt::IoStats>();
+    reader_config.internal_node_cache = std::make_shared<pbt::NodeCache>(1 << 24);
+    if (leaf_node_cache_size > 0)
+    {
+        reader_config.leaf_node_cache = std::make_shared<pbt::NodeCache>(leaf_node_cache_size);
+    }
+    pbt::Reader reader = writer.to_reader(reader_config);
+
+    std::vector<std::string> lookup_keys(keys.begin(), keys.end());
+    std::shuffle(lookup_keys.begin(), lookup_keys.end(), std::mt19937_64(0));
+    lookup_keys.resize(200000);
+
+    uint64_t checksum = 0;
+    pbt::PinnedView value;
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (auto &key : lookup_keys)
+    {
+        reader.get(key, value);
+        checksum += value.get().size();
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
+    std::cout << "benchmark_explicit_reads (" << (enable_mmap ? "mmap" : "pread") << ", cache " << leaf_node_cache_size << "): "
+              << duration.count() << "μs, " << reader_config.io_stats->get_num_reads() << " reads, "
+              << reader_config.io_stats->get_num_bytes_read() << " bytes" << (checksum == 0 ? " " : "") << std::endl;
+}
+
+void benchmark_get_batch(bool enable_io_uring, uint64_t batch_size)
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(keys, 1000000);
+    generate_values_sequence(values, 1000000);
+
+    std::string file_path = "benchmark_get_batch.pbt";
+    pbt::Writer writer(0, file_path, get_writer_config());
+    write_key_value_pairs(writer, keys, values);
+
+    pbt::ReaderConfig reader_config = get_reader_config();
+    reader_config.enable_mmap = false;
+    reader_config.enable_io_uring = enable_io_uring;
+    reader_config.internal_node_cache = std::make_shared<pbt::NodeCache>(1 << 24);
+    pbt::Reader reader = writer.to_reader(reader_config);
+
+    std::vector<std::string> lookup_keys(keys.begin(), keys.end());
+    std::shuffle(lookup_keys.begin(), lookup_keys.end(), std::mt19937_64(0));
+    lookup_keys.resize(200000);
+
+    uint64_t checksum = 0;
+    auto t1 = std::chrono::high_resolution_clock::now();
+    std::vector<std::string_view> batch;
+    std::vector<std::optional<pbt::PinnedView>> batch_values;
+    for (uint64_t start = 0; start < lookup_keys.size(); start += batch_size)
+    {
+        batch.assign(lookup_keys.begin() + start, lookup_keys.begin() + std::min<uint64_t>(start + batch_size, lookup_keys.size()));
+        reader.get_batch(batch, batch_values);
+        for (auto &value : batch_values)
+        {
+            checksum += value.has_value() ? value->get().size() : 0;
+        }
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
+    std::cout << "benchmark_get_batch (" << (enable_io_uring ? "io_uring" : "pread") << ", batches of " << batch_size << "): "
+              << duration.count() << "μs" << (checksum == 0 ? " " : "") << std::endl;
+}
+
+void benchmark_pin_internal_nodes(bool pin_internal_nodes)
+{
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    generate_keys_sequence(keys, 1000000);
+    generate_values_sequence(values, 1000000);
+
+    std::string file_path = "benchmark_pin_internal_nodes.pbt";
+    pbt::Writer writer(0, file_path, get_writer_config());
+    write_key_value_pairs(writer, keys, values);
+
+    pbt::ReaderConfig reader_config = get_reader_config();
+    reader_config.enable_mmap = false;
+    reader_config.io_stats = std::make_shared<pbt::IoStats>();
+    reader_config.pin_internal_nodes = pin_internal_nodes;
+    pbt::Reader reader = writer.to_reader(reader_config);
+
+    std::vector<std::string> lookup_keys(keys.begin(), keys.end());
+    std::shuffle(lookup_keys.begin(), lookup_keys.end(), std::mt19937_64(0));
+    lookup_keys.resize(200000);
+
+    uint64_t checksum = 0;
+    pbt::PinnedView value;
+    uint64_t num_reads = reader_config.io_stats->get_num_reads();
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (auto &key : lookup_keys)
+    {
+        reader.get(key, value);
+        checksum += value.get().size();
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
+    std::cout << "benchmark_pin_internal_nodes (" << (pin_internal_nodes ? "pinned" : "not pinned") << ", " << reader.get_pinned_size() << " bytes): "
+              << duration.count() << "μs, " << reader_config.io_stats->get_num_reads() - num_reads << " reads"
+              << (checksum == 0 ? " " : "") << std::endl;
+}
+
 int main()
 {
     test_merge();
+    test_merge_leaf_runs();
+    test_concatenate();
+    test_merge_parallel();
+    test_explicit_reads();
+    test_get_batch();
+    test_pinned_views();
+    test_pin_internal_nodes();
+    test_bloom_filter();
     // test_reduce();
-    test_duplicate_keys();
+    test_duplicate_keys(16);
+    test_duplicate_keys(256);
 
     test_get_by_key();
     test_get_by_index();
     test_iterator_begin();
     test_iterator_seek_key();
     test_iterator_seek_index();
+    test_index_navigation();
+    test_prefix_compression();
 
     // benchmark_add();
     // benchmark_get_by_key();
     // benchmark_get_by_index();
     // benchmark_iterator();
+    benchmark_prefix_compression(false);
+    benchmark_prefix_compression(true);
+    benchmark_lz4_compression(false, 0);
+    benchmark_lz4_compression(true, 0);
+    benchmark_lz4_compression(false, 1 << 26);
+    benchmark_lz4_compression(true, 1 << 26);
+    for (uint64_t max_node_children : {8, 16, 32, 64, 128, 256})
+    {
+        benchmark_max_node_children(max_node_children);
+    }
+    for (uint64_t num_files : {2, 10, 50})
+    {
+        benchmark_merge(num_files, false);
+        benchmark_merge(num_files, true);
+    }
+    for (bool enable_streaming_writes : {false, true})
+    {
+        benchmark_write(enable_streaming_writes, 1, 2000000);
+    }
+    for (bool enable_streaming_writes : {false, true})
+    {
+        benchmark_write(enable_streaming_writes, 200, 1000);
+    }
+    for (uint64_t num_parts : {1, 2, 4, 8})
+    {
+        benchmark_merge_parallel(num_parts);
+    }
+    for (bool enable_mmap : {true, false})
+    {
+        benchmark_explicit_reads(enable_mmap, 0);
+        benchmark_explicit_reads(enable_mmap, 1 << 26);
+    }
+    for (bool enable_io_uring : {false, true})
+    {
+        for (uint64_t batch_size : {1, 16, 256})
+        {
+            benchmark_get_batch(enable_io_uring, batch_size);
+        }
+    }
+    for (bool pin_internal_nodes : {false, true})
+    {
+        benchmark_pin_internal_nodes(pin_internal_nodes);
+    }
 
     return 0;
 }
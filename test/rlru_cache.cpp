@@ -0,0 +1,235 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// #define NINEDB_PROFILING
+
+#include "../src/ninedb/detail/rlru_cache.hpp"
+#include "../src/ninedb/detail/sharded_rlru_cache.hpp"
+
+using namespace ninedb::detail;
+
+/**
+ * Generate keys with a skewed distribution, where lower keys are accessed more often.
+ */
+void generate_keys_skewed(uint64_t count, uint64_t num_keys, uint64_t seed, std::vector<uint64_t> &keys)
+{
+    std::mt19937_64 rng(seed);
+    std::exponential_distribution<double> distribution(8.0 / num_keys);
+    for (uint64_t i = 0; i < count; i++)
+    {
+        keys.push_back(static_cast<uint64_t>(distribution(rng)) % num_keys);
+    }
+}
+
+void test_weighted_size()
+{
+    RLRUCache<uint64_t, std::string> cache(100, [](const std::string &value)
+                                           { return value.size(); });
+    for (uint64_t i = 0; i < 100; i++)
+    {
+        cache.put(i, std::string(10, 'x'));
+        if (cache.get_size() > 100)
+        {
+            std::cout << "test_weighted_size failed" << std::endl;
+            exit(1);
+        }
+    }
+
+    std::string value;
+    if (!cache.try_get(99, value) || value.size() != 10)
+    {
+        std::cout << "test_weighted_size failed" << std::endl;
+        exit(1);
+    }
+
+    // An item larger than the capacity is kept on its own
+    cache.put(100, std::string(200, 'x'));
+    if (!cache.exists(100) || cache.get_size() != 200)
+    {
+        std::cout << "test_weighted_size failed" << std::endl;
+        exit(1);
+    }
+
+    std::cout << "test_weighted_size done" << std::endl;
+}
+
+void test_pinning()
+{
+    RLRUCache<uint64_t, uint64_t> cache(10);
+    for (uint64_t i = 0; i < 10; i++)
+    {
+        cache.put(i, i);
+    }
+
+    uint64_t value;
+    for (uint64_t i = 0; i < 5; i++)
+    {
+        if (!cache.try_get_and_pin(i, value) || value != i)
+        {
+            std::cout << "test_pinning failed" << std::endl;
+            exit(1);
+        }
+    }
+    for (uint64_t i = 10; i < 100; i++)
+    {
+        cache.put(i, i);
+    }
+    for (uint64_t i = 0; i < 5; i++)
+    {
+        if (!cache.exists(i))
+        {
+            std::cout << "test_pinning failed" << std::endl;
+            exit(1);
+        }
+    }
+
+    // Pin as many items as the capacity, so the cache has to grow beyond its capacity
+    for (uint64_t i = 5; i < 10; i++)
+    {
+        cache.put(i, i);
+        cache.try_get_and_pin(i, value);
+    }
+    for (uint64_t i = 100; i < 105; i++)
+    {
+        cache.put(i, i);
+    }
+    if (cache.get_size() != 11)
+    {
+        std::cout << "test_pinning failed" << std::endl;
+        exit(1);
+    }
+
+    // Unpinning shrinks the cache back to its capacity
+    for (uint64_t i = 0; i < 10; i++)
+    {
+        cache.unpin(i);
+    }
+    if (cache.get_size() != 10)
+    {
+        std::cout << "test_pinning failed" << std::endl;
+        exit(1);
+    }
+
+    std::cout << "test_pinning done" << std::endl;
+}
+
+void test_sharded_concurrent()
+{
+    ShardedRLRUCache<uint64_t, uint64_t> cache(1000);
+
+    std::vector<std::thread> threads;
+    for (uint64_t t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&cache, t]()
+                             {
+            std::vector<uint64_t> keys;
+            generate_keys_skewed(100000, 10000, t, keys);
+            uint64_t value;
+            for (uint64_t key : keys)
+            {
+                if (cache.try_get_and_pin(key, value))
+                {
+                    if (value != key * 2)
+                    {
+                        std::cout << "test_sharded_concurrent failed" << std::endl;
+                        exit(1);
+                    }
+                    cache.unpin(key);
+                }
+                else
+                {
+                    cache.put(key, key * 2);
+                }
+            } });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    if (cache.get_size() > cache.get_max_size() + cache.get_num_shards())
+    {
+        std::cout << "test_sharded_concurrent failed" << std::endl;
+        exit(1);
+    }
+
+    std::cout << "test_sharded_concurrent done" << std::endl;
+}
+
+template <typename C, typename L>
+void run_benchmark(const char *name, C &cache, L &&lock, uint64_t num_threads)
+{
+    std::vector<std::vector<uint64_t>> thread_keys(num_threads);
+    for (uint64_t t = 0; t < num_threads; t++)
+    {
+        generate_keys_skewed(1000000 / num_threads, 100000, t, thread_keys[t]);
+    }
+
+    std::atomic<uint64_t> num_hits{0};
+    auto t1 = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    for (uint64_t t = 0; t < num_threads; t++)
+    {
+        threads.emplace_back([&, t]()
+                             {
+            uint64_t hits = 0;
+            uint64_t value;
+            for (uint64_t key : thread_keys[t])
+            {
+                [[maybe_unused]] auto guard = lock();
+                if (cache.try_get(key, value))
+                {
+                    hits++;
+                }
+                else
+                {
+                    cache.put(key, key);
+                }
+            }
+            num_hits += hits; });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
+    std::cout << name << " (" << num_threads << " threads): " << duration.count() << " μs, hit ratio " << num_hits * 100 / 1000000 << "%" << std::endl;
+}
+
+void benchmark_rlru_cache(uint64_t num_threads)
+{
+    RLRUCache<uint64_t, uint64_t> cache(10000);
+    std::mutex mutex;
+    run_benchmark("benchmark_rlru_cache", cache, [&mutex]()
+                  { return std::unique_lock<std::mutex>(mutex); }, num_threads);
+}
+
+void benchmark_sharded_rlru_cache(uint64_t num_threads)
+{
+    ShardedRLRUCache<uint64_t, uint64_t> cache(10000);
+    run_benchmark("benchmark_sharded_rlru_cache", cache, []()
+                  { return 0; }, num_threads);
+}
+
+int main()
+{
+    test_weighted_size();
+    test_pinning();
+    test_sharded_concurrent();
+
+    benchmark_rlru_cache(1);
+    benchmark_sharded_rlru_cache(1);
+    benchmark_rlru_cache(4);
+    benchmark_sharded_rlru_cache(4);
+
+    return 0;
+}